@@ -0,0 +1,135 @@
+/*
+ * demux_benchmark.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ * Measures how fast the segment storage and demuxer get through TS that is
+ * already in memory, so the network doesn't hide the cost of the parsing.
+ *
+ * demux_benchmark [options] [segment.ts]
+ *   --segments <n>   times the segment is played, default 200
+ *   --runs <n>       runs to take the best of, default 3
+ *   --verbose        print the addon log
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "../src/globals.h"
+#include "../src/hls/playlist_refresher.h"
+#include "../src/hls/stream.h"
+
+extern bool g_sim_verbose;
+
+// Has to look like http for the segments to go through the downloader
+const char * const BENCH_URL_PREFIX = "http://bench/segment";
+
+// Hands out the same segment for every location, in chunks the size of a
+// network read
+class MemoryDownloader : public Downloader {
+public:
+  MemoryDownloader(const std::string &contents) : contents(contents) {};
+  std::string download(std::string location) {
+    return contents;
+  };
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func) {
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(contents.data());
+    for(size_t pos = 0; pos < contents.length(); pos += read_size) {
+      if (!func(data + pos, std::min(read_size, contents.length() - pos))) {
+        return false;
+      }
+    }
+    return true;
+  };
+private:
+  std::string contents;
+};
+
+struct BenchResult {
+  BenchResult() : bytes(0), packets(0), packet_bytes(0), seconds(0) {};
+  uint64_t bytes;
+  uint64_t packets;
+  // Should stay the same when the demuxer changes
+  uint64_t packet_bytes;
+  double seconds;
+};
+
+static BenchResult run(const std::string &contents, size_t segment_count) {
+  hls::MediaPlaylist playlist;
+  std::stringstream playlist_contents;
+  playlist_contents << "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#EXT-X-MEDIA-SEQUENCE:0\n";
+  for(size_t i = 0; i < segment_count; ++i) {
+    playlist_contents << "#EXTINF:10,\n" << BENCH_URL_PREFIX << i << ".ts\n";
+  }
+  playlist_contents << "#EXT-X-ENDLIST\n";
+  playlist.load_contents(playlist_contents.str());
+
+  MemoryDownloader downloader(contents);
+  RequestScheduler request_scheduler(&downloader);
+  WorkerPool worker_pool(4);
+  hls::PlaylistRefresher playlist_refresher(&request_scheduler, &worker_pool);
+
+  BenchResult result;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    StreamContainer stream(playlist, &request_scheduler, &worker_pool, &playlist_refresher, nullptr,
+        playlist.get_segments().front(), Keyframe());
+    while(true) {
+      DemuxContainer container = stream.get_demux()->Read();
+      if (!container.demux_packet) {
+        break;
+      }
+      if (!container.stalled) {
+        ++result.packets;
+        result.packet_bytes += container.demux_packet->iSize;
+      }
+      ipsh->FreeDemuxPacket(container.demux_packet);
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  result.bytes = contents.length() * segment_count;
+  result.seconds = elapsed.count();
+  return result;
+}
+
+int main(int argc, char **argv) {
+  std::string segment_path = "test/hls/gear1/fileSequence0.ts";
+  size_t segment_count = 200;
+  size_t runs = 3;
+  for(int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--segments") == 0 && i + 1 < argc) {
+      segment_count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      g_sim_verbose = true;
+    } else {
+      segment_path = argv[i];
+    }
+  }
+
+  std::ifstream file(segment_path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  if (!file || contents.str().empty()) {
+    std::cerr << "Unable to read " << segment_path << "\n";
+    return 1;
+  }
+
+  BenchResult best;
+  for(size_t i = 0; i < runs; ++i) {
+    BenchResult result = run(contents.str(), segment_count);
+    std::cout << "run " << i + 1 << ": " << result.bytes / 1e6 << " MB " << result.packets << " packets (" <<
+        result.packet_bytes << " bytes) in " <<
+        result.seconds << " s, " << result.bytes / 1e6 / result.seconds << " MB/s\n";
+    if (best.seconds == 0 || result.seconds < best.seconds) {
+      best = result;
+    }
+  }
+  std::cout << "best: " << best.bytes / 1e6 / best.seconds << " MB/s, " <<
+      best.packets / best.seconds << " packets/s\n";
+  return 0;
+}
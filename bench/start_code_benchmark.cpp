@@ -0,0 +1,122 @@
+/*
+ * start_code_benchmark.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ * Measures the start code search on its own, byte at a time against
+ * FindStartCode, and the H.264 parser that uses it.
+ *
+ * start_code_benchmark [options] [video.h264]
+ *   --passes <n>     times the video is gone through per run, default 200
+ *   --runs <n>       runs to take the best of, default 3
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#include "../src/demuxer/ES_h264.h"
+#include "../src/demuxer/start_code.h"
+
+// Payload of a TS packet, how the demuxer hands the video to the parser
+const size_t PAYLOAD_SIZE = 184;
+
+struct BenchResult {
+  BenchResult() : count(0), seconds(0) {};
+  // Should be the same for every search
+  uint64_t count;
+  double seconds;
+};
+
+// The search the parsers did before, a register shifted a byte at a time
+static uint64_t count_scalar(const unsigned char *data, size_t len) {
+  uint64_t count = 0;
+  uint32_t startcode = 0xffffffff;
+  for(size_t i = 0; i < len; ++i) {
+    startcode = startcode << 8 | data[i];
+    if ((startcode & 0x00ffffff) == 0x00000001) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+static uint64_t count_find_start_code(const unsigned char *data, size_t len) {
+  uint64_t count = 0;
+  for(size_t pos = TSDemux::FindStartCode(data, len); pos < len;
+      pos += 1 + TSDemux::FindStartCode(data + pos + 1, len - pos - 1)) {
+    ++count;
+  }
+  return count;
+}
+
+// Packets out of the parser
+static uint64_t count_h264_packets(const unsigned char *data, size_t len) {
+  uint64_t count = 0;
+  TSDemux::ES_h264 parser(0x100);
+  TSDemux::STREAM_PKT pkt;
+  for(size_t pos = 0; pos < len; pos += PAYLOAD_SIZE) {
+    parser.Append(data + pos, std::min(PAYLOAD_SIZE, len - pos), pos == 0);
+    while(parser.GetStreamPacket(&pkt)) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+static BenchResult run(const std::string &contents, size_t passes,
+    std::function<uint64_t(const unsigned char*, size_t)> func) {
+  const unsigned char *data = reinterpret_cast<const unsigned char*>(contents.data());
+  BenchResult result;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < passes; ++i) {
+    result.count += func(data, contents.length());
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+  return result;
+}
+
+static void bench(const char *name, const std::string &contents, size_t passes, size_t runs,
+    std::function<uint64_t(const unsigned char*, size_t)> func) {
+  BenchResult best;
+  for(size_t i = 0; i < runs; ++i) {
+    BenchResult result = run(contents, passes, func);
+    if (best.seconds == 0 || result.seconds < best.seconds) {
+      best = result;
+    }
+  }
+  double bytes = contents.length() * passes;
+  std::cout << name << ": " << best.count / passes << " found, " << bytes / 1e6 / best.seconds << " MB/s\n";
+}
+
+int main(int argc, char **argv) {
+  std::string video_path = "test/encrypted/video.h264";
+  size_t passes = 200;
+  size_t runs = 3;
+  for(int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+      passes = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else {
+      video_path = argv[i];
+    }
+  }
+
+  std::ifstream file(video_path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  if (!file || contents.str().empty()) {
+    std::cerr << "Unable to read " << video_path << "\n";
+    return 1;
+  }
+
+  bench("scalar", contents.str(), passes, runs, count_scalar);
+  bench("FindStartCode", contents.str(), passes, runs, count_find_start_code);
+  bench("ES_h264", contents.str(), passes, runs, count_h264_packets);
+  return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * main.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ * Replays network traces through the real Session, StreamContainer and
+ * Demux pipeline and scores the ABR decisions.
+ *
+ * hls_simulator [options] trace...
+ *   --master <path>      master playlist, default test/hls/bipbopall.m3u8
+ *   --segments <n>       segments to play, default 30
+ *   --speedup <n>        virtual seconds per real second, default 20
+ *   --bandwidth <bits>   initial bandwidth estimate, default 400000
+ *   --verbose            print the addon log
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "../src/globals.h"
+#include "../src/hls/session.h"
+#include "network_trace.h"
+#include "throttled_downloader.h"
+#include "virtual_clock.h"
+
+extern bool g_sim_verbose;
+
+// Media the player holds on to, like the buffer in front of the decoder
+const double PLAYER_BUFFER_SECONDS = 2.0;
+// Media the player waits for before starting or resuming playback
+const double PLAYER_RESUME_SECONDS = 1.0;
+// Virtual time to wait when the player doesn't need data
+const double PLAYER_POLL_SECONDS = 0.1;
+// QoE = average bitrate (kbit/s) - REBUFFER_PENALTY * rebuffer seconds per
+// minute - SWITCH_PENALTY * switches per minute
+const double REBUFFER_PENALTY = 100.0;
+const double SWITCH_PENALTY = 10.0;
+
+struct SimResult {
+  SimResult() : startup_delay(-1), rebuffer_count(0), rebuffer_duration(0),
+    switch_count(0), media_time(0), bitrate_time(0) {};
+  double startup_delay;
+  uint32_t rebuffer_count;
+  double rebuffer_duration;
+  uint32_t switch_count;
+  double media_time;
+  // Sum of bitrate * seconds played at that bitrate
+  double bitrate_time;
+  double get_average_bitrate() const { return media_time > 0 ? bitrate_time / media_time : 0; };
+  double get_qoe() const {
+    double minutes = std::max(media_time / 60.0, 1.0 / 60.0);
+    return get_average_bitrate() / 1000.0 - REBUFFER_PENALTY * rebuffer_duration / minutes -
+        SWITCH_PENALTY * switch_count / minutes;
+  };
+};
+
+struct SimOptions {
+  SimOptions() : master("test/hls/bipbopall.m3u8"), segments(30), speedup(20),
+    initial_bandwidth(400000) {};
+  std::string master;
+  size_t segments;
+  double speedup;
+  double initial_bandwidth;
+};
+
+static SimResult simulate(const SimOptions &options, const NetworkTrace &trace) {
+  hls::FileMasterPlaylist master_playlist;
+  master_playlist.open(options.master.c_str());
+
+  // The variant with the most segments sets the timeline, the variant whose
+  // segments exist on disk provides the media for all of them
+  std::string timeline_playlist;
+  size_t most_segments = 0;
+  std::vector<std::string> source_segments;
+  for(auto it = master_playlist.get_media_playlists().begin(); it != master_playlist.get_media_playlists().end(); ++it) {
+    if (it->get_segments().size() > most_segments) {
+      most_segments = it->get_segments().size();
+      timeline_playlist = it->get_url();
+    }
+    if (source_segments.empty()) {
+      for(auto segment = it->get_segments().begin(); segment != it->get_segments().end(); ++segment) {
+        FILE *f = fopen(segment->get_url().c_str(), "rb");
+        if (!f) {
+          source_segments.clear();
+          break;
+        }
+        fclose(f);
+        source_segments.push_back(segment->get_url());
+      }
+    }
+  }
+  SimContent content(timeline_playlist, options.segments, source_segments);
+  for(auto it = master_playlist.get_media_playlists().begin(); it != master_playlist.get_media_playlists().end(); ++it) {
+    // Everything has to come through the throttled downloader
+    it->set_url(SIM_URL_PREFIX + it->get_url());
+    it->clear_segments();
+    content.add_variant(it->get_url(), it->bandwidth);
+  }
+
+  VirtualClock clock(options.speedup);
+  SimResult result;
+  hls::Session session(master_playlist,
+      new ThrottledDownloader(trace, clock, content, options.initial_bandwidth), 0, 0, false);
+
+  int main_stream = -1;
+  // Media seconds the player has presented
+  double position = 0;
+  double last_update = 0;
+  bool rebuffering = false;
+  double rebuffer_start = 0;
+  uint32_t current_bandwidth = 0;
+  double time_limit = content.get_total_duration() * 4 + 120;
+  while(clock.now() < time_limit) {
+    double now = clock.now();
+    if (result.startup_delay >= 0) {
+      if (!rebuffering) {
+        position += now - last_update;
+        if (position >= result.media_time) {
+          // Player ran dry
+          position = result.media_time;
+          rebuffering = true;
+          rebuffer_start = now;
+          ++result.rebuffer_count;
+        }
+      }
+      last_update = now;
+      if (!rebuffering && result.media_time - position > PLAYER_BUFFER_SECONDS) {
+        std::this_thread::sleep_for(clock.to_real(PLAYER_POLL_SECONDS));
+        continue;
+      }
+    }
+
+    DemuxContainer container = session.get_current_pkt();
+    session.read_next_pkt();
+    DemuxPacket *packet = container.demux_packet;
+    if (!packet) {
+      // End of the stream
+      break;
+    } else if (container.stalled || packet->iStreamId < 0) {
+      ipsh->FreeDemuxPacket(packet);
+      continue;
+    }
+
+    if (main_stream < 0) {
+      // Streams are known once the demuxer has output a packet
+      INPUTSTREAM_IDS ids = session.get_streams();
+      for(size_t i = 0; i < ids.m_streamCount; ++i) {
+        if (session.get_stream(ids.m_streamIds[i]).m_streamType == INPUTSTREAM_INFO::TYPE_VIDEO) {
+          main_stream = ids.m_streamIds[i];
+        }
+      }
+    }
+    if (packet->iStreamId == main_stream) {
+      uint32_t bandwidth = content.get_bandwidth(container.segment.get_url());
+      if (current_bandwidth && bandwidth != current_bandwidth) {
+        ++result.switch_count;
+      }
+      current_bandwidth = bandwidth;
+      double duration = packet->duration / DVD_TIME_BASE;
+      result.media_time += duration;
+      result.bitrate_time += bandwidth * duration;
+
+      double buffered = result.media_time - position;
+      if (result.startup_delay < 0 && buffered >= PLAYER_RESUME_SECONDS) {
+        result.startup_delay = now;
+        last_update = now;
+      } else if (rebuffering && buffered >= PLAYER_RESUME_SECONDS) {
+        rebuffering = false;
+        result.rebuffer_duration += now - rebuffer_start;
+      }
+    }
+    ipsh->FreeDemuxPacket(packet);
+  }
+  return result;
+}
+
+static void usage() {
+  std::cerr << "usage: hls_simulator [--master <path>] [--segments <n>] [--speedup <n>] "
+      "[--bandwidth <bits/s>] [--verbose] trace..." << std::endl;
+}
+
+int main(int argc, char **argv) {
+  SimOptions options;
+  std::vector<std::string> trace_files;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--master" && has_value) {
+      options.master = argv[++i];
+    } else if (arg == "--segments" && has_value) {
+      options.segments = std::atoi(argv[++i]);
+    } else if (arg == "--speedup" && has_value) {
+      options.speedup = std::atof(argv[++i]);
+    } else if (arg == "--bandwidth" && has_value) {
+      options.initial_bandwidth = std::atof(argv[++i]);
+    } else if (arg == "--verbose") {
+      g_sim_verbose = true;
+    } else if (arg.find("--") == 0) {
+      usage();
+      return 1;
+    } else {
+      trace_files.push_back(arg);
+    }
+  }
+  if (trace_files.empty()) {
+    usage();
+    return 1;
+  }
+
+  printf("%-24s %10s %9s %11s %9s %13s %9s\n", "trace", "startup(s)", "rebuffers",
+      "rebuffer(s)", "switches", "bitrate(kbps)", "qoe");
+  double total_qoe = 0;
+  for(auto it = trace_files.begin(); it != trace_files.end(); ++it) {
+    NetworkTrace trace;
+    if (!trace.load(*it)) {
+      std::cerr << "Unable to load trace " << *it << std::endl;
+      return 1;
+    }
+    SimResult result = simulate(options, trace);
+    printf("%-24s %10.2f %9u %11.2f %9u %13.1f %9.1f\n", trace.get_name().c_str(),
+        result.startup_delay, result.rebuffer_count, result.rebuffer_duration, result.switch_count,
+        result.get_average_bitrate() / 1000.0, result.get_qoe());
+    total_qoe += result.get_qoe();
+  }
+  printf("average qoe %.1f\n", total_qoe / trace_files.size());
+  return 0;
+}
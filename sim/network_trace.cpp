@@ -0,0 +1,86 @@
+/*
+ * network_trace.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "network_trace.h"
+
+bool NetworkTrace::load(std::string file_path) {
+  std::ifstream trace_file(file_path);
+  if (!trace_file.is_open()) {
+    return false;
+  }
+  size_t name_start = file_path.find_last_of("/\\");
+  name = name_start == std::string::npos ? file_path : file_path.substr(name_start + 1);
+  std::string line;
+  while(std::getline(trace_file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream values(line);
+    double duration, bandwidth_kbit, latency_ms;
+    if (values >> duration >> bandwidth_kbit >> latency_ms) {
+      add_period(duration, bandwidth_kbit * 1000, latency_ms / 1000.0);
+    }
+  }
+  // A trace without any bandwidth would never finish a transfer
+  for(auto it = periods.begin(); it != periods.end(); ++it) {
+    if (it->bandwidth > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void NetworkTrace::add_period(double duration, double bandwidth, double latency) {
+  if (duration <= 0) {
+    return;
+  }
+  periods.push_back({duration, bandwidth, latency});
+  total_duration += duration;
+}
+
+const NetworkTrace::Period &NetworkTrace::get_period(double t, double &period_end) const {
+  double loop_start = std::floor(t / total_duration) * total_duration;
+  period_end = loop_start;
+  for(auto it = periods.begin(); it != periods.end(); ++it) {
+    period_end += it->duration;
+    if (t < period_end) {
+      return *it;
+    }
+  }
+  return periods.back();
+}
+
+double NetworkTrace::get_bandwidth(double t) const {
+  double period_end;
+  return get_period(t, period_end).bandwidth;
+}
+
+double NetworkTrace::get_latency(double t) const {
+  double period_end;
+  return get_period(t, period_end).latency;
+}
+
+double NetworkTrace::get_transfer_end(double start, double bits) const {
+  double t = start;
+  while(bits > 0) {
+    double period_end;
+    const Period &period = get_period(t, period_end);
+    if (period.bandwidth <= 0) {
+      // Outage, nothing gets through until the next period
+      t = period_end;
+      continue;
+    }
+    double period_bits = (period_end - t) * period.bandwidth;
+    if (period_bits >= bits) {
+      return t + bits / period.bandwidth;
+    }
+    bits -= period_bits;
+    t = period_end;
+  }
+  return t;
+}
@@ -0,0 +1,47 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+// Bandwidth and latency over time.  Trace files have one period per line:
+//   <duration seconds> <bandwidth kbit/s> <latency ms>
+// Lines starting with # are comments.  The trace repeats once it runs out.
+class NetworkTrace {
+public:
+  NetworkTrace() : total_duration(0) {};
+  bool load(std::string file_path);
+  void add_period(double duration, double bandwidth, double latency);
+  std::string get_name() const { return name; };
+  // Bits per second at virtual time t
+  double get_bandwidth(double t) const;
+  // Seconds of latency for a request made at t
+  double get_latency(double t) const;
+  // Time at which bits sent from start have been received
+  double get_transfer_end(double start, double bits) const;
+private:
+  struct Period {
+    double duration;
+    double bandwidth;
+    double latency;
+  };
+  const Period &get_period(double t, double &period_end) const;
+  std::string name;
+  std::vector<Period> periods;
+  double total_duration;
+};
@@ -0,0 +1,129 @@
+/*
+ * throttled_downloader.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "throttled_downloader.h"
+
+SimContent::SimContent(std::string timeline_playlist, size_t max_segments, std::vector<std::string> source_segments) :
+total_duration(0),
+source_segments(source_segments) {
+  std::istringstream lines(read_file(timeline_playlist));
+  std::string line;
+  double duration = 0;
+  size_t number_of_segments = 0;
+  while(std::getline(lines, line) && number_of_segments < max_segments) {
+    if (line.find("#EXT-X-ENDLIST") == 0) {
+      break;
+    }
+    playlist_contents += line + "\n";
+    if (line.find("#EXTINF:") == 0) {
+      duration = std::atof(line.c_str() + 8);
+    } else if (!line.empty() && line[0] != '#') {
+      segment_durations[line] = duration;
+      total_duration += duration;
+      ++number_of_segments;
+    }
+  }
+  playlist_contents += "#EXT-X-ENDLIST\n";
+}
+
+void SimContent::add_variant(std::string url, uint32_t bandwidth) {
+  variants[url.substr(0, url.find_last_of('/') + 1)] = bandwidth;
+}
+
+std::string SimContent::read_file(std::string file_path) {
+  std::ifstream file(file_path, std::ios::binary);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+uint32_t SimContent::get_bandwidth(std::string url) {
+  auto it = variants.find(url.substr(0, url.find_last_of('/') + 1));
+  return it == variants.end() ? 0 : it->second;
+}
+
+std::string SimContent::get(std::string url, double &nominal_bytes) {
+  if (url.find(".m3u8") != std::string::npos) {
+    nominal_bytes = playlist_contents.length();
+    return playlist_contents;
+  }
+  std::string name = url.substr(url.find_last_of('/') + 1);
+  std::string file_path = url.substr(SIM_URL_PREFIX.length());
+  std::lock_guard<std::mutex> lock(content_mutex);
+  auto cached = file_cache.find(file_path);
+  if (cached == file_cache.end()) {
+    std::string contents = read_file(file_path);
+    if (contents.empty() && !source_segments.empty()) {
+      size_t digits = name.find_first_of("0123456789");
+      size_t index = digits == std::string::npos ? 0 : std::atoi(name.c_str() + digits);
+      contents = read_file(source_segments.at(index % source_segments.size()));
+    }
+    cached = file_cache.insert({file_path, contents}).first;
+  }
+  nominal_bytes = cached->second.length();
+  uint32_t bandwidth = get_bandwidth(url);
+  auto duration = segment_durations.find(name);
+  if (bandwidth && duration != segment_durations.end()) {
+    nominal_bytes = bandwidth * duration->second / 8;
+  }
+  return cached->second;
+}
+
+ThrottledDownloader::ThrottledDownloader(const NetworkTrace &trace, const VirtualClock &clock,
+    SimContent &content, double initial_bandwidth) :
+Downloader(initial_bandwidth),
+trace(trace),
+clock(clock),
+content(content),
+link_free_at(0) {
+}
+
+void ThrottledDownloader::transfer(double nominal_bytes) {
+  double request_time = clock.now();
+  double start, end;
+  {
+    std::lock_guard<std::mutex> lock(link_mutex);
+    start = std::max(request_time + trace.get_latency(request_time), link_free_at);
+    end = trace.get_transfer_end(start, nominal_bytes * 8);
+    link_free_at = end;
+  }
+  std::this_thread::sleep_for(clock.to_real(end - clock.now()));
+  if (nominal_bytes >= BANDWIDTH_MIN_TRANSFER_BYTES) {
+    // Waiting for the link isn't part of the transfer, the latency is
+    double queued = std::max(0.0, start - (request_time + trace.get_latency(request_time)));
+    bandwidth_estimator.add_sample(nominal_bytes, end - request_time - queued);
+  }
+}
+
+std::string ThrottledDownloader::download(std::string location) {
+  double nominal_bytes;
+  std::string contents = content.get(location, nominal_bytes);
+  transfer(nominal_bytes);
+  return contents;
+}
+
+bool ThrottledDownloader::download(std::string location, uint32_t byte_offset, uint32_t byte_length,
+    DownloadCallback func) {
+  std::string contents = download(location);
+  if (byte_offset >= contents.length()) {
+    return false;
+  }
+  size_t end = contents.length();
+  if (byte_length) {
+    end = std::min<size_t>(end, byte_offset + byte_length);
+  }
+  const uint8_t *data = reinterpret_cast<const uint8_t*>(contents.data());
+  for(size_t pos = byte_offset; pos < end; pos += read_size) {
+    if (!func(data + pos, std::min(read_size, end - pos))) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../src/downloader/downloader.h"
+#include "network_trace.h"
+#include "virtual_clock.h"
+
+// Urls have to look like http for SegmentStorage to use our downloader
+const std::string SIM_URL_PREFIX = "http://sim/";
+
+// Serves the test fixtures under SIM_URL_PREFIX.  Every variant playlist is
+// served as the timeline playlist so all variants cover the same segments,
+// segments missing from the fixtures are replaced by the source segments.
+// Each segment is accounted for at the size it would have at the bitrate
+// of its variant.
+class SimContent {
+public:
+  SimContent(std::string timeline_playlist, size_t max_segments, std::vector<std::string> source_segments);
+  void add_variant(std::string url, uint32_t bandwidth);
+  std::string get(std::string url, double &nominal_bytes);
+  // Bandwidth of the variant a segment belongs to, 0 if unknown
+  uint32_t get_bandwidth(std::string url);
+  double get_total_duration() { return total_duration; };
+private:
+  std::string read_file(std::string file_path);
+  std::string playlist_contents;
+  std::map<std::string, double> segment_durations;
+  double total_duration;
+  std::vector<std::string> source_segments;
+  // Directory url of the variant to its bandwidth
+  std::map<std::string, uint32_t> variants;
+  std::mutex content_mutex;
+  std::map<std::string, std::string> file_cache;
+};
+
+// Downloader that takes as long as the network trace says.  Transfers share
+// one link and go through it one at a time.
+class ThrottledDownloader : public Downloader {
+public:
+  ThrottledDownloader(const NetworkTrace &trace, const VirtualClock &clock, SimContent &content,
+      double initial_bandwidth);
+  std::string download(std::string location);
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func);
+private:
+  void transfer(double nominal_bytes);
+  const NetworkTrace &trace;
+  const VirtualClock &clock;
+  SimContent &content;
+  std::mutex link_mutex;
+  double link_free_at;
+};
@@ -0,0 +1,39 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chrono>
+
+// Clock for the simulation, runs speedup times faster than real time.
+// Times are in seconds since the clock was created.
+class VirtualClock {
+public:
+  VirtualClock(double speedup) :
+    speedup(speedup), start(std::chrono::steady_clock::now()) {};
+  double now() const {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() * speedup;
+  };
+  // Real time for a span of virtual time
+  std::chrono::microseconds to_real(double seconds) const {
+    return std::chrono::microseconds((long long) (seconds / speedup * 1000000));
+  };
+  double get_speedup() const { return speedup; };
+private:
+  double speedup;
+  std::chrono::steady_clock::time_point start;
+};
@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <sstream>
+#include <chrono>
+#include <ctime>
 
 #include "xbmc_addon_types.h"
 #include "libXBMC_addon.h"
@@ -158,6 +160,7 @@ extern "C" {
   bool Open(INPUTSTREAM& props)
   {
     xbmc->Log(ADDON::LOG_DEBUG, "Open()");
+    std::chrono::steady_clock::time_point open_time = std::chrono::steady_clock::now();
 
     const char *lt(""), *lk(""), *ld("");
     for (unsigned int i(0); i < props.m_nCountInfoValues; ++i)
@@ -181,14 +184,16 @@ extern "C" {
 
     kodihost.SetProfilePath(props.m_profileFolder);
 
-    std::string fn(std::string(props.m_profileFolder) + "bandwidth.bin");
-    FILE* f = fopen(fn.c_str(), "rb");
-    double bandwidth = 4000000;
-    if (f) {
-      fread(&bandwidth, sizeof(double), 1, f);
-      fclose(f);
+    std::string profile_path(props.m_profileFolder);
+    ThroughputHistory throughput_history;
+    throughput_history.load(profile_path + THROUGHPUT_HISTORY_FILE, profile_path + LEGACY_BANDWIDTH_FILE);
+    std::string host(get_url_host(props.m_strURL));
+    double bandwidth = throughput_history.get_start_bandwidth(host, std::time(nullptr));
+    if (bandwidth <= 0) {
+      bandwidth = 4000000;
     }
-    xbmc->Log(ADDON::LOG_DEBUG, "Initial bandwidth: %f ", bandwidth);
+    xbmc->Log(ADDON::LOG_DEBUG, "Initial bandwidth for %s: %f latency: %f", host.c_str(), bandwidth,
+        throughput_history.get_latency(host, std::time(nullptr)));
 
     int min_bandwidth(0);
     xbmc->GetSetting("MINBANDWIDTH", (char*)&min_bandwidth);
@@ -202,12 +207,40 @@ extern "C" {
     xbmc->GetSetting("STREAMSELECTION", (char*)&buf);
     xbmc->Log(ADDON::LOG_DEBUG, "STREAMSELECTION selected: %d ", buf);
     bool manual_streams = buf != 0;
-
+    buf = 0;
+    xbmc->GetSetting("DOWNLOADER", (char*)&buf);
+    xbmc->Log(ADDON::LOG_DEBUG, "DOWNLOADER selected: %d ", buf);
+    bool native_downloader = buf != 0;
+
+    int live_hold_back(0);
+    xbmc->GetSetting("LIVEHOLDBACK", (char*)&live_hold_back);
+    xbmc->Log(ADDON::LOG_DEBUG, "LIVEHOLDBACK selected: %d ", live_hold_back);
+    hls::StartOptions start_options;
+    start_options.hold_back = live_hold_back;
+    bool fast_start(true);
+    xbmc->GetSetting("FASTSTART", (char*)&fast_start);
+    xbmc->Log(ADDON::LOG_DEBUG, "FASTSTART selected: %d ", fast_start);
+
+    Downloader *downloader = create_downloader(bandwidth, native_downloader);
+    hls::StartupPrefetcher *startup_prefetcher = nullptr;
     KodiMasterPlaylist master_playlist;
+    if (fast_start) {
+      // The first variant the settings and the history of the host allow
+      // starts downloading while the rest of the master playlist is read
+      startup_prefetcher = new hls::StartupPrefetcher(downloader, start_options);
+      master_playlist.set_variant_listener([&](const hls::MediaPlaylist &variant) {
+        if (variant.bandwidth >= min_bandwidth && (variant.bandwidth <= max_bandwidth || max_bandwidth == 0) &&
+            variant.bandwidth <= bandwidth) {
+          startup_prefetcher->start(variant.get_url());
+        }
+      });
+    }
     master_playlist.open(props.m_strURL);
+    master_playlist.set_variant_listener(nullptr);
     master_playlist.select_media_playlist();
-    hls_session = new KodiSession(master_playlist, bandwidth, props.m_profileFolder,
-        min_bandwidth, max_bandwidth, manual_streams);
+    hls_session = new KodiSession(master_playlist, downloader, profile_path,
+        min_bandwidth, max_bandwidth, manual_streams, startup_prefetcher, live_hold_back);
+    hls_session->set_start_time(open_time);
 
     return true;
   }
@@ -269,7 +302,8 @@ extern "C" {
   void EnableStream(int streamid, bool enable)
   {
     xbmc->Log(ADDON::LOG_DEBUG, "EnableStream(%d: %s)", streamid, enable?"true":"false");
-    // TODO: Unsure if I need to support EnableStream
+    if (hls_session)
+      hls_session->enable_stream(streamid, enable);
   }
 
   // Doesn't cause any skpping, so it is something related
@@ -389,7 +423,8 @@ extern "C" {
 
   bool IsRealTimeStream(void)
   {
-    return false;
+    // Lets Kodi speed playback up a little to stay close to the live edge
+    return hls_session && hls_session->is_live();
   }
 
 }//extern "C"
@@ -22,12 +22,18 @@ class DemuxContainer {
 public:
   DemuxContainer() : demux_packet(0), pcr(0),
   segment_changed(false),
+  current_time(0),
   discontinuity(false),
-  current_time(0) {};
+  stalled(false),
+  keyframe(true) {};
   DemuxPacket *demux_packet;
   uint64_t pcr;
   hls::Segment segment;
   bool segment_changed;
   int32_t current_time;
   bool discontinuity;
+  // Demuxer had no packets ready, demux_packet is an empty packet
+  bool stalled;
+  // Decoding can start at this packet, false for video that isn't an IDR
+  bool keyframe;
 };
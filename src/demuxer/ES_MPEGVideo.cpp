@@ -21,6 +21,9 @@
 #include "ES_MPEGVideo.h"
 #include "bitstream.h"
 #include "debug.h"
+#include "start_code.h"
+
+#include <algorithm>
 
 using namespace TSDemux;
 
@@ -65,6 +68,7 @@ ES_MPEG2Video::ES_MPEG2Video(uint16_t pid)
   m_AuPTS             = 0;
   m_AuPrevDTS         = 0;
   m_TemporalReference = 0;
+  m_PicCodingType     = 0;
   m_TrLastTime        = 0;
   m_PicNumber         = 0;
   m_FpsScale          = 0;
@@ -92,7 +96,14 @@ void ES_MPEG2Video::Parse(STREAM_PKT *pkt)
         break;
       }
     }
-    startcode = startcode << 8 | es_buf[p++];
+    // Unless the last bytes can be part of one, go straight to the next start code
+    if ((startcode & 0xff) == 0 || (startcode & 0xffffff) == 0x000001)
+      startcode = startcode << 8 | es_buf[p++];
+    else
+    {
+      int next = p + (int)FindStartCode(es_buf + p, es_len - p) + 4;
+      startcode = SkipToPosition(startcode, es_buf, p, std::min(next, (int)es_len - 3));
+    }
   }
   es_parsed = p;
   m_StartCode = startcode;
@@ -121,6 +132,7 @@ void ES_MPEG2Video::Parse(STREAM_PKT *pkt)
       pkt->pts          = m_PTS;
       pkt->duration     = m_FrameDuration;
       pkt->streamChange = streamChange;
+      pkt->keyframe     = m_PicCodingType == PKT_I_FRAME;
     }
     m_StartCode = 0xffffffff;
     es_parsed = es_consumed;
@@ -277,6 +289,7 @@ bool ES_MPEG2Video::Parse_MPEG2Video_PicStart(uint8_t *buf)
   if (pct < PKT_I_FRAME || pct > PKT_B_FRAME)
     return true; /* Illegal picture_coding_type */
 
+  m_PicCodingType = pct;
   if (pct == PKT_I_FRAME)
     m_NeedIFrame = false;
 
@@ -41,6 +41,7 @@ namespace TSDemux
     int64_t         m_PTS;
     int64_t         m_AuDTS, m_AuPTS, m_AuPrevDTS;
     int             m_TemporalReference;
+    int             m_PicCodingType;
     int             m_TrLastTime;
     int             m_PicNumber;
     int             m_FpsScale;
@@ -21,7 +21,9 @@
 #include "ES_h264.h"
 #include "bitstream.h"
 #include "debug.h"
+#include "start_code.h"
 
+#include <algorithm>
 #include <cstring>      // for memset memcpy
 
 using namespace TSDemux;
@@ -85,7 +87,14 @@ void ES_h264::Parse(STREAM_PKT* pkt)
         break;
       }
     }
-    startcode = startcode << 8 | es_buf[p++];
+    // Unless the last bytes can be part of one, go straight to the next start code
+    if ((startcode & 0xff) == 0 || (startcode & 0xffffff) == 0x000001)
+      startcode = startcode << 8 | es_buf[p++];
+    else
+    {
+      size_t next = p + FindStartCode(es_buf + p, es_len - p) + 4;
+      startcode = SkipToPosition(startcode, es_buf, p, std::min(next, es_len - 3));
+    }
   }
   es_parsed = p;
   m_StartCode = startcode;
@@ -120,6 +129,7 @@ void ES_h264::Parse(STREAM_PKT* pkt)
       pkt->pts            = m_PTS;
       pkt->duration       = duration;
       pkt->streamChange   = streamChange;
+      pkt->keyframe       = m_streamData.vcl_nal.nal_unit_type == 5;
     }
     m_StartCode = 0xffffffff;
     es_parsed = es_consumed;
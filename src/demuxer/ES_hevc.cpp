@@ -23,7 +23,9 @@
 #include "ES_hevc.h"
 #include "bitstream.h"
 #include "debug.h"
+#include "start_code.h"
 
+#include <algorithm>
 #include <cstring>      // for memset memcpy
 
 using namespace TSDemux;
@@ -59,6 +61,14 @@ void ES_hevc::Parse(STREAM_PKT* pkt)
 
   while (p < es_len)
   {
+    // Unless the last bytes can be part of one, go straight to the next start code
+    if ((startcode & 0xff) != 0)
+    {
+      size_t next = p + FindStartCode(es_buf + p, es_len - p) + 2;
+      startcode = SkipToPosition(startcode, es_buf, p, std::min(next, es_len));
+      if (p >= es_len)
+        break;
+    }
     startcode = startcode << 8 | es_buf[p++];
     if ((startcode & 0x00ffffff) == 0x00000001)
     {
@@ -102,6 +112,8 @@ void ES_hevc::Parse(STREAM_PKT* pkt)
       pkt->pts      = m_PTS;
       pkt->duration = duration;
       pkt->streamChange = streamChange;
+      pkt->keyframe = m_streamData.vcl_nal.nal_unit_type >= NAL_BLA_W_LP &&
+                      m_streamData.vcl_nal.nal_unit_type <= NAL_RSV_IRAP_VCL23;
     }
     m_StartCode = 0xffffffff;
     m_LastStartPos = -1;
@@ -19,112 +19,162 @@
  */
 
 #include "bitstream.h"
+#include "simd.h"
 
 using namespace TSDemux;
 
-void CBitstream::skipBits(unsigned int num)
-{
-  if (m_doEP3)
-  {
-
-    while (num)
-    {
-      unsigned int tmp = m_offset >> 3;
-      if (!(m_offset & 7) && (m_data[tmp--] == 3) && (m_data[tmp--] == 0) && (m_data[tmp] == 0))
-        m_offset += 8;   // skip EP3 byte
-
-      if (!(m_offset & 7) && (num >= 8)) // byte boundary, speed up things a little bit
-      {
-        m_offset += 8;
-        num -= 8;
-      }
-      else if ((tmp = 8-(m_offset & 7)) <= num) // jump to byte boundary
-      {
-        m_offset += tmp;
-        num -= tmp;
-      }
-      else
-      {
-        m_offset += num;
-         num = 0;
-      }
-
-      if (m_offset >= m_len)
-      {
-        m_error = true;
-        break;
-      }
-    }
+#define EP3_BYTE 0x03
 
-    return;
-  }
+static inline uint64_t load_be64(const uint8_t *data)
+{
+  uint64_t w = 0;
+  for (int i = 0; i < 8; i++)
+    w = w << 8 | data[i];
+  return w;
+}
 
-  m_offset += num;
+// Whether any of the bytes in w is 0x03
+static inline bool has_ep3_byte(uint64_t w)
+{
+  uint64_t x = w ^ 0x0303030303030303ULL;
+  return ((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL) != 0;
 }
 
-unsigned int CBitstream::readBits(int num)
+void CBitstream::refill()
 {
-  unsigned int r = 0;
+  const size_t end = m_len >> 3;
+  if (m_cacheBits > 56)
+    return;
 
-  while(num > 0)
+  // Whole words when none of the bytes can be an emulation_prevention_three_byte
+  if (m_pos + 8 <= end)
   {
-    if (m_doEP3)
+    uint64_t w = load_be64(m_data + m_pos);
+    if (!m_doEP3 || !has_ep3_byte(w))
     {
-      size_t tmp = m_offset >> 3;
-      if (!(m_offset & 7) && (m_data[tmp--] == 3) && (m_data[tmp--] == 0) && (m_data[tmp] == 0))
-        m_offset += 8;   // skip EP3 byte
+      int bytes = (64 - m_cacheBits) >> 3;
+      int shift = 64 - 8 * bytes;
+      m_cache |= (w >> shift << shift) >> m_cacheBits;
+      m_cacheBits += 8 * bytes;
+      m_pos += bytes;
+      return;
     }
+  }
 
-    if(m_offset >= m_len)
+  while (m_cacheBits <= 56 && m_pos <= end)
+  {
+    int bits = m_pos < end ? 8 : (int)(m_len & 7);
+    if (bits == 0)
+      break;
+    uint8_t b = m_data[m_pos];
+    if (m_doEP3 && b == EP3_BYTE && m_data[m_pos - 1] == 0 && m_data[m_pos - 2] == 0)
     {
-      m_error = true;
-      return 0;
+      m_pos++;
+      continue;
     }
+    m_cache |= (uint64_t)(b >> (8 - bits)) << (64 - bits - m_cacheBits);
+    m_cacheBits += bits;
+    m_pos++;
+  }
+}
 
-    num--;
-
-    if(m_data[m_offset / 8] & (1 << (7 - (m_offset & 7))))
-      r |= 1 << num;
+// Everything is used up, the reads after it fail
+void CBitstream::drain()
+{
+  m_cache = 0;
+  m_cacheBits = 0;
+  m_pos = (m_len >> 3) + 1;
+}
 
-    m_offset++;
-  }
-  return r;
+// Whether the last bit has been read, not counting a last byte that is an
+// emulation_prevention_three_byte
+bool CBitstream::atEnd()
+{
+  if (m_cacheBits == 0)
+    refill();
+  if (m_cacheBits > 0)
+    return false;
+  size_t last = (m_len >> 3) - 1;
+  bool ep3_last = !(m_len & 7) && m_len >= 24 &&
+      m_data[last] == EP3_BYTE && m_data[last - 1] == 0 && m_data[last - 2] == 0;
+  return !ep3_last;
 }
 
-unsigned int CBitstream::showBits(int num)
+void CBitstream::skipBits(unsigned int num)
 {
-  unsigned int r = 0;
-  size_t offs = m_offset;
+  if (num == 0)
+    return;
 
-  while(num > 0)
+  while (num > (unsigned int)m_cacheBits)
   {
-    if(offs >= m_len)
+    num -= m_cacheBits;
+    m_cache = 0;
+    m_cacheBits = 0;
+    refill();
+    if (m_cacheBits == 0)
     {
-      m_error = true;
-      return 0;
+      // Skipping past the end is only noticed by the next read without EP3
+      if (m_doEP3)
+        m_error = true;
+      drain();
+      return;
     }
+  }
+  takeBits(num);
 
-    num--;
+  if (m_doEP3 && atEnd())
+    m_error = true;
+}
 
-    if(m_data[offs / 8] & (1 << (7 - (offs & 7))))
-      r |= 1 << num;
+unsigned int CBitstream::readBitsSlow(int num)
+{
+  if (num <= 0)
+    return 0;
 
-    offs++;
+  refill();
+  if (num > m_cacheBits)
+  {
+    m_error = true;
+    drain();
+    return 0;
   }
-  return r;
+  return (unsigned int)takeBits(num);
 }
 
-unsigned int CBitstream::readGolombUE(int maxbits)
+unsigned int CBitstream::showBits(int num)
 {
-  int lzb = -1;
-  int bits = 0;
+  if (num <= 0)
+    return 0;
+
+  if (num > m_cacheBits)
+    refill();
+  if (num > m_cacheBits)
+  {
+    m_error = true;
+    return 0;
+  }
+  return (unsigned int)(m_cache >> (64 - num));
+}
 
-  for(int b = 0; !b; lzb++, bits++)
+unsigned int CBitstream::readGolombUE(int maxbits)
+{
+  // The leading zeros are looked for in up to maxbits + 1 bits
+  if (m_cacheBits <= maxbits)
+    refill();
+  int window = m_cacheBits < maxbits + 1 ? m_cacheBits : maxbits + 1;
+  int lzb = m_cache ? CountLeadingZeros(m_cache) : 64;
+  if (lzb >= window)
   {
-    if (bits > maxbits)
-      return 0;
-    b = readBits1();
+    if (window < maxbits + 1)
+    {
+      m_error = true;
+      drain();
+    }
+    else
+      takeBits(window);
+    return 0;
   }
+  takeBits(lzb + 1);
 
   return (1 << lzb) - 1 + readBits(lzb);
 }
@@ -26,20 +26,39 @@
 
 namespace TSDemux
 {
+  // Reads from a cache of the next 57 to 64 bits, filled a word at a time.
+  // The emulation_prevention_three_bytes are dropped while filling, so the
+  // reads only see the bits that are left.
   class CBitstream
   {
   private:
-    uint8_t       *m_data;
-    size_t         m_offset;
-    const size_t   m_len;
+    const uint8_t *m_data;
+    const size_t   m_len;     // in bits
+    size_t         m_pos;     // next byte to go into the cache
+    uint64_t       m_cache;   // next bits from the top down, zero below them
+    int            m_cacheBits;
     bool           m_error;
     const bool     m_doEP3;
 
+    void         refill();
+    void         drain();
+    bool         atEnd();
+    uint64_t     takeBits(int num)
+    {
+      uint64_t r = m_cache >> (64 - num);
+      m_cache = num < 64 ? m_cache << num : 0;
+      m_cacheBits -= num;
+      return r;
+    }
+    unsigned int readBitsSlow(int num);
+
   public:
     CBitstream(uint8_t *data, size_t bits)
     : m_data(data)
-    , m_offset(0)
     , m_len(bits)
+    , m_pos(0)
+    , m_cache(0)
+    , m_cacheBits(0)
     , m_error(false)
     , m_doEP3(false)
     {}
@@ -49,14 +68,21 @@ namespace TSDemux
     // Data must start at byte 2
     CBitstream(uint8_t *data, size_t bits, bool doEP3)
     : m_data(data)
-    , m_offset(16) // skip header and use as sentinel for EP3 detection
     , m_len(bits)
+    , m_pos(2) // skip header and use as sentinel for EP3 detection
+    , m_cache(0)
+    , m_cacheBits(0)
     , m_error(false)
     , m_doEP3(true)
     {}
 
     void         skipBits(unsigned int num);
-    unsigned int readBits(int num);
+    unsigned int readBits(int num)
+    {
+      if (num > 0 && num <= m_cacheBits)
+        return (unsigned int)takeBits(num);
+      return readBitsSlow(num);
+    }
     unsigned int showBits(int num);
     unsigned int readBits1() { return readBits(1); }
     unsigned int readGolombUE(int maxbits = 32);
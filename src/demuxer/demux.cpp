@@ -68,14 +68,18 @@ void DemuxLog(int level, char *msg)
   }
 }
 
-Demux::Demux(SegmentStorage *segment_storage)
-  : m_channel(1)
-  , m_av_buf_size(AV_BUFFER_SIZE)
-  , m_av_pos(0)
-  , m_av_buf(NULL)
-  , m_av_rbs(NULL)
-  , m_av_rbe(NULL)
-  , m_AVContext(NULL)
+Demux::Demux(SegmentStorage *segment_storage, WorkerPool *worker_pool, KeyframeIndex *keyframe_index,
+    const hls::Segment &start_segment, const Keyframe &start_keyframe)
+  : m_read_pos(0)
+  , m_mergeStarted(false)
+  , m_mergedTime(0)
+  , m_lastPcr(PTS_UNSET)
+  , m_keyframeIndex(keyframe_index)
+  , m_keyframePID(0xffff)
+  , m_startSegment(start_segment)
+  , m_startKeyframe(start_keyframe)
+  , m_skippedTime(0)
+  , m_indexStart(false)
   , m_mainStreamPID(0xffff)
   , m_isStreamDone(false)
   , m_segmentChanged(false)
@@ -84,32 +88,27 @@ Demux::Demux(SegmentStorage *segment_storage)
   , quit_processing(false)
   , processed_discontinuity(true)
   , awaiting_initial_setup(false)
+  , m_setupStartPos(0)
   , include_discontinuity(false)
   , m_av_contents(segment_storage)
+  , m_worker_pool(worker_pool)
+  , task_group(worker_pool)
+  , demux_task(&task_group, [this] { process_demux(); })
 {
   xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting demux", __FUNCTION__);
-  memset(&m_streams, 0, sizeof(INPUTSTREAM_IDS));
-  m_av_buf = (unsigned char*)malloc(sizeof(*m_av_buf) * (m_av_buf_size + 1));
-  if (m_av_buf)
-  {
-    m_av_rbs = m_av_buf;
-    m_av_rbe = m_av_buf;
-
-    if (g_bExtraDebug)
-      TSDemux::DBGLevel(DEMUX_DBG_DEBUG);
-    else
-      TSDemux::DBGLevel(DEMUX_DBG_ERROR);
-    TSDemux::SetDBGMsgCallback(DemuxLog);
+  memset(&m_streamIds, 0, sizeof(m_streamIds));
+  memset(&m_streams, 0, sizeof(m_streams));
 
-    m_AVContext = new TSDemux::AVContext(this, m_av_pos, m_channel);
-
-    demux_thread = std::thread(&Demux::process_demux_thread, this);
-    demux_cv.notify_one();
-  }
+  if (g_bExtraDebug)
+    TSDemux::DBGLevel(DEMUX_DBG_DEBUG);
   else
-  {
-    xbmc->Log(LOG_ERROR, LOGTAG "alloc AV buffer failed");
-  }
+    TSDemux::DBGLevel(DEMUX_DBG_ERROR);
+  TSDemux::SetDBGMsgCallback(DemuxLog);
+
+  m_av_contents->set_data_listener([this] {
+    demux_task.trigger();
+  });
+  demux_task.trigger();
 }
 
 Demux::~Demux()
@@ -121,196 +120,247 @@ Demux::~Demux()
     quit_processing = true;
   }
   initial_setup_cv.notify_all();
-  demux_cv.notify_all();
-  demux_thread.join();
+  m_av_contents->set_data_listener(nullptr);
+  task_group.cancel();
 
   Abort();
 
-  // Free AV context
-  if (m_AVContext)
-    SAFE_DELETE(m_AVContext);
-  // Free AV buffer
-  if (m_av_buf)
-  {
-    if (g_bExtraDebug)
-      xbmc->Log(LOG_DEBUG, LOGTAG "free AV buffer: allocated size was %zu", m_av_buf_size);
-    free(m_av_buf);
-    m_av_buf = NULL;
-  }
+  // Waits for the segments being demuxed, from the first one on as a
+  // demuxer can hand its AV context to the one after it
+  std::lock_guard<std::mutex> lock(demux_mutex);
+  while (!m_segments.empty())
+    m_segments.pop_front();
 }
 
-/*
- * Implement our AV reader
- */
-const unsigned char* Demux::ReadAV(uint64_t pos, size_t n)
+void Demux::read_segments()
 {
-  // out of range
-  if (n > m_av_buf_size)
-    return NULL;
-
-  // Already read ?
-  size_t sz = m_av_rbe - m_av_buf;
-  if (pos < m_av_pos || pos > (m_av_pos + sz))
-  {
-    // seek and reset buffer
-    m_av_rbs = m_av_rbe = m_av_buf;
-  }
-  else
+  while (!quit_processing)
   {
-    // move to the desired pos in buffer
-    m_av_rbs = m_av_buf + (size_t)(pos - m_av_pos);
-  }
-
-  size_t dataread = m_av_rbe - m_av_rbs;
-  if (dataread >= n)
-    return m_av_rbs;
-  dataread = 0;
-//  xbmc->Log(LOG_DEBUG, LOGTAG "%s: Starting read at %d", __FUNCTION__, pos);
-  // flush old data to free up space at the end
-  memmove(m_av_buf, m_av_rbs, dataread);
-  m_av_rbs = m_av_buf;
-  m_av_rbe = m_av_rbs + dataread;
-  m_av_pos = pos - dataread;
-  // fill new data
-  size_t len = (size_t)(m_av_buf_size - dataread);
-  // xbmc->Log(LOG_DEBUG, LOGTAG "%s Going to read at %d for %d bytes, dataread: %d len %d", __FUNCTION__, pos, n, dataread, len);
-
-  hls::Segment segment_read = m_av_contents->read(m_av_pos + dataread, len, m_av_rbe, n);
-  // xbmc->Log(LOG_DEBUG, LOGTAG "%s Read at %d for %d bytes", __FUNCTION__, pos, len);
-  if (!(segment_read == current_segment) && len > 0) {
-    m_segmentChanged = true;
-    if (m_segmentReadTime == -1) {
-        m_segmentReadTime = segment_read.time_in_playlist * DVD_TIME_BASE;
-        xbmc->Log(LOG_DEBUG, LOGTAG "%s Setting segment read time: %d", __FUNCTION__, m_segmentReadTime);
-    }
-    m_readTime = m_segmentReadTime;
-    current_segment = segment_read;
-    if (current_segment.valid) {
-      m_segmentReadTime += (current_segment.duration * DVD_TIME_BASE);
-    }
-    if (current_segment.discontinuity) {
-      processed_discontinuity = false;
-      include_discontinuity = true;
-      xbmc->Log(LOG_DEBUG, LOGTAG "%s Segment discontinuity", __FUNCTION__);
-
-      if (!processed_discontinuity) {
-        xbmc->Log(LOG_DEBUG, LOGTAG "%s: processing discontinuity", __FUNCTION__);
-        awaiting_initial_setup = true;
-        xbmc->Log(LOG_DEBUG, LOGTAG "%s: resetting AV context", __FUNCTION__);
-        m_AVContext->StreamDiscontinuity();
-        m_AVContext->Reset();
-        m_AVContext->ResetPackets();
-        processed_discontinuity = true;
+    // Checked first, data that arrives after the read isn't lost by seeing the end
+    bool finished = m_av_contents->is_finished();
+    size_t len = AV_BUFFER_SIZE;
+    const uint8_t *data = NULL;
+    hls::Segment segment_read = m_av_contents->view(m_read_pos, len, data);
+    if (len == 0)
+    {
+      if (finished && !m_isStreamDone)
+      {
+        m_isStreamDone = true;
+        for (auto it = m_segments.begin(); it != m_segments.end(); ++it)
+          (*it)->end_data();
       }
+      return;
     }
-    xbmc->Log(LOG_DEBUG, LOGTAG "%s Pos: %d Current Segment: %d", __FUNCTION__, m_av_pos,
-                  current_segment.media_sequence);
-  }
-  if (len == 0) {
-    m_isStreamDone = true;
-  }
 
-  m_av_rbe += len;
-  dataread += len;
-
-  if (dataread < n) {
-    xbmc->Log(LOG_DEBUG, LOGTAG "%s Didn't read enough data, read %d", __FUNCTION__, dataread);
+    SegmentDemuxer *previous = m_segments.size() > 1 ? m_segments[m_segments.size() - 2].get() : nullptr;
+    SegmentDemuxer *last = m_segments.empty() ? nullptr : m_segments.back().get();
+    if (!last || !(segment_read == last->get_segment()))
+    {
+      if (m_segments.size() >= MAX_SEGMENT_DEMUXERS)
+        // Carries on once the first one has been merged
+        return;
+      // Only the segment right before gets the start of the new one
+      if (previous)
+        previous->end_data();
+
+      uint64_t skip_to = 0;
+      if (m_read_pos == 0 && m_startKeyframe.offset && segment_read == m_startSegment)
+      {
+        xbmc->Log(LOG_DEBUG, LOGTAG "%s: starting segment %d at the keyframe %f seconds in", __FUNCTION__,
+            segment_read.media_sequence, m_startKeyframe.time);
+        skip_to = m_startKeyframe.offset;
+        m_skippedTime = m_startKeyframe.time * DVD_TIME_BASE;
+      }
+      std::lock_guard<std::mutex> lock(demux_mutex);
+      m_segments.push_back(std::unique_ptr<SegmentDemuxer>(new SegmentDemuxer(m_av_contents, segment_read,
+          m_read_pos, m_disabled, m_worker_pool, [this] { demux_task.trigger(); }, skip_to)));
+      previous = last;
+      last = m_segments.back().get();
+      if (previous && segment_read.discontinuity)
+        previous->end_data();
+      else if (previous && segment_read.independent)
+        previous->end_segment();
+      else if (previous)
+        // Frames, the program and the parameter sets carry over
+        previous->continue_with(last);
+    }
+    m_read_pos += len;
+    last->extend(m_read_pos);
+    if (previous && previous->wants_data())
+      previous->extend(m_read_pos);
   }
-
-  return dataread >= n ? m_av_rbs : NULL;
 }
 
-bool Demux::Process()
+void Demux::merge_segments()
 {
-  xbmc->Log(LOG_DEBUG, LOGTAG "%s: Processing demux", __FUNCTION__);
-  if (!m_AVContext)
+  while (!quit_processing)
   {
-    xbmc->Log(LOG_ERROR, LOGTAG "%s: no AVContext", __FUNCTION__);
-    return false;
-  }
-
-  int ret = 0;
-
-  while (true)
-  {
-    ret = m_AVContext->TSResync();
-    if (ret != TSDemux::AVCONTEXT_CONTINUE)
-      break;
-
-    ret = m_AVContext->ProcessTSPacket();
-
-    if (m_AVContext->HasPIDStreamData())
     {
-      TSDemux::STREAM_PKT pkt;
-      while (get_stream_data(&pkt))
+      std::lock_guard<std::mutex> lock(demux_mutex);
+      if (writePacketBuffer.size() >= MAX_DEMUX_PACKETS)
+        return;
+    }
+    if (m_segments.empty())
+    {
+      if (m_isStreamDone)
       {
-        if (pkt.streamChange)
+        xbmc->Log(LOG_DEBUG, LOGTAG "%s: all segments demuxed", __FUNCTION__);
         {
-          // We cannot wait to push the stream change because our data packets will get in for one stream
-          // and start playing while the other stream is attempting setup
-          update_pvr_stream(pkt.pid);
-          if (awaiting_initial_setup) {
-            if (m_nosetup.empty()) {
-              std::lock_guard<std::mutex> lock(initial_setup_mutex);
-              awaiting_initial_setup = false;
-            }
-            initial_setup_cv.notify_all();
-          } else {
-            push_stream_change();
-          }
-        }
-        DemuxPacket* dxp = stream_pvr_data(&pkt);
-        DemuxContainer demux_container;
-        demux_container.demux_packet = dxp;
-        demux_container.pcr = pkt.pcr;
-        update_timing_data(demux_container);
-        if (m_segmentChanged) {
-          m_segmentChanged = false;
-          include_discontinuity = false;
+          std::lock_guard<std::mutex> lock(demux_mutex);
+          quit_processing = true;
         }
-        push_stream_data(demux_container);
+        read_demux_cv.notify_all();
       }
+      return;
     }
-    if (m_AVContext->HasPIDPayload())
+
+    SegmentDemuxer *segment = m_segments.front().get();
+    if (!m_mergeStarted)
     {
-      ret = m_AVContext->ProcessTSPayload();
-      if (ret == TSDemux::AVCONTEXT_PROGRAM_CHANGE)
+      m_mergeStarted = true;
       {
-        xbmc->Log(LOG_DEBUG, LOGTAG "%s: processing stream change", __FUNCTION__);
-        awaiting_initial_setup = true;
-        populate_pvr_streams();
-        push_stream_change();
+        std::lock_guard<std::mutex> lock(demux_mutex);
+        m_mergedTime = m_skippedTime;
       }
+      update_current_segment(segment->get_segment());
+      m_readTime += m_skippedTime;
+      m_skippedTime = 0;
+      // Keyframe times are from the first packet of the whole segment
+      m_indexStart = m_keyframeIndex && segment->get_skip_to() == 0;
     }
-
-    if (ret < 0)
-      xbmc->Log(LOG_NOTICE, LOGTAG "%s: error %d", __FUNCTION__, ret);
-
-    if (ret == TSDemux::AVCONTEXT_TS_ERROR)
-      m_AVContext->Shift();
-    else
-      m_AVContext->GoNext();
-
+    uint64_t position = segment->get_position();
+    SegmentPacket packet;
+    bool has_room = true;
+    while (has_room && segment->pop_packet(packet))
+      has_room = merge_packet(packet, position);
+    check_initial_setup_probe(position);
+    if (!has_room || !segment->is_done())
+      return;
+
+    std::unique_ptr<SegmentDemuxer> done;
     {
       std::lock_guard<std::mutex> lock(demux_mutex);
-      if (writePacketBuffer.size() >= MAX_DEMUX_PACKETS) {
-        ret = 0;
-        break;
-      }
-      if (quit_processing) {
-        break;
-      }
+      done.swap(m_segments.front());
+      m_segments.pop_front();
     }
+    m_mergeStarted = false;
+    // The segments before the ones still being demuxed make room for downloads
+    m_av_contents->release(m_segments.empty() ? m_read_pos : m_segments.front()->get_data_start());
   }
-  xbmc->Log(LOG_DEBUG, LOGTAG "%s: stopped with status %d", __FUNCTION__, ret);
-  if (ret < 0) {
+}
+
+bool Demux::merge_packet(SegmentPacket &packet, uint64_t position)
+{
+  if (packet.program_change)
+  {
+    xbmc->Log(LOG_DEBUG, LOGTAG "%s: processing stream change", __FUNCTION__);
+    bool changed = current_segment.discontinuity || packet.streams.size() != m_streamIds.m_streamCount;
+    for (size_t i = 0; !changed && i < packet.streams.size(); ++i)
+      changed = packet.streams[i].info.m_pID != m_streams[i].m_pID ||
+          strncmp(packet.streams[i].info.m_codecName, m_streams[i].m_codecName, 32) != 0;
+    if (changed)
     {
-      std::lock_guard<std::mutex> lock(demux_mutex);
-      quit_processing = true;
+      // Each segment starts with the program, only a different one is a change
+      start_initial_setup(position);
+      populate_pvr_streams(packet.streams);
+      push_stream_change();
     }
-    read_demux_cv.notify_all();
+    return true;
+  }
+
+  if (!packet.streams.empty() && update_pvr_stream(packet.streams.front()))
+  {
+    // We cannot wait to push the stream change because our data packets will get in for one stream
+    // and start playing while the other stream is attempting setup
+    if (awaiting_initial_setup) {
+      if (m_nosetup.empty()) {
+        std::lock_guard<std::mutex> lock(initial_setup_mutex);
+        awaiting_initial_setup = false;
+      }
+      initial_setup_cv.notify_all();
+    } else {
+      push_stream_change();
+    }
+  }
+
+  // The PCR carries over until the segment's first one
+  if (packet.pcr == PTS_UNSET)
+    packet.pcr = m_lastPcr;
+  m_lastPcr = packet.pcr;
+
+  DemuxPacket *dxp = packet.demux_packet;
+  if (m_indexStart && dxp->pts != DVD_NOPTS_VALUE && dxp->dts != DVD_NOPTS_VALUE)
+  {
+    // The same packet the session lines the segment up with the playlist by
+    m_keyframeIndex->set_start_pts(current_segment, dxp->pts);
+    m_indexStart = false;
+  }
+  if (m_keyframeIndex && packet.has_keyframe_offset && dxp->pts != DVD_NOPTS_VALUE)
+  {
+    if (m_keyframePID == 0xffff)
+      m_keyframePID = dxp->iStreamId;
+    if (dxp->iStreamId == m_keyframePID)
+      m_keyframeIndex->add_keyframe(current_segment, packet.keyframe_offset, dxp->pts);
+  }
+
+  DemuxContainer demux_container;
+  demux_container.demux_packet = packet.demux_packet;
+  demux_container.pcr = packet.pcr;
+  demux_container.keyframe = packet.keyframe;
+  update_timing_data(demux_container);
+  if (packet.demux_packet->iStreamId == m_mainStreamPID) {
+    std::lock_guard<std::mutex> lock(demux_mutex);
+    m_mergedTime += packet.demux_packet->duration;
+  }
+  if (m_segmentChanged) {
+    m_segmentChanged = false;
+    include_discontinuity = false;
+  }
+  return push_stream_data(demux_container);
+}
+
+void Demux::update_current_segment(const hls::Segment &segment_read)
+{
+  if (segment_read == current_segment)
+    return;
+  m_segmentChanged = true;
+  if (m_segmentReadTime == -1) {
+      m_segmentReadTime = segment_read.time_in_playlist * DVD_TIME_BASE;
+      xbmc->Log(LOG_DEBUG, LOGTAG "%s Setting segment read time: %d", __FUNCTION__, m_segmentReadTime);
+  }
+  m_readTime = m_segmentReadTime;
+  current_segment = segment_read;
+  if (current_segment.valid) {
+    m_segmentReadTime += (current_segment.duration * DVD_TIME_BASE);
+  }
+  if (current_segment.discontinuity) {
+    include_discontinuity = true;
+    // The segment's demuxer started on its own, the program it finds is
+    // taken as a change
+    xbmc->Log(LOG_DEBUG, LOGTAG "%s Segment discontinuity", __FUNCTION__);
+    m_lastPcr = PTS_UNSET;
+  }
+  xbmc->Log(LOG_DEBUG, LOGTAG "%s Pos: %llu Current Segment: %d", __FUNCTION__,
+      (unsigned long long)m_read_pos, current_segment.media_sequence);
+}
+
+void Demux::start_initial_setup(uint64_t position)
+{
+  awaiting_initial_setup = true;
+  m_setupStartPos = position;
+}
+
+void Demux::check_initial_setup_probe(uint64_t position)
+{
+  if (!awaiting_initial_setup || position < m_setupStartPos + STREAM_INFO_PROBE_SIZE)
+    return;
+  xbmc->Log(LOG_NOTICE, LOGTAG "%s: %zu streams without setup after %d bytes, continuing without them", __FUNCTION__,
+      m_nosetup.size(), (int)STREAM_INFO_PROBE_SIZE);
+  {
+    std::lock_guard<std::mutex> lock(initial_setup_mutex);
+    awaiting_initial_setup = false;
   }
-  return ret >= 0 ? true : false;
+  initial_setup_cv.notify_all();
 }
 
 INPUTSTREAM_IDS Demux::GetStreamIds()
@@ -327,6 +377,17 @@ INPUTSTREAM_IDS Demux::GetStreamIds()
   return m_streamIds;
 }
 
+void Demux::EnableStream(uint16_t pid, bool enable)
+{
+  std::lock_guard<std::mutex> lock(demux_mutex);
+  if (enable)
+    m_disabled.erase(pid);
+  else
+    m_disabled.insert(pid);
+  for (auto it = m_segments.begin(); it != m_segments.end(); ++it)
+    (*it)->EnableStream(pid, enable);
+}
+
 INPUTSTREAM_INFO* Demux::GetStreams()
 {
   std::lock_guard<std::mutex> lock(demux_mutex);
@@ -356,13 +417,13 @@ DemuxContainer Demux::Read(bool remove_packet)
   if (readPacketBuffer.empty()) {
     std::unique_lock<std::mutex> lock(demux_mutex);
     read_demux_cv.wait_for(lock, std::chrono::milliseconds(10), [&] {
-      return quit_processing || writePacketBuffer.size() == MAX_DEMUX_PACKETS;
+      return quit_processing || writePacketBuffer.size() >= MAX_DEMUX_PACKETS;
     });
     readPacketBuffer.swap(writePacketBuffer);
 //      xbmc->Log(LOG_NOTICE, LOGTAG "%s: Loaded %d packets", __FUNCTION__, readPacketBuffer.size());
-  }
-  if (readPacketBuffer.size() / (double) MAX_DEMUX_PACKETS < 0.5) {
-    demux_cv.notify_all();
+    lock.unlock();
+    // The write buffer is empty again
+    demux_task.trigger();
   }
   if (readPacketBuffer.empty()) {
     if (quit_processing) {
@@ -372,6 +433,7 @@ DemuxContainer Demux::Read(bool remove_packet)
       xbmc->Log(LOG_NOTICE, LOGTAG "%s: Returning empty packet", __FUNCTION__);
       DemuxContainer container;
       container.demux_packet = ipsh->AllocateDemuxPacket(0);
+      container.stalled = true;
       return container;
     }
   }
@@ -388,186 +450,98 @@ DemuxContainer Demux::Read(bool remove_packet)
   return packet;
 }
 
-uint32_t Demux::get_current_media_sequence() {
-  return Read(false).segment.media_sequence;
-}
-
-bool Demux::get_stream_data(TSDemux::STREAM_PKT* pkt)
-{
-  TSDemux::ElementaryStream* es = m_AVContext->GetPIDStream();
-  if (!es)
-    return false;
-
-  if (!es->GetStreamPacket(pkt))
-    return false;
-
-  pkt->pcr = es->c_pcr;
-
-
-
-  if (pkt->duration > PTS_TIME_BASE * 2)
-  {
-    pkt->duration = 0;
+double Demux::get_buffered_time() {
+  // readPacketBuffer is only used from the reading thread
+  double buffered = 0;
+  for(auto it = readPacketBuffer.begin(); it != readPacketBuffer.end(); ++it) {
+    if (it->demux_packet && it->demux_packet->iStreamId == m_mainStreamPID) {
+      buffered += it->demux_packet->duration;
+    }
   }
-  return true;
-}
-
-static void recode_language(const char* muxLanguage, char* strLanguage)
-{
-  /*
-   * While XBMC does'nt support them.
-   * Fix unsupported language codes (EN 300 468 Annex F & J)
-   * 'qaa'        : Original audio
-   * 'qad','NAR'  : Audio Description
-   */
-  if (strncmp(muxLanguage, "qaa", 3) == 0 ||
-      strncmp(muxLanguage, "qad", 3) == 0 ||
-      strncmp(muxLanguage, "NAR", 3) == 0)
-  {
-    strLanguage[0] = 0;
-    strLanguage[1] = 0;
-    strLanguage[2] = 0;
-    strLanguage[3] = 0;
+  std::lock_guard<std::mutex> lock(demux_mutex);
+  for(auto it = writePacketBuffer.begin(); it != writePacketBuffer.end(); ++it) {
+    if (it->demux_packet && it->demux_packet->iStreamId == m_mainStreamPID) {
+      buffered += it->demux_packet->duration;
+    }
   }
-  else
-  {
-    strLanguage[0] = muxLanguage[0];
-    strLanguage[1] = muxLanguage[1];
-    strLanguage[2] = muxLanguage[2];
-    strLanguage[3] = 0;
+  // Whole segments taken from the storage, less what has been merged from
+  // the first one
+  for(auto it = m_segments.begin(); it != m_segments.end(); ++it) {
+    if ((*it)->is_segment_complete()) {
+      double segment_time = (*it)->get_segment().duration * DVD_TIME_BASE;
+      if (it == m_segments.begin()) {
+        segment_time -= m_mergedTime;
+      }
+      buffered += std::max(0.0, segment_time);
+    }
   }
+  return buffered / DVD_TIME_BASE;
 }
 
-void Demux::populate_pvr_streams()
+void Demux::populate_pvr_streams(const std::vector<StreamSetup> &streams)
 {
   std::lock_guard<std::mutex> lock(demux_mutex);
 
   uint16_t mainPid = 0xffff;
-  int mainType = XBMC_CODEC_TYPE_UNKNOWN;
-  const std::vector<TSDemux::ElementaryStream*> es_streams = m_AVContext->GetStreams();
-  int count = 0;
-  for (std::vector<TSDemux::ElementaryStream*>::const_iterator it = es_streams.begin(); it != es_streams.end(); ++it)
+  int mainType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_NONE;
+  m_nosetup.clear();
+  unsigned int count = 0;
+  for (auto it = streams.begin(); it != streams.end() && count < INPUTSTREAM_IDS::MAX_STREAM_COUNT; ++it)
   {
-    const char* codec_name = (*it)->GetStreamCodecName();
-    xbmc_codec_t codec = CODEC->GetCodecByName(codec_name);
-    if (codec.codec_type != XBMC_CODEC_TYPE_UNKNOWN)
+    // Find the main stream:
+    // The best candidate would be the first video. Else the first audio
+    switch (mainType)
     {
-      // Find the main stream:
-      // The best candidate would be the first video. Else the first audio
-      switch (mainType)
-      {
-      case XBMC_CODEC_TYPE_VIDEO:
+    case INPUTSTREAM_INFO::STREAM_TYPE::TYPE_VIDEO:
+      break;
+    case INPUTSTREAM_INFO::STREAM_TYPE::TYPE_AUDIO:
+      if (it->info.m_streamType != INPUTSTREAM_INFO::STREAM_TYPE::TYPE_VIDEO)
         break;
-      case XBMC_CODEC_TYPE_AUDIO:
-        if (codec.codec_type != XBMC_CODEC_TYPE_VIDEO)
-          break;
-      default:
-        mainPid = (*it)->pid;
-        mainType = codec.codec_type;
-      }
-
-      m_streams[count].m_pID           = (*it)->pid;
-      memcpy(m_streams[count].m_codecName, codec_name, 32);
-      switch(codec.codec_type) {
-      case XBMC_CODEC_TYPE_VIDEO:
-              m_streams[count].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_VIDEO; break;
-      case XBMC_CODEC_TYPE_AUDIO:
-              m_streams[count].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_AUDIO; break;
-      case XBMC_CODEC_TYPE_SUBTITLE:
-              m_streams[count].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_SUBTITLE; break;
-      case XBMC_CODEC_TYPE_DATA:
-              m_streams[count].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_TELETEXT; break;
-      default:
-              m_streams[count].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_NONE; break;
-      }
-      recode_language((*it)->stream_info.language, m_streams[count].m_language);
-      // m_streams[count].iSubtitleInfo  = stream_identifier((*it)->stream_info.composition_id, (*it)->stream_info.ancillary_id);
-      m_streams[count].m_FpsScale      = (*it)->stream_info.fps_scale;
-      m_streams[count].m_FpsRate       = (*it)->stream_info.fps_rate;
-      m_streams[count].m_Height        = (*it)->stream_info.height;
-      m_streams[count].m_Width         = (*it)->stream_info.width;
-      m_streams[count].m_Aspect        = (*it)->stream_info.aspect;
-      m_streams[count].m_Channels      = (*it)->stream_info.channels;
-      m_streams[count].m_SampleRate    = (*it)->stream_info.sample_rate;
-      m_streams[count].m_BlockAlign    = (*it)->stream_info.block_align;
-      m_streams[count].m_BitRate       = (*it)->stream_info.bit_rate;
-      m_streams[count].m_BitsPerSample = (*it)->stream_info.bits_per_sample;
-      m_streams[count].m_Bandwidth = 0;
-      m_streams[count].m_ExtraSize = 0;
-      m_streams[count].m_ExtraData = nullptr;
-
-      m_streamIds.m_streamIds[count] = (*it)->pid;
-
-      count++;
-      m_AVContext->StartStreaming((*it)->pid);
-
-      // Add stream to no setup set
-      if (!(*it)->has_stream_info)
-        m_nosetup.insert((*it)->pid);
-
-      if (g_bExtraDebug)
-        xbmc->Log(LOG_DEBUG, LOGTAG "%s: register PES %.4x %s", __FUNCTION__, (*it)->pid, codec_name);
+    default:
+      mainPid = it->info.m_pID;
+      mainType = it->info.m_streamType;
     }
+
+    m_streams[count] = it->info;
+    m_streamIds.m_streamIds[count] = it->info.m_pID;
+    count++;
+
+    // Add stream to no setup set
+    if (!it->has_stream_info && m_disabled.find(it->info.m_pID) == m_disabled.end())
+      m_nosetup.insert(it->info.m_pID);
+
+    if (g_bExtraDebug)
+      xbmc->Log(LOG_DEBUG, LOGTAG "%s: register PES %.4x %s", __FUNCTION__, it->info.m_pID, it->info.m_codecName);
   }
   m_streamIds.m_streamCount = count;
   // Renew main stream
   m_mainStreamPID = mainPid;
 }
 
-bool Demux::update_pvr_stream(uint16_t pid)
+bool Demux::update_pvr_stream(const StreamSetup &setup)
 {
-  TSDemux::ElementaryStream* es = m_AVContext->GetStream(pid);
-  if (!es)
-    return false;
-
-  const char* codec_name = es->GetStreamCodecName();
-  xbmc_codec_t codec = CODEC->GetCodecByName(codec_name);
   if (g_bExtraDebug)
-    xbmc->Log(LOG_DEBUG, LOGTAG "%s: update info PES %.4x %s", __FUNCTION__, es->pid, codec_name);
+    xbmc->Log(LOG_DEBUG, LOGTAG "%s: update info PES %.4x %s", __FUNCTION__, setup.info.m_pID, setup.info.m_codecName);
 
   std::lock_guard<std::mutex> lock(demux_mutex);
 
   // find stream index for pid
   for (unsigned i = 0; i < m_streamIds.m_streamCount; i++)
   {
-    if (m_streams[i].m_pID == es->pid)
+    if (m_streams[i].m_pID == setup.info.m_pID)
     {
-      memcpy(m_streams[i].m_codecName, codec_name, 32);
-      switch(codec.codec_type) {
-      case XBMC_CODEC_TYPE_VIDEO:
-              m_streams[i].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_VIDEO; break;
-      case XBMC_CODEC_TYPE_AUDIO:
-              m_streams[i].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_AUDIO; break;
-      case XBMC_CODEC_TYPE_SUBTITLE:
-              m_streams[i].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_SUBTITLE; break;
-      case XBMC_CODEC_TYPE_DATA:
-              m_streams[i].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_TELETEXT; break;
-      default:
-              m_streams[i].m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_NONE; break;
-      }
-      recode_language(es->stream_info.language, m_streams[i].m_language);
-      // m_streams[i].m_Subtitle  = stream_identifier(es->stream_info.composition_id, es->stream_info.ancillary_id);
-      m_streams[i].m_FpsScale      = es->stream_info.fps_scale;
-      m_streams[i].m_FpsRate       = es->stream_info.fps_rate;
-      m_streams[i].m_Height        = es->stream_info.height;
-      m_streams[i].m_Width         = es->stream_info.width;
-      m_streams[i].m_Aspect        = es->stream_info.aspect;
-      m_streams[i].m_Channels      = es->stream_info.channels;
-      m_streams[i].m_SampleRate    = es->stream_info.sample_rate;
-      m_streams[i].m_BlockAlign    = es->stream_info.block_align;
-      m_streams[i].m_BitRate       = es->stream_info.bit_rate;
-      m_streams[i].m_BitsPerSample = es->stream_info.bits_per_sample;
-
-      if (es->has_stream_info)
+      std::set<uint16_t>::iterator it = m_nosetup.find(setup.info.m_pID);
+      // The parser of every segment finds the setup again
+      if (it == m_nosetup.end() && memcmp(&m_streams[i], &setup.info, sizeof(setup.info)) == 0)
+        return false;
+      m_streams[i] = setup.info;
+
+      if (setup.has_stream_info && it != m_nosetup.end())
       {
         // Now stream is setup. Remove it from no setup set
-        std::set<uint16_t>::iterator it = m_nosetup.find(es->pid);
-        if (it != m_nosetup.end())
-        {
-          m_nosetup.erase(it);
-          if (m_nosetup.empty())
-            xbmc->Log(LOG_DEBUG, LOGTAG "%s: setup is completed", __FUNCTION__);
-        }
+        m_nosetup.erase(it);
+        if (m_nosetup.empty())
+          xbmc->Log(LOG_DEBUG, LOGTAG "%s: setup is completed", __FUNCTION__);
       }
       return true;
     }
@@ -602,53 +576,21 @@ void Demux::push_stream_change()
   xbmc->Log(LOG_DEBUG, LOGTAG "%s: pushed stream change", __FUNCTION__);
 }
 
-DemuxPacket* Demux::stream_pvr_data(TSDemux::STREAM_PKT* pkt)
-{
-  if (!pkt)
-    return NULL;
-
-  DemuxPacket* dxp = ipsh->AllocateDemuxPacket(pkt->size);
-  if (dxp)
-  {
-    if (pkt->size > 0 && pkt->data)
-      memcpy(dxp->pData, pkt->data, pkt->size);
-
-    dxp->iStreamId = (int)(pkt->pid);
-    dxp->iSize = pkt->size;
-    dxp->duration = (double)pkt->duration * DVD_TIME_BASE / PTS_TIME_BASE;
-    if (pkt->dts != PTS_UNSET)
-      dxp->dts = (double)pkt->dts * DVD_TIME_BASE / PTS_TIME_BASE;
-    else
-      dxp->dts = DVD_NOPTS_VALUE;
-    if (pkt->pts != PTS_UNSET)
-      dxp->pts = (double)pkt->pts * DVD_TIME_BASE / PTS_TIME_BASE;
-    else
-      dxp->pts = DVD_NOPTS_VALUE;
-  }
-  return dxp;
-}
-
-void Demux::push_stream_data(DemuxContainer dxp) {
+bool Demux::push_stream_data(DemuxContainer dxp) {
   std::lock_guard<std::mutex> lock(demux_mutex);
   writePacketBuffer.push_back(dxp);
   read_demux_cv.notify_all();
+  return writePacketBuffer.size() < MAX_DEMUX_PACKETS;
 }
 
-void Demux::process_demux_thread() {
-  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting demuxer thread", __FUNCTION__);
-  while(true) {
-   std::unique_lock<std::mutex> lock(demux_mutex);
-   demux_cv.wait(lock, [this] {
-     return quit_processing || (writePacketBuffer.size() / (double) MAX_DEMUX_PACKETS) < 0.5;
-   });
-
-   if (quit_processing) {
-     break;
-   }
-   lock.unlock();
-
-   Process();
+void Demux::process_demux() {
+  read_segments();
+  {
+    std::lock_guard<std::mutex> lock(demux_mutex);
+    if (quit_processing || (writePacketBuffer.size() / (double) MAX_DEMUX_PACKETS) >= 0.5) {
+      // Runs again when the reader takes the packets
+      return;
+    }
   }
-  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Exiting demux thread");
+  merge_segments();
 }
-
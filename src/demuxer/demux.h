@@ -21,15 +21,18 @@
  *
  */
 
-#include "tsDemuxer.h"
+#include "keyframe_index.h"
+#include "segment_demuxer.h"
 
 #include <p8-platform/threads/threads.h>
 #include <p8-platform/threads/mutex.h>
 #include <p8-platform/util/buffer.h>
 
 #include <future>
+#include <memory>
 #include <thread>
 
+#include <deque>
 #include <map>
 #include <set>
 
@@ -38,75 +41,113 @@
 #include "../hls/segment_data.h"
 #include "../ring_buffer.h"
 #include "../segment_storage.h"
+#include "../worker_pool.h"
 
+// Most segment data taken from the storage at once
 #define AV_BUFFER_SIZE          131072
 
 const int MAX_DEMUX_PACKETS = 500;
-
-class Demux : public TSDemux::TSDemuxer
+// Streams without their setup after this much TS are left out of the
+// stream info, they are added with a stream change when they get it
+const uint64_t STREAM_INFO_PROBE_SIZE = 64 * 1024;
+// Segments demuxed at the same time, the storage keeps them until they are
+// done and has room for one more
+const size_t MAX_SEGMENT_DEMUXERS = MAX_SEGMENTS - 1;
+
+// Hands the segments out of the storage to a SegmentDemuxer each and puts
+// their packets back in segment order.  Only segments the playlist says are
+// independent are demuxed on their own, the others carry on with the AV
+// context of the segment before.
+class Demux
 {
 public:
-  Demux(SegmentStorage *segment_storage);
+  // The keyframes of the main stream go into keyframe_index.  Demuxing
+  // starts at start_keyframe when the first segment is start_segment.
+  Demux(SegmentStorage *segment_storage, WorkerPool *worker_pool, KeyframeIndex *keyframe_index = nullptr,
+      const hls::Segment &start_segment = hls::Segment(), const Keyframe &start_keyframe = Keyframe());
   ~Demux();
 
   INPUTSTREAM_IDS GetStreamIds();
   INPUTSTREAM_INFO* GetStreams();
+  // Disabled streams are skipped when their TS packets are read, also the
+  // ones of programs that haven't started yet
+  void EnableStream(uint16_t pid, bool enable);
   void Flush();
   void Abort();
   DemuxContainer Read(bool remove_packet = true);
 
   double get_percentage_packet_buffer_full() { return writePacketBuffer.size() / double(MAX_DEMUX_PACKETS); };
-  uint32_t get_current_media_sequence();
+  // Seconds of the main stream demuxed but not read yet, call from the reading thread
+  double get_buffered_time();
 private:
-  const unsigned char* ReadAV(uint64_t pos, size_t n);
-  bool Process();
+  void update_current_segment(const hls::Segment &segment_read);
   void update_timing_data(DemuxContainer &demux_container);
 private:
-  uint16_t m_channel;
   std::deque<DemuxContainer> writePacketBuffer; // Needs to be locked
   std::deque<DemuxContainer> readPacketBuffer; // Only read in Read()
   std::mutex demux_mutex;
   INPUTSTREAM_IDS m_streamIds;
   INPUTSTREAM_INFO m_streams[INPUTSTREAM_IDS::MAX_STREAM_COUNT];
 
-  bool get_stream_data(TSDemux::STREAM_PKT* pkt);
-  void reset_posmap();
-
   // PVR interfaces
   bool processed_discontinuity;
   std::mutex initial_setup_mutex;
   std::condition_variable initial_setup_cv;
   std::atomic_bool awaiting_initial_setup;
-  void populate_pvr_streams();
-  bool update_pvr_stream(uint16_t pid);
+  // Position the setup started at
+  uint64_t m_setupStartPos;
+  void start_initial_setup(uint64_t position);
+  void check_initial_setup_probe(uint64_t position);
+  void populate_pvr_streams(const std::vector<StreamSetup> &streams);
+  // False when nothing changed
+  bool update_pvr_stream(const StreamSetup &setup);
   void push_stream_change();
-  DemuxPacket* stream_pvr_data(TSDemux::STREAM_PKT* pkt);
-  void push_stream_data(DemuxContainer dxp);
-  void process_demux_thread();
-  bool should_process_demux();
-
-  // AV raw buffer
-  size_t m_av_buf_size;         ///< size of av buffer
-  uint64_t m_av_pos;            ///< absolute position in av
-  unsigned char* m_av_buf;      ///< buffer
-  unsigned char* m_av_rbs;      ///< raw data start in buffer
-  unsigned char* m_av_rbe;      ///< raw data end in buffer
+  // False once the packet buffer is full
+  bool push_stream_data(DemuxContainer dxp);
+  void process_demux();
+  // Tells the segment demuxers what the storage has
+  void read_segments();
+  // Moves the packets of the first segment demuxer to the packet buffer
+  void merge_segments();
+  // False once the packet buffer is full
+  bool merge_packet(SegmentPacket &packet, uint64_t position);
+
+  // Segments being demuxed, in order.  Changed only by process_demux,
+  // with demux_mutex held.
+  std::deque<std::unique_ptr<SegmentDemuxer>> m_segments;
+  // Position in the storage the next data is read from
+  uint64_t m_read_pos;
+  // Merging the first segment demuxer started
+  bool m_mergeStarted;
+  // Main stream duration merged from the first segment demuxer (DVD_TIME_BASE)
+  double m_mergedTime;
+  // PCR of the last packet, for packets before the first PCR of a segment
+  uint64_t m_lastPcr;
+  KeyframeIndex *m_keyframeIndex;
+  // The video stream whose keyframes are indexed, the first one with them
+  uint16_t m_keyframePID;
+  hls::Segment m_startSegment;
+  Keyframe m_startKeyframe;
+  // Seconds of the first segment demuxing skipped, until it is merged
+  double m_skippedTime;
+  // The first packet of the segment being merged gives the index its start
+  bool m_indexStart;
 
-  // Playback context
-  TSDemux::AVContext* m_AVContext;
   uint16_t m_mainStreamPID;     ///< PID of main stream
   int64_t m_segmentReadTime;    ///< current relative position based on segments (DVD_TIME_BASE)
   int64_t m_readTime;           ///< current relative position based on packets read (DVD_TIME_BASE)
   std::set<uint16_t> m_nosetup;
+  std::set<uint16_t> m_disabled; // Needs demux_mutex
 
   SegmentStorage *m_av_contents;
+  WorkerPool *m_worker_pool;
   hls::Segment current_segment;
   bool m_isStreamDone;
   bool m_segmentChanged;
   bool include_discontinuity;
 
   std::condition_variable read_demux_cv;
-  std::condition_variable demux_cv;
-  std::thread demux_thread;
   std::atomic_bool quit_processing;
+  TaskGroup task_group;
+  SerialTask demux_task;
 };
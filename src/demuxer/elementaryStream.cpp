@@ -26,9 +26,71 @@
 #include <cstring>    // memset memcpy memmove
 #include <climits>    // for INT_MAX
 #include <cerrno>
+#include <utility>
+#include <vector>
+
+#include <p8-platform/threads/mutex.h>
 
 using namespace TSDemux;
 
+namespace
+{
+  // Buffers of the streams that went away, the streams of the next program
+  // or demuxer start with them instead of allocating and growing their own
+  class BufferPool
+  {
+  public:
+    ~BufferPool()
+    {
+      for (size_t i = 0; i < buffers.size(); i++)
+        free(buffers[i].first);
+    }
+
+    // Smallest buffer that holds min_size, NULL when there isn't one.  Of
+    // the same size the one given back last, it is the most likely to still
+    // be in the cache.
+    unsigned char* Take(size_t min_size, size_t& size)
+    {
+      P8PLATFORM::CLockObject lock(mutex);
+      size_t best = buffers.size();
+      for (size_t i = buffers.size(); i-- > 0;)
+      {
+        if (buffers[i].second >= min_size && (best == buffers.size() || buffers[i].second < buffers[best].second))
+          best = i;
+      }
+      if (best == buffers.size())
+        return NULL;
+      unsigned char* buf = buffers[best].first;
+      size = buffers[best].second;
+      buffers.erase(buffers.begin() + best);
+      return buf;
+    }
+
+    void Give(unsigned char* buf, size_t size)
+    {
+      {
+        P8PLATFORM::CLockObject lock(mutex);
+        if (buffers.size() < ES_POOL_MAX_BUFFERS)
+        {
+          buffers.push_back(std::make_pair(buf, size));
+          return;
+        }
+      }
+      free(buf);
+    }
+
+  private:
+    P8PLATFORM::CMutex mutex;
+    std::vector<std::pair<unsigned char*, size_t> > buffers;
+  };
+
+  BufferPool& GetBufferPool()
+  {
+    static BufferPool pool;
+    return pool;
+  }
+}
+
 ElementaryStream::ElementaryStream(uint16_t pes_pid)
   : pid(pes_pid)
   , stream_type(STREAM_TYPE_UNKNOWN)
@@ -39,6 +101,7 @@ ElementaryStream::ElementaryStream(uint16_t pes_pid)
   , c_pcr(PTS_UNSET)
   , p_pcr(PTS_UNSET)
   , has_stream_info(false)
+  , pes_packets(false)
   , es_alloc_init(ES_INIT_BUFFER_SIZE)
   , es_buf(NULL)
   , es_alloc(0)
@@ -48,22 +111,29 @@ ElementaryStream::ElementaryStream(uint16_t pes_pid)
   , es_parsed(0)
   , es_found_frame(false)
   , es_frame_valid(false)
+  , es_packet_allocator(NULL)
+  , es_packet_data(NULL)
+  , es_packet_handle(NULL)
+  , es_packet_size(0)
+  , es_packet_len(0)
 {
   memset(&stream_info, 0, sizeof(STREAM_INFO));
 }
 
 ElementaryStream::~ElementaryStream(void)
 {
+  FreePESPacket();
   if (es_buf)
   {
     DBG(DEMUX_DBG_DEBUG, "free stream buffer %.4x: allocated size was %zu\n", pid, es_alloc);
-    free(es_buf);
+    GetBufferPool().Give(es_buf, es_alloc);
     es_buf = NULL;
   }
 }
 
 void ElementaryStream::Reset(void)
 {
+  FreePESPacket();
   ClearBuffer();
   es_found_frame = false;
   es_frame_valid = false;
@@ -74,15 +144,69 @@ void ElementaryStream::ClearBuffer()
   es_len = es_consumed = es_pts_pointer = es_parsed = 0;
 }
 
+void ElementaryStream::StartPESPacket(PacketAllocator* allocator, size_t len)
+{
+  // Left over when the last PES was cut short
+  FreePESPacket();
+  if (!pes_packets || es_consumed < es_len)
+    return;
+
+  es_packet_data = allocator->AllocatePacket(len, &es_packet_handle);
+  if (es_packet_data)
+  {
+    es_packet_allocator = allocator;
+    es_packet_size = len;
+    es_packet_len = 0;
+  }
+}
+
+void ElementaryStream::SetPacketAllocator(PacketAllocator* allocator)
+{
+  if (es_packet_data)
+    es_packet_allocator = allocator;
+}
+
+void ElementaryStream::FreePESPacket()
+{
+  if (es_packet_data)
+  {
+    es_packet_allocator->FreePacket(es_packet_handle);
+    es_packet_data = NULL;
+    es_packet_handle = NULL;
+  }
+}
+
 int ElementaryStream::Append(const unsigned char* buf, size_t len, bool new_pts)
 {
+  if (es_packet_data)
+  {
+    if (es_packet_len + len <= es_packet_size)
+    {
+      memcpy(es_packet_data + es_packet_len, buf, len);
+      es_packet_len += len;
+      return 0;
+    }
+    // Longer than the header said, the buffer takes it all
+    unsigned char* data = es_packet_data;
+    es_packet_data = NULL;
+    int ret = Append(data, es_packet_len, new_pts);
+    es_packet_allocator->FreePacket(es_packet_handle);
+    es_packet_handle = NULL;
+    if (ret < 0)
+      return ret;
+  }
+
   // Mark position where current pts become applicable
   if (new_pts)
     es_pts_pointer = es_len;
 
   if (es_buf && es_consumed)
   {
-    if (es_consumed < es_len)
+    if (es_consumed >= es_len)
+      ClearBuffer();
+    // The rest is only moved to the front when there is no room after it,
+    // instead of with every frame
+    else if (es_len + len > es_alloc)
     {
       memmove(es_buf, es_buf + es_consumed, es_len - es_consumed);
       es_len -= es_consumed;
@@ -94,8 +218,12 @@ int ElementaryStream::Append(const unsigned char* buf, size_t len, bool new_pts)
 
       es_consumed = 0;
     }
-    else
-      ClearBuffer();
+  }
+  if (!es_buf)
+  {
+    es_buf = GetBufferPool().Take(es_alloc_init, es_alloc);
+    if (es_buf)
+      DBG(DEMUX_DBG_DEBUG, "reuse buffer of size %zu for stream %.4x\n", es_alloc, pid);
   }
   if (es_len + len > es_alloc)
   {
@@ -192,7 +320,28 @@ bool ElementaryStream::GetStreamPacket(STREAM_PKT* pkt)
 void ElementaryStream::Parse(STREAM_PKT* pkt)
 {
   // No parser: pass-through
-  if (es_consumed < es_len)
+  if (es_packet_data)
+  {
+    if (es_packet_len > 0)
+    {
+      pkt->pid            = pid;
+      pkt->size           = es_packet_len;
+      pkt->data           = es_packet_data;
+      pkt->handle         = es_packet_handle;
+      pkt->dts            = c_dts;
+      pkt->pts            = c_pts;
+      if (c_dts == PTS_UNSET || p_dts == PTS_UNSET)
+        pkt->duration     = 0;
+      else
+        pkt->duration     = c_dts - p_dts;
+      pkt->streamChange   = false;
+      pkt->keyframe       = true;
+      // The packet is handed out with its memory
+      es_packet_data = NULL;
+      es_packet_handle = NULL;
+    }
+  }
+  else if (es_consumed < es_len)
   {
     es_consumed = es_parsed = es_len;
     pkt->pid              = pid;
@@ -205,6 +354,7 @@ void ElementaryStream::Parse(STREAM_PKT* pkt)
     else
       pkt->duration       = c_dts - p_dts;
     pkt->streamChange     = false;
+    pkt->keyframe         = true;
   }
 }
 
@@ -213,10 +363,12 @@ void ElementaryStream::ResetStreamPacket(STREAM_PKT* pkt)
   pkt->pid                = 0xffff;
   pkt->size               = 0;
   pkt->data               = NULL;
+  pkt->handle             = NULL;
   pkt->dts                = PTS_UNSET;
   pkt->pts                = PTS_UNSET;
   pkt->duration           = 0;
   pkt->streamChange       = false;
+  pkt->keyframe           = true;
 }
 
 uint64_t ElementaryStream::Rescale(uint64_t a, uint64_t b, uint64_t c)
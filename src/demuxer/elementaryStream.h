@@ -27,6 +27,7 @@
 
 #define ES_INIT_BUFFER_SIZE     64000
 #define ES_MAX_BUFFER_SIZE      1048576
+#define ES_POOL_MAX_BUFFERS     16
 #define PTS_MASK                0x1ffffffffLL
 #define PTS_UNSET               0x1ffffffffLL
 #define PTS_TIME_BASE           90000LL
@@ -85,6 +86,19 @@ namespace TSDemux
     uint64_t              pcr;
     uint64_t              duration;
     bool                  streamChange;
+    bool                  keyframe;       ///< decoding can start at this packet
+    void*                 handle;         ///< packet of the PacketAllocator that data is in, NULL when it has to be copied
+  };
+
+  // Memory of the packets handed out, a PES of known length is put together
+  // in its packet instead of being copied there from the stream buffer
+  class PacketAllocator
+  {
+  public:
+    virtual ~PacketAllocator() {}
+    // NULL when the packet has to go through the stream buffer
+    virtual unsigned char* AllocatePacket(size_t size, void** handle) = 0;
+    virtual void FreePacket(void* handle) = 0;
   };
 
   class ElementaryStream
@@ -95,6 +109,9 @@ namespace TSDemux
     virtual void Reset();
     void ClearBuffer();
     int Append(const unsigned char* buf, size_t len, bool new_pts = false);
+    void StartPESPacket(PacketAllocator* allocator, size_t len);
+    // The PES packet being put together is freed through allocator from now on
+    void SetPacketAllocator(PacketAllocator* allocator);
     const char* GetStreamCodecName() const;
     static const char* GetStreamCodecName(STREAM_TYPE stream_type);
 
@@ -109,6 +126,7 @@ namespace TSDemux
     uint64_t c_pcr;
 
     bool has_stream_info;         ///< true if stream info is completed else it requires parsing of iframe
+    bool pes_packets;             ///< true if a packet is a whole PES payload, without a parser
 
     STREAM_INFO stream_info;
 
@@ -120,6 +138,7 @@ namespace TSDemux
     uint64_t Rescale(uint64_t a, uint64_t b, uint64_t c);
     bool SetVideoInformation(int FpsScale, int FpsRate, int Height, int Width, float Aspect, bool Interlaced);
     bool SetAudioInformation(int Channels, int SampleRate, int BitRate, int BitsPerSample, int BlockAlign);
+    void FreePESPacket();
 
     size_t es_alloc_init;         ///< Initial allocation of memory for buffer
     unsigned char* es_buf;        ///< The Pointer to buffer
@@ -130,6 +149,12 @@ namespace TSDemux
     size_t es_parsed;             ///< Parser: Last processed position in buffer
     bool   es_found_frame;        ///< Parser: Found frame
     bool   es_frame_valid;
+
+    PacketAllocator* es_packet_allocator;
+    unsigned char* es_packet_data;  ///< PES packet being put together, NULL when it goes into the buffer
+    void*  es_packet_handle;
+    size_t es_packet_size;        ///< Payload length the PES header gave
+    size_t es_packet_len;         ///< Size of data in the PES packet
   };
 }
 
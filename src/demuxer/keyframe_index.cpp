@@ -0,0 +1,87 @@
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "keyframe_index.h"
+
+#include "../globals.h"
+
+KeyframeIndex::SegmentKey KeyframeIndex::get_key(const hls::Segment &segment)
+{
+  // Byte ranges of one file are segments of their own
+  return SegmentKey(segment.get_url(), segment.byte_offset);
+}
+
+void KeyframeIndex::set_start_pts(const hls::Segment &segment, double pts)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  SegmentKey key = get_key(segment);
+  if (segments.find(key) != segments.end())
+    return;
+  if (added.size() >= KEYFRAME_INDEX_SEGMENTS)
+  {
+    segments.erase(added.front());
+    added.pop_front();
+  }
+  SegmentKeyframes &entry = segments[key];
+  entry.start_pts = pts;
+  added.push_back(key);
+}
+
+void KeyframeIndex::add_keyframe(const hls::Segment &segment, uint64_t offset, double pts)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = segments.find(get_key(segment));
+  if (it == segments.end())
+    return;
+  std::vector<Keyframe> &keyframes = it->second.keyframes;
+  // Demuxing the segment again finds the same ones
+  if (!keyframes.empty() && offset <= keyframes.back().offset)
+    return;
+  Keyframe keyframe;
+  keyframe.offset = offset;
+  keyframe.pts = pts;
+  keyframe.time = (pts - it->second.start_pts) / DVD_TIME_BASE;
+  keyframes.push_back(keyframe);
+}
+
+bool KeyframeIndex::find(const hls::Segment &segment, double time, bool backwards, Keyframe &keyframe)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = segments.find(get_key(segment));
+  if (it == segments.end())
+    return false;
+  const std::vector<Keyframe> &keyframes = it->second.keyframes;
+  if (time <= 0)
+    return false;
+  const Keyframe *found = nullptr;
+  for (auto kf = keyframes.begin(); kf != keyframes.end(); ++kf)
+  {
+    if (backwards ? kf->time > time : kf->time >= time)
+    {
+      // Keyframes are only missing after the last one found, this is the
+      // first one from time on
+      if (!backwards)
+        found = &*kf;
+      break;
+    }
+    found = &*kf;
+  }
+  if (!found)
+    return false;
+  keyframe = *found;
+  return true;
+}
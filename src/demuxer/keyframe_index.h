@@ -0,0 +1,72 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../hls/HLS.h"
+
+// Segments whose keyframes are kept, the oldest ones are dropped first
+const size_t KEYFRAME_INDEX_SEGMENTS = 3000;
+
+struct Keyframe
+{
+  Keyframe() : offset(0), pts(0), time(0) {};
+  // Bytes from the start of the segment to the TS packet its PES starts in
+  uint64_t offset;
+  // PTS of the frame (DVD_TIME_BASE)
+  double pts;
+  // Seconds from the start of the segment
+  double time;
+};
+
+// Where the keyframes of the main stream are in the segments demuxed so
+// far.  It outlives the streams so seeking into a segment that was played
+// before can start at a keyframe inside it.
+class KeyframeIndex
+{
+public:
+  // PTS of the segment's first packet, the keyframe times are from it.
+  // Only the first call for a segment counts.
+  void set_start_pts(const hls::Segment &segment, double pts);
+  // Keyframes of a segment without its start PTS are left out.  The one
+  // the segment starts with doesn't need to be added.
+  void add_keyframe(const hls::Segment &segment, uint64_t offset, double pts);
+  // The last keyframe at or before time, seconds into the segment.  Not
+  // backwards, the first one at or after it when it is known.  False when
+  // that is the start of the segment or the segment isn't indexed.
+  bool find(const hls::Segment &segment, double time, bool backwards, Keyframe &keyframe);
+private:
+  typedef std::pair<std::string, uint32_t> SegmentKey;
+  struct SegmentKeyframes
+  {
+    double start_pts;
+    // In the order they were demuxed, by offset
+    std::vector<Keyframe> keyframes;
+  };
+  static SegmentKey get_key(const hls::Segment &segment);
+
+  std::mutex lock;
+  std::map<SegmentKey, SegmentKeyframes> segments;
+  // Oldest first
+  std::deque<SegmentKey> added;
+};
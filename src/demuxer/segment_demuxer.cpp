@@ -0,0 +1,546 @@
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <xbmc_codec_types.h>
+
+#include "segment_demuxer.h"
+
+#include "../globals.h"
+
+#define LOGTAG                  "[SegmentDemuxer] "
+
+using namespace ADDON;
+
+static void recode_language(const char* muxLanguage, char* strLanguage)
+{
+  /*
+   * While XBMC does'nt support them.
+   * Fix unsupported language codes (EN 300 468 Annex F & J)
+   * 'qaa'        : Original audio
+   * 'qad','NAR'  : Audio Description
+   */
+  if (strncmp(muxLanguage, "qaa", 3) == 0 ||
+      strncmp(muxLanguage, "qad", 3) == 0 ||
+      strncmp(muxLanguage, "NAR", 3) == 0)
+  {
+    strLanguage[0] = 0;
+    strLanguage[1] = 0;
+    strLanguage[2] = 0;
+    strLanguage[3] = 0;
+  }
+  else
+  {
+    strLanguage[0] = muxLanguage[0];
+    strLanguage[1] = muxLanguage[1];
+    strLanguage[2] = muxLanguage[2];
+    strLanguage[3] = 0;
+  }
+}
+
+// False for codecs the player doesn't know
+static bool fill_stream_setup(const TSDemux::ElementaryStream* es, StreamSetup &setup)
+{
+  const char* codec_name = es->GetStreamCodecName();
+  xbmc_codec_t codec = CODEC->GetCodecByName(codec_name);
+  if (codec.codec_type == XBMC_CODEC_TYPE_UNKNOWN)
+    return false;
+
+  INPUTSTREAM_INFO &info = setup.info;
+  memset(&info, 0, sizeof(info));
+  info.m_pID = es->pid;
+  memcpy(info.m_codecName, codec_name, 32);
+  switch(codec.codec_type) {
+  case XBMC_CODEC_TYPE_VIDEO:
+          info.m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_VIDEO; break;
+  case XBMC_CODEC_TYPE_AUDIO:
+          info.m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_AUDIO; break;
+  case XBMC_CODEC_TYPE_SUBTITLE:
+          info.m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_SUBTITLE; break;
+  case XBMC_CODEC_TYPE_DATA:
+          info.m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_TELETEXT; break;
+  default:
+          info.m_streamType = INPUTSTREAM_INFO::STREAM_TYPE::TYPE_NONE; break;
+  }
+  recode_language(es->stream_info.language, info.m_language);
+  // info.iSubtitleInfo  = stream_identifier(es->stream_info.composition_id, es->stream_info.ancillary_id);
+  info.m_FpsScale      = es->stream_info.fps_scale;
+  info.m_FpsRate       = es->stream_info.fps_rate;
+  info.m_Height        = es->stream_info.height;
+  info.m_Width         = es->stream_info.width;
+  info.m_Aspect        = es->stream_info.aspect;
+  info.m_Channels      = es->stream_info.channels;
+  info.m_SampleRate    = es->stream_info.sample_rate;
+  info.m_BlockAlign    = es->stream_info.block_align;
+  info.m_BitRate       = es->stream_info.bit_rate;
+  info.m_BitsPerSample = es->stream_info.bits_per_sample;
+  info.m_Bandwidth = 0;
+  info.m_ExtraSize = 0;
+  info.m_ExtraData = nullptr;
+  setup.has_stream_info = es->has_stream_info;
+  return true;
+}
+
+static uint64_t packet_timestamp(const TSDemux::STREAM_PKT &pkt)
+{
+  return pkt.dts != PTS_UNSET ? pkt.dts : pkt.pts;
+}
+
+static bool is_video(TSDemux::STREAM_TYPE stream_type)
+{
+  switch (stream_type)
+  {
+  case TSDemux::STREAM_TYPE_VIDEO_MPEG1:
+  case TSDemux::STREAM_TYPE_VIDEO_MPEG2:
+  case TSDemux::STREAM_TYPE_VIDEO_H264:
+  case TSDemux::STREAM_TYPE_VIDEO_HEVC:
+  case TSDemux::STREAM_TYPE_VIDEO_MPEG4:
+  case TSDemux::STREAM_TYPE_VIDEO_VC1:
+    return true;
+  default:
+    return false;
+  }
+}
+
+SegmentDemuxer::SegmentDemuxer(SegmentSource *source, const hls::Segment &segment, uint64_t start_pos,
+    const std::set<uint16_t> &disabled, WorkerPool *worker_pool, std::function<void()> output_listener,
+    uint64_t skip_to)
+  : source(source)
+  , segment(segment)
+  , start_pos(start_pos)
+  , skip_to(skip_to)
+  , disabled(disabled)
+  , output_listener(output_listener)
+  , data_start(start_pos)
+  , data_end(start_pos)
+  , block_pos(0)
+  , block_data(nullptr)
+  , block_size(0)
+  , end_pos(0)
+  , data_ended(false)
+  , quit_processing(false)
+  , position(start_pos)
+  , m_AVContext(new TSDemux::AVContext(this, start_pos, 1))
+  , next_demuxer(nullptr)
+  , demux_done(false)
+  , skipped(skip_to == 0)
+  , program_found(false)
+  , task_group(worker_pool)
+  , demux_task(&task_group, [this] { process(); })
+{
+}
+
+SegmentDemuxer::~SegmentDemuxer()
+{
+  quit_processing = true;
+  task_group.cancel();
+  SAFE_DELETE(m_AVContext);
+  for (auto it = packets.begin(); it != packets.end(); ++it)
+  {
+    if (it->demux_packet)
+      ipsh->FreeDemuxPacket(it->demux_packet);
+  }
+}
+
+void SegmentDemuxer::extend(uint64_t end)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (data_ended || demux_done || end <= data_end)
+      return;
+    data_end = end;
+    if (end_pos && data_end >= end_pos + SEGMENT_TAIL_SIZE)
+    {
+      data_end = end_pos + SEGMENT_TAIL_SIZE;
+      data_ended = true;
+    }
+  }
+  demux_task.trigger();
+}
+
+void SegmentDemuxer::end_segment()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (!end_pos)
+    end_pos = data_end;
+}
+
+void SegmentDemuxer::end_data()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!end_pos)
+      end_pos = data_end;
+    data_ended = true;
+  }
+  demux_task.trigger();
+}
+
+void SegmentDemuxer::continue_with(SegmentDemuxer *next)
+{
+  {
+    std::lock_guard<std::mutex> guard(next->lock);
+    SAFE_DELETE(next->m_AVContext);
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    next_demuxer = next;
+    if (!end_pos)
+      end_pos = data_end;
+    data_ended = true;
+    if (demux_done)
+      hand_over();
+  }
+  demux_task.trigger();
+}
+
+void SegmentDemuxer::hand_over()
+{
+  if (!m_AVContext)
+    return;
+  TSDemux::AVContext *context = m_AVContext;
+  m_AVContext = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(next_demuxer->lock);
+    context->SetDemuxer(next_demuxer);
+    next_demuxer->m_AVContext = context;
+    // A TS packet cut off at the end of this segment is read again from its start
+    next_demuxer->data_start = std::min(next_demuxer->start_pos, context->GetPosition());
+  }
+  next_demuxer->demux_task.trigger();
+}
+
+bool SegmentDemuxer::wants_data()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return !data_ended && !demux_done;
+}
+
+bool SegmentDemuxer::is_segment_complete()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return end_pos != 0;
+}
+
+void SegmentDemuxer::EnableStream(uint16_t pid, bool enable)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (enable)
+  {
+    disabled.erase(pid);
+    if (m_AVContext)
+      m_AVContext->StartStreaming(pid);
+  }
+  else
+  {
+    disabled.insert(pid);
+    if (m_AVContext)
+      m_AVContext->StopStreaming(pid);
+  }
+}
+
+bool SegmentDemuxer::pop_packet(SegmentPacket &packet)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (packets.empty())
+    return false;
+  packet = std::move(packets.front());
+  packets.pop_front();
+  return true;
+}
+
+bool SegmentDemuxer::is_done()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return demux_done && packets.empty();
+}
+
+uint64_t SegmentDemuxer::get_position()
+{
+  return position;
+}
+
+uint64_t SegmentDemuxer::get_data_start()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return data_start;
+}
+
+const unsigned char* SegmentDemuxer::ReadAV(uint64_t pos, size_t n)
+{
+  // Called with lock held from process
+  if (pos < data_start || pos + n > data_end)
+    return NULL;
+  if (pos >= block_pos && pos + n <= block_pos + block_size)
+    return block_data + (size_t)(pos - block_pos);
+  size_t size = (size_t)(data_end - pos);
+  const uint8_t *data;
+  source->view(pos, size, data);
+  block_pos = pos;
+  block_data = data;
+  block_size = size;
+  if (size >= n)
+    return data;
+
+  // Only windows of a few packets get here, the TS packets of a segment
+  // don't straddle blocks
+  window.resize(n);
+  for (size_t copied = 0; copied < n; copied += size)
+  {
+    size = n - copied;
+    source->view(pos + copied, size, data);
+    if (size == 0)
+      return NULL;
+    memcpy(window.data() + copied, data, size);
+  }
+  return window.data();
+}
+
+bool SegmentDemuxer::OnStreamData()
+{
+  TSDemux::ElementaryStream* es = m_AVContext->GetPIDStream();
+  if (!es)
+    return true;
+
+  uint16_t pid = m_AVContext->GetPID();
+  if (end_pos && m_AVContext->GetPosition() >= end_pos && cut_timestamp.find(pid) == cut_timestamp.end())
+  {
+    // The PES header of the unit starting now hasn't been read, at the next
+    // unit start the stream has the timestamp of the first one past the end
+    uint64_t timestamp = es->c_dts != PTS_UNSET ? es->c_dts : es->c_pts;
+    auto pending = pending_timestamp.find(pid);
+    if (pending == pending_timestamp.end())
+      pending_timestamp[pid] = timestamp;
+    else if (timestamp != PTS_UNSET && timestamp != pending->second)
+      cut_timestamp[pid] = timestamp;
+  }
+  if (is_video(es->stream_type))
+    add_pes_start(es);
+
+  TSDemux::STREAM_PKT pkt;
+  while (es->GetStreamPacket(&pkt))
+  {
+    pkt.pcr = es->c_pcr;
+    if (pkt.duration > PTS_TIME_BASE * 2)
+      pkt.duration = 0;
+
+    // The packets come in order, from the first one of the next segment on
+    // they are left to its demuxer.  Timestamps can jump between segments,
+    // so the first one is found by its timestamp instead of comparing them.
+    auto cut = cut_timestamp.find(pkt.pid);
+    if (cut_streams.find(pkt.pid) != cut_streams.end() ||
+        (cut != cut_timestamp.end() && packet_timestamp(pkt) == cut->second))
+    {
+      cut_streams.insert(pkt.pid);
+      if (pkt.handle)
+        FreePacket(pkt.handle);
+      continue;
+    }
+
+    SegmentPacket packet;
+    packet.demux_packet = stream_pvr_data(&pkt);
+    if (!packet.demux_packet)
+      continue;
+    packet.pcr = pkt.pcr;
+    packet.keyframe = pkt.keyframe;
+    uint64_t keyframe_pos;
+    if (pkt.keyframe && pkt.pts != PTS_UNSET && find_pes_start(pkt.pid, pkt.pts, keyframe_pos))
+    {
+      packet.has_keyframe_offset = true;
+      packet.keyframe_offset = keyframe_pos - start_pos;
+    }
+    if (pkt.streamChange)
+    {
+      StreamSetup setup;
+      if (get_stream_setup(pkt.pid, setup))
+        packet.streams.push_back(setup);
+    }
+    active_streams.insert(pkt.pid);
+    packets.push_back(std::move(packet));
+  }
+  return true;
+}
+
+bool SegmentDemuxer::OnProgramChange()
+{
+  program_found = true;
+  SegmentPacket packet;
+  packet.program_change = true;
+  const std::vector<TSDemux::ElementaryStream*> es_streams = m_AVContext->GetStreams();
+  for (auto it = es_streams.begin(); it != es_streams.end(); ++it)
+  {
+    StreamSetup setup;
+    if (!fill_stream_setup(*it, setup))
+      continue;
+    packet.streams.push_back(setup);
+    if (disabled.find((*it)->pid) == disabled.end())
+      m_AVContext->StartStreaming((*it)->pid);
+  }
+  packets.push_back(std::move(packet));
+  // Ends the batch, process jumps to the keyframe
+  return skipped;
+}
+
+unsigned char* SegmentDemuxer::AllocatePacket(size_t size, void** handle)
+{
+  DemuxPacket* dxp = ipsh->AllocateDemuxPacket(size);
+  if (!dxp)
+    return NULL;
+  *handle = dxp;
+  return dxp->pData;
+}
+
+void SegmentDemuxer::FreePacket(void* handle)
+{
+  ipsh->FreeDemuxPacket(static_cast<DemuxPacket*>(handle));
+}
+
+bool SegmentDemuxer::tail_finished()
+{
+  if (!end_pos || m_AVContext->GetPosition() < end_pos)
+    return false;
+  for (auto it = active_streams.begin(); it != active_streams.end(); ++it)
+  {
+    if (cut_streams.find(*it) == cut_streams.end())
+      return false;
+  }
+  return true;
+}
+
+void SegmentDemuxer::process()
+{
+  bool done = false;
+  while (!done && !quit_processing)
+  {
+    size_t packet_count;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (demux_done || !m_AVContext)
+        return;
+      packet_count = packets.size();
+      int ret = m_AVContext->ProcessTSPackets(TS_PACKET_BATCH);
+      if (!skipped && program_found)
+      {
+        // Only the program is needed from before the keyframe
+        skipped = true;
+        if (m_AVContext->GetPosition() < start_pos + skip_to)
+          m_AVContext->GoPosition(start_pos + skip_to);
+      }
+      position = m_AVContext->GetPosition();
+      if (ret == TSDemux::AVCONTEXT_IO_ERROR)
+      {
+        // Picks up again when more data arrives
+        if (!data_ended)
+        {
+          if (packets.size() == packet_count)
+            return;
+          done = true;
+        }
+        else
+          demux_done = true;
+      }
+      else if (ret < 0)
+      {
+        xbmc->Log(LOG_ERROR, LOGTAG "%s: segment %d stopped with status %d", __FUNCTION__,
+            segment.media_sequence, ret);
+        demux_done = true;
+      }
+      else if (tail_finished())
+        demux_done = true;
+      if (demux_done)
+      {
+        done = true;
+        if (next_demuxer)
+          hand_over();
+      }
+      else if (packets.size() == packet_count)
+        continue;
+    }
+    output_listener();
+  }
+}
+
+DemuxPacket* SegmentDemuxer::stream_pvr_data(TSDemux::STREAM_PKT* pkt)
+{
+  if (!pkt)
+    return NULL;
+
+  DemuxPacket* dxp;
+  if (pkt->handle)
+    // Put together in place
+    dxp = static_cast<DemuxPacket*>(pkt->handle);
+  else
+  {
+    dxp = ipsh->AllocateDemuxPacket(pkt->size);
+    if (dxp && pkt->size > 0 && pkt->data)
+      memcpy(dxp->pData, pkt->data, pkt->size);
+  }
+  if (dxp)
+  {
+    dxp->iStreamId = (int)(pkt->pid);
+    dxp->iSize = pkt->size;
+    dxp->duration = (double)pkt->duration * DVD_TIME_BASE / PTS_TIME_BASE;
+    if (pkt->dts != PTS_UNSET)
+      dxp->dts = (double)pkt->dts * DVD_TIME_BASE / PTS_TIME_BASE;
+    else
+      dxp->dts = DVD_NOPTS_VALUE;
+    if (pkt->pts != PTS_UNSET)
+      dxp->pts = (double)pkt->pts * DVD_TIME_BASE / PTS_TIME_BASE;
+    else
+      dxp->pts = DVD_NOPTS_VALUE;
+  }
+  return dxp;
+}
+
+bool SegmentDemuxer::get_stream_setup(uint16_t pid, StreamSetup &setup)
+{
+  TSDemux::ElementaryStream* es = m_AVContext->GetStream(pid);
+  return es && fill_stream_setup(es, setup);
+}
+
+void SegmentDemuxer::add_pes_start(TSDemux::ElementaryStream* es)
+{
+  uint16_t pid = es->pid;
+  auto start = pes_start.find(pid);
+  if (start != pes_start.end())
+  {
+    // The PES header of the one that ends now has been read
+    std::deque<std::pair<uint64_t, uint64_t>> &starts = pes_starts[pid];
+    starts.push_back(std::make_pair(es->c_pts, start->second));
+    if (starts.size() > PES_START_HISTORY)
+      starts.pop_front();
+  }
+  pes_start[pid] = m_AVContext->GetPosition();
+}
+
+bool SegmentDemuxer::find_pes_start(uint16_t pid, uint64_t pts, uint64_t &position)
+{
+  auto starts = pes_starts.find(pid);
+  if (starts == pes_starts.end())
+    return false;
+  for (auto it = starts->second.rbegin(); it != starts->second.rend(); ++it)
+  {
+    if (it->first == pts)
+    {
+      position = it->second;
+      return true;
+    }
+  }
+  return false;
+}
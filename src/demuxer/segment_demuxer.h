@@ -0,0 +1,184 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "tsDemuxer.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "kodi_inputstream_types.h"
+#include "../hls/HLS.h"
+#include "../hls/segment_data.h"
+#include "../worker_pool.h"
+
+// TS packets parsed with the AV context locked once
+const size_t TS_PACKET_BATCH = 128;
+// Most of the next segment a segment's demuxer reads for the frames that
+// end there
+const size_t SEGMENT_TAIL_SIZE = 1024 * 1024;
+// Video PES of a stream remembered for finding where a keyframe starts, a
+// frame comes out of the parser a couple of PES after its own started
+const size_t PES_START_HISTORY = 8;
+
+struct StreamSetup {
+  INPUTSTREAM_INFO info;
+  // False until the parser found what the stream info needs
+  bool has_stream_info;
+};
+
+struct SegmentPacket {
+  SegmentPacket() : demux_packet(nullptr), pcr(0), keyframe(false), has_keyframe_offset(false),
+      keyframe_offset(0), program_change(false) {};
+  // NULL for a program change
+  DemuxPacket *demux_packet;
+  uint64_t pcr;
+  bool keyframe;
+  // For a video keyframe, bytes from the start of the segment to the TS
+  // packet its PES starts in.  Demuxing can start there once the program
+  // is known.
+  bool has_keyframe_offset;
+  uint64_t keyframe_offset;
+  // Every stream of the new program, streams is empty when it has none
+  bool program_change;
+  // For a packet, the new setup of its stream when it changed
+  std::vector<StreamSetup> streams;
+};
+
+// Demuxes one segment with its own AV context on the worker pool, reading
+// it in place from the source, so the segments ahead of playback are
+// demuxed at the same time.  The frames still open at the end of the
+// segment are finished from the start of the next one, frames that start
+// there are left to the next segment's demuxer.  That needs each segment to
+// start with a PAT, PMT and frames that can be decoded on their own, for
+// the others continue_with has the next demuxer carry on with this one's
+// AV context once it is done.
+class SegmentDemuxer : public TSDemux::TSDemuxer
+{
+public:
+  // output_listener is called from the worker when there are packets or
+  // the demuxer is done.  With skip_to the demuxer jumps from the program
+  // at the start of the segment to the keyframe at that offset.
+  SegmentDemuxer(SegmentSource *source, const hls::Segment &segment, uint64_t start_pos,
+      const std::set<uint16_t> &disabled, WorkerPool *worker_pool, std::function<void()> output_listener,
+      uint64_t skip_to = 0);
+  ~SegmentDemuxer();
+  SegmentDemuxer(const SegmentDemuxer& other) = delete;
+  SegmentDemuxer & operator= (const SegmentDemuxer & other) = delete;
+
+  const hls::Segment &get_segment() const { return segment; };
+  // Offset in the segment the frames start at, 0 for all of them
+  uint64_t get_skip_to() const { return skip_to; };
+  // The source has the data up to end, of the segment and then of the next
+  // segment while wants_data()
+  void extend(uint64_t end);
+  // The data from now on is the next segment's
+  void end_segment();
+  // No more data is coming
+  void end_data();
+  // Ends the data where next starts, next has no AV context of its own and
+  // demuxes with this one's once it is done.  For segments that carry on
+  // from the one before.
+  void continue_with(SegmentDemuxer *next);
+  bool wants_data();
+  bool is_segment_complete();
+  void EnableStream(uint16_t pid, bool enable);
+  // False when no packet is ready
+  bool pop_packet(SegmentPacket &packet);
+  // Everything has been demuxed and popped
+  bool is_done();
+  // Position in the TS the demuxing got to
+  uint64_t get_position();
+  // First position the demuxer reads, the source has to keep it until the
+  // demuxer is done
+  uint64_t get_data_start();
+private:
+  const unsigned char* ReadAV(uint64_t pos, size_t n);
+  bool OnStreamData();
+  bool OnProgramChange();
+  unsigned char* AllocatePacket(size_t size, void** handle);
+  void FreePacket(void* handle);
+  void process();
+  // Call with lock held
+  bool tail_finished();
+  // Call with lock held, gives the AV context to next_demuxer
+  void hand_over();
+  DemuxPacket* stream_pvr_data(TSDemux::STREAM_PKT* pkt);
+  bool get_stream_setup(uint16_t pid, StreamSetup &setup);
+  // Call with lock held, keeps track of where the video PES start
+  void add_pes_start(TSDemux::ElementaryStream* es);
+  bool find_pes_start(uint16_t pid, uint64_t pts, uint64_t &position);
+private:
+  SegmentSource *source;
+  hls::Segment segment;
+  uint64_t start_pos;
+  const uint64_t skip_to;
+  std::set<uint16_t> disabled;
+  std::function<void()> output_listener;
+
+  // Guards everything below, the worker holds it for a batch of packets
+  std::mutex lock;
+  // The data read from the source, data_start is before start_pos when a
+  // TS packet of the segment before carries over
+  uint64_t data_start;
+  uint64_t data_end;
+  // The rest of the block last viewed, most reads are in it and don't have
+  // to go to the source
+  uint64_t block_pos;
+  const uint8_t *block_data;
+  size_t block_size;
+  // A read that crosses a block or segment end is put together here
+  std::vector<uint8_t> window;
+  // Where the next segment starts, 0 until the segment is complete
+  uint64_t end_pos;
+  bool data_ended;
+  std::atomic<bool> quit_processing;
+  std::atomic<uint64_t> position;
+  // NULL while waiting for the AV context of the segment before
+  TSDemux::AVContext *m_AVContext;
+  // Carries on with the AV context once this one is done
+  SegmentDemuxer *next_demuxer;
+  std::deque<SegmentPacket> packets;
+  bool demux_done;
+  // Jumped to skip_to already, or not skipping
+  bool skipped;
+  bool program_found;
+
+  // Position of the PES each video stream is in
+  std::map<uint16_t, uint64_t> pes_start;
+  // PTS and position of the last PES of each video stream
+  std::map<uint16_t, std::deque<std::pair<uint64_t, uint64_t>>> pes_starts;
+
+  // Streams that had packets in the segment
+  std::set<uint16_t> active_streams;
+  // Timestamp of the PES still open at the end of the segment, the first
+  // one after it starts the next segment
+  std::map<uint16_t, uint64_t> pending_timestamp;
+  // Timestamp of the first PES of a stream in the next segment, packets
+  // from there on aren't this segment's
+  std::map<uint16_t, uint64_t> cut_timestamp;
+  // Streams whose packets reached the next segment
+  std::set<uint16_t> cut_streams;
+
+  TaskGroup task_group;
+  SerialTask demux_task;
+};
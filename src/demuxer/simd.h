@@ -0,0 +1,73 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <stdint.h>
+
+// Vector instructions for the byte scans, SSE2 is always there on x86-64,
+// AVX2 only when the compiler is told to use it
+#if defined(__AVX2__)
+#define TSDEMUX_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TSDEMUX_SSE2
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TSDEMUX_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace TSDemux
+{
+  // mask must not be 0
+  inline int CountTrailingZeros(uint64_t mask)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+  }
+
+  // mask must not be 0
+  inline int CountLeadingZeros(uint64_t mask)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(mask);
+#endif
+  }
+
+#if defined(TSDEMUX_NEON)
+  // Whether any byte of a comparison result is set
+  inline bool AnyByteSet(uint8x16_t matches)
+  {
+    uint64x2_t halves = vreinterpretq_u64_u8(matches);
+    return (vgetq_lane_u64(halves, 0) | vgetq_lane_u64(halves, 1)) != 0;
+  }
+#endif
+}
@@ -0,0 +1,70 @@
+/*
+ * start_code.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "start_code.h"
+#include "simd.h"
+
+namespace TSDemux
+{
+  size_t FindStartCode(const unsigned char* data, size_t len)
+  {
+    if (len < 3)
+      return len;
+    // Start codes that begin before here fit in the data
+    size_t last = len - 2;
+    size_t i = 0;
+    // Compares each byte and the two after it, the loads go 2 bytes further
+    // than the block
+#if defined(TSDEMUX_AVX2)
+    const __m256i zero32 = _mm256_setzero_si256();
+    const __m256i one32 = _mm256_set1_epi8(1);
+    for (; i + 34 <= len; i += 32)
+    {
+      __m256i b0 = _mm256_loadu_si256((const __m256i*)(data + i));
+      __m256i b1 = _mm256_loadu_si256((const __m256i*)(data + i + 1));
+      __m256i b2 = _mm256_loadu_si256((const __m256i*)(data + i + 2));
+      __m256i matches = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero32),
+          _mm256_cmpeq_epi8(b1, zero32)), _mm256_cmpeq_epi8(b2, one32));
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(matches);
+      if (mask)
+        return i + CountTrailingZeros(mask);
+    }
+#endif
+#if defined(TSDEMUX_SSE2)
+    const __m128i zero16 = _mm_setzero_si128();
+    const __m128i one16 = _mm_set1_epi8(1);
+    for (; i + 18 <= len; i += 16)
+    {
+      __m128i b0 = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i b1 = _mm_loadu_si128((const __m128i*)(data + i + 1));
+      __m128i b2 = _mm_loadu_si128((const __m128i*)(data + i + 2));
+      __m128i matches = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero16),
+          _mm_cmpeq_epi8(b1, zero16)), _mm_cmpeq_epi8(b2, one16));
+      uint32_t mask = (uint32_t)_mm_movemask_epi8(matches);
+      if (mask)
+        return i + CountTrailingZeros(mask);
+    }
+#elif defined(TSDEMUX_NEON)
+    const uint8x16_t zero16 = vdupq_n_u8(0);
+    const uint8x16_t one16 = vdupq_n_u8(1);
+    for (; i + 18 <= len; i += 16)
+    {
+      uint8x16_t matches = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(data + i), zero16),
+          vceqq_u8(vld1q_u8(data + i + 1), zero16)), vceqq_u8(vld1q_u8(data + i + 2), one16));
+      // The loop below finds which one
+      if (AnyByteSet(matches))
+        break;
+    }
+#endif
+    for (; i < last; i++)
+    {
+      // Most bytes aren't 0x01, check the last one first
+      if (data[i + 2] > 1)
+        i += 2;
+      else if (data[i + 2] == 1 && data[i + 1] == 0 && data[i] == 0)
+        return i;
+    }
+    return len;
+  }
+}
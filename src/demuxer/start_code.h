@@ -0,0 +1,40 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace TSDemux
+{
+  // Offset of the first 00 00 01 start code in data, len when there isn't
+  // a whole one
+  size_t FindStartCode(const unsigned char* data, size_t len);
+
+  // The parsers keep the last four bytes they went past in startcode, this
+  // moves p on to end and leaves startcode as if every byte was shifted in
+  template<typename T>
+  inline uint32_t SkipToPosition(uint32_t startcode, const unsigned char* buf, T& p, T end)
+  {
+    if (end - p > 4)
+      p = end - 4;
+    while (p < end)
+      startcode = startcode << 8 | buf[p++];
+    return startcode;
+  }
+}
@@ -29,10 +29,13 @@
 #include "ES_Subtitle.h"
 #include "ES_Teletext.h"
 #include "debug.h"
+#include "ts_sync.h"
 
 #include <cassert>
 
 #define MAX_RESYNC_SIZE         65536
+// Bytes searched for sync bytes at a time
+#define TS_SYNC_WINDOW          8192
 
 using namespace TSDemux;
 
@@ -40,6 +43,7 @@ AVContext::AVContext(TSDemuxer* const demux, uint64_t pos, uint16_t channel)
   : av_pos(pos)
   , av_data_len(FLUTS_NORMAL_TS_PACKETSIZE)
   , av_pkt_size(0)
+  , av_buf(NULL)
   , is_configured(false)
   , channel(channel)
   , pid(0xffff)
@@ -54,9 +58,18 @@ AVContext::AVContext(TSDemuxer* const demux, uint64_t pos, uint16_t channel)
   , pcr(PTS_UNSET)
 {
   m_demux = demux;
-  memset(av_buf, 0, sizeof(av_buf));
 };
 
+void AVContext::SetDemuxer(TSDemuxer* const demux)
+{
+  P8PLATFORM::CLockObject lock(mutex);
+
+  m_demux = demux;
+  for (size_t i = 0; i < TS_PID_COUNT; i++)
+    if (packets[i] && packets[i]->stream)
+      packets[i]->stream->SetPacketAllocator(demux);
+}
+
 void AVContext::StreamDiscontinuity(void)
 {
   P8PLATFORM::CLockObject lock(mutex);
@@ -68,6 +81,11 @@ void AVContext::Reset(void)
 {
   P8PLATFORM::CLockObject lock(mutex);
 
+  reset_packet();
+}
+
+void AVContext::reset_packet()
+{
   pid = 0xffff;
   transport_error = false;
   has_payload = false;
@@ -131,9 +149,9 @@ std::vector<ElementaryStream*> AVContext::GetStreams()
   P8PLATFORM::CLockObject lock(mutex);
 
   std::vector<ElementaryStream*> v;
-  for (std::map<uint16_t, Packet>::iterator it = packets.begin(); it != packets.end(); ++it)
-    if (it->second.packet_type == PACKET_TYPE_PES && it->second.stream)
-      v.push_back(it->second.stream);
+  for (size_t i = 0; i < TS_PID_COUNT; i++)
+    if (packets[i] && packets[i]->packet_type == PACKET_TYPE_PES && packets[i]->stream)
+      v.push_back(packets[i]->stream);
   return v;
 }
 
@@ -141,27 +159,31 @@ void AVContext::StartStreaming(uint16_t pid)
 {
   P8PLATFORM::CLockObject lock(mutex);
 
-  std::map<uint16_t, Packet>::iterator it = packets.find(pid);
-  if (it != packets.end())
-    it->second.streaming = true;
+  Packet* p = get_packet(pid);
+  if (p)
+    p->streaming = true;
 }
 
 void AVContext::StopStreaming(uint16_t pid)
 {
   P8PLATFORM::CLockObject lock(mutex);
 
-  std::map<uint16_t, Packet>::iterator it = packets.find(pid);
-  if (it != packets.end())
-    it->second.streaming = false;
+  Packet* p = get_packet(pid);
+  if (p && p->streaming)
+  {
+    p->streaming = false;
+    // Drops what was put together so far, streaming again waits for a unit start
+    p->Reset();
+  }
 }
 
 ElementaryStream* AVContext::GetStream(uint16_t pid) const
 {
   P8PLATFORM::CLockObject lock(mutex);
 
-  std::map<uint16_t, Packet>::const_iterator it = packets.find(pid);
-  if (it != packets.end())
-    return it->second.stream;
+  Packet* p = get_packet(pid);
+  if (p)
+    return p->stream;
   return NULL;
 }
 
@@ -169,9 +191,9 @@ uint16_t AVContext::GetChannel(uint16_t pid) const
 {
   P8PLATFORM::CLockObject lock(mutex);
 
-  std::map<uint16_t, Packet>::const_iterator it = packets.find(pid);
-  if (it != packets.end())
-    return it->second.channel;
+  Packet* p = get_packet(pid);
+  if (p)
+    return p->channel;
   return 0xffff;
 }
 
@@ -179,11 +201,27 @@ void AVContext::ResetPackets()
 {
   P8PLATFORM::CLockObject lock(mutex);
 
-  for (std::map<uint16_t, Packet>::iterator it = packets.begin(); it != packets.end(); ++it)
+  for (size_t i = 0; i < TS_PID_COUNT; i++)
   {
-    it->second.Reset();
+    if (packets[i])
+    {
+      packets[i]->Reset();
+      packets[i].reset();
+    }
   }
-  packets.clear();
+}
+
+Packet* AVContext::get_packet(uint16_t pid) const
+{
+  return packets[pid & 0x1fff].get();
+}
+
+Packet& AVContext::add_packet(uint16_t pid)
+{
+  std::unique_ptr<Packet>& p = packets[pid & 0x1fff];
+  if (!p)
+    p.reset(new Packet());
+  return *p;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -257,71 +295,44 @@ STREAM_TYPE AVContext::get_stream_type(uint8_t pes_type)
   return STREAM_TYPE_UNKNOWN;
 }
 
+const unsigned char* AVContext::read_window(uint64_t pos, size_t* len, size_t min_len)
+{
+  // Shorter windows for the end of the data
+  for (; *len >= min_len; *len /= 2)
+  {
+    const unsigned char* data = m_demux->ReadAV(pos, *len);
+    if (data)
+      return data;
+  }
+  return NULL;
+}
+
 int AVContext::configure_ts()
 {
-  size_t data_size = AV_CONTEXT_PACKETSIZE;
   uint64_t pos = av_pos;
-  int fluts[][2] = {
-    {FLUTS_NORMAL_TS_PACKETSIZE, 0},
-    {FLUTS_M2TS_TS_PACKETSIZE, 0},
-    {FLUTS_DVB_ASI_TS_PACKETSIZE, 0},
-    {FLUTS_ATSC_TS_PACKETSIZE, 0}
-  };
-  int nb = sizeof (fluts) / (2 * sizeof (int));
-  int score = TS_CHECK_MIN_SCORE;
-
-  for (int i = 0; i < MAX_RESYNC_SIZE; i++)
+  size_t window = TS_SYNC_WINDOW;
+
+  while (pos < av_pos + MAX_RESYNC_SIZE)
   {
-    const unsigned char* data = m_demux->ReadAV(pos, data_size);
+    const unsigned char* data = read_window(pos, &window, AV_CONTEXT_PACKETSIZE * (TS_CHECK_MIN_SCORE + 1));
     if (!data)
       return AVCONTEXT_IO_ERROR;
-    if (data[0] == 0x47)
+    size_t offset, packet_size;
+    int ret = FindTSSync(data, window, TS_CHECK_MIN_SCORE, TS_CHECK_MAX_SCORE, &offset, &packet_size);
+    if (ret == TS_SYNC_FOUND)
     {
-      int count, found;
-      for (int t = 0; t < nb; t++) // for all fluts
-      {
-        const unsigned char* ndata;
-        uint64_t npos = pos;
-        int do_retry = score; // Reach for score
-        do
-        {
-          --do_retry;
-          npos += fluts[t][0];
-          if (!(ndata = m_demux->ReadAV(npos, data_size)))
-            return AVCONTEXT_IO_ERROR;
-        }
-        while (ndata[0] == 0x47 && (++fluts[t][1]) && do_retry);
-      }
-      // Is score reached ?
-      count = found = 0;
-      for (int t = 0; t < nb; t++)
-      {
-        if (fluts[t][1] == score)
-        {
-          found = t;
-          ++count;
-        }
-        // Reset score for next retry
-        fluts[t][1] = 0;
-      }
-      // One and only one is eligible
-      if (count == 1)
-      {
-        DBG(DEMUX_DBG_DEBUG, "%s: packet size is %d\n", __FUNCTION__, fluts[found][0]);
-        av_pkt_size = fluts[found][0];
-        av_pos = pos;
-        return AVCONTEXT_CONTINUE;
-      }
-      // More one: Retry for highest score
-      else if (count > 1 && ++score > TS_CHECK_MAX_SCORE)
-        // Packet size remains undetermined
-        break;
-      // None: Bad sync. Shift and retry
-      else
-        pos++;
+      DBG(DEMUX_DBG_DEBUG, "%s: packet size is %d\n", __FUNCTION__, (int)packet_size);
+      av_pkt_size = packet_size;
+      av_pos = pos + offset;
+      return AVCONTEXT_CONTINUE;
     }
-    else
-      pos++;
+    // Packet size remains undetermined
+    if (ret == TS_SYNC_AMBIGUOUS)
+      break;
+    // Not enough data left to check the sync byte at the start
+    if (offset == 0)
+      return AVCONTEXT_IO_ERROR;
+    pos += offset;
   }
 
   DBG(DEMUX_DBG_ERROR, "%s: invalid stream\n", __FUNCTION__);
@@ -329,6 +340,13 @@ int AVContext::configure_ts()
 }
 
 int AVContext::TSResync()
+{
+  P8PLATFORM::CLockObject lock(mutex);
+
+  return ts_resync();
+}
+
+int AVContext::ts_resync()
 {
   if (!is_configured)
   {
@@ -337,21 +355,35 @@ int AVContext::TSResync()
       return ret;
     is_configured = true;
   }
-  for (int i = 0; i < MAX_RESYNC_SIZE; i++)
+  const unsigned char* data = m_demux->ReadAV(av_pos, av_pkt_size);
+  if (!data)
+    return AVCONTEXT_IO_ERROR;
+  if (data[0] != 0x47)
   {
-    const unsigned char* data = m_demux->ReadAV(av_pos, av_pkt_size);
-    if (!data)
-      return AVCONTEXT_IO_ERROR;
-    if (data[0] == 0x47)
+    // Lost sync, skip to the next sync byte
+    uint64_t end = av_pos + MAX_RESYNC_SIZE;
+    size_t window = TS_SYNC_WINDOW;
+    while (true)
     {
-      memcpy(av_buf, data, av_pkt_size);
-      Reset();
-      return AVCONTEXT_CONTINUE;
+      if (av_pos >= end)
+        return AVCONTEXT_TS_NOSYNC;
+      data = read_window(av_pos, &window, av_pkt_size);
+      if (!data)
+        return AVCONTEXT_IO_ERROR;
+      // Only where a whole packet fits in the window
+      size_t candidates = window - av_pkt_size + 1;
+      size_t offset = FindSyncByte(data, candidates);
+      av_pos += offset;
+      if (offset < candidates)
+        break;
     }
-    av_pos++;
+    data = m_demux->ReadAV(av_pos, av_pkt_size);
+    if (!data)
+      return AVCONTEXT_IO_ERROR;
   }
-
-  return AVCONTEXT_TS_NOSYNC;
+  av_buf = data;
+  reset_packet();
+  return AVCONTEXT_CONTINUE;
 }
 
 uint64_t AVContext::GoNext()
@@ -405,10 +437,14 @@ int AVContext::ProcessTSPacket()
 {
   P8PLATFORM::CLockObject lock(mutex);
 
+  return process_ts_packet();
+}
+
+int AVContext::process_ts_packet()
+{
   int ret = AVCONTEXT_CONTINUE;
-  std::map<uint16_t, Packet>::iterator it;
 
-  if (av_rb8(this->av_buf) != 0x47) // ts sync byte
+  if (!this->av_buf || av_rb8(this->av_buf) != 0x47) // ts sync byte
     return AVCONTEXT_TS_NOSYNC;
 
   uint16_t header = av_rb16(this->av_buf + 1);
@@ -465,19 +501,19 @@ int AVContext::ProcessTSPacket()
     this->payload_len = this->av_data_len - n - 4;
   }
 
-  it = this->packets.find(this->pid);
-  if (it == this->packets.end())
+  Packet* it = get_packet(this->pid);
+  if (!it)
   {
     // Not registred PID
     // We are waiting for unit start of PID 0 else next packet is required
     if (this->pid == 0 && this->payload_unit_start)
     {
       // Registering PID 0
-      Packet pid0;
+      Packet& pid0 = add_packet(this->pid);
       pid0.pid = this->pid;
       pid0.packet_type = PACKET_TYPE_PSI;
       pid0.continuity = continuity_counter;
-      it = this->packets.insert(it, std::make_pair(this->pid, pid0));
+      it = &pid0;
     }
     else
       return AVCONTEXT_CONTINUE;
@@ -486,35 +522,35 @@ int AVContext::ProcessTSPacket()
   {
     // PID is registred
     // Checking unit start is required
-    if (it->second.wait_unit_start && !this->payload_unit_start)
+    if (it->wait_unit_start && !this->payload_unit_start)
     {
       // Not unit start. Save packet flow continuity...
-      it->second.continuity = continuity_counter;
+      it->continuity = continuity_counter;
       this->discontinuity = true;
       return AVCONTEXT_DISCONTINUITY;
     }
     // Checking continuity where possible
-    if (it->second.continuity != 0xff)
+    if (it->continuity != 0xff)
     {
-      uint8_t expected_cc = has_payload ? (it->second.continuity + 1) & 0x0f : it->second.continuity;
+      uint8_t expected_cc = has_payload ? (it->continuity + 1) & 0x0f : it->continuity;
       if (!is_discontinuity && expected_cc != continuity_counter)
       {
         this->discontinuity = true;
         // If unit is not start then reset PID and wait the next unit start
         if (!this->payload_unit_start)
         {
-          it->second.Reset();
+          it->Reset();
           DBG(DEMUX_DBG_WARN, "PID %.4x discontinuity detected: found %u, expected %u\n", this->pid, continuity_counter, expected_cc);
           return AVCONTEXT_DISCONTINUITY;
         }
       }
     }
-    it->second.continuity = continuity_counter;
+    it->continuity = continuity_counter;
   }
 
   this->discontinuity |= is_discontinuity;
   this->has_payload = has_payload;
-  this->packet = &(it->second);
+  this->packet = it;
 
   // It is time to stream data for PES
   if (this->payload_unit_start &&
@@ -538,6 +574,11 @@ int AVContext::ProcessTSPayload()
 {
   P8PLATFORM::CLockObject lock(mutex);
 
+  return process_ts_payload();
+}
+
+int AVContext::process_ts_payload()
+{
   if (!this->packet)
     return AVCONTEXT_CONTINUE;
 
@@ -557,33 +598,77 @@ int AVContext::ProcessTSPayload()
   return ret;
 }
 
+/*
+ * Process a batch of packets
+ *
+ * Does what a demuxer would do calling TSResync, ProcessTSPacket,
+ * ProcessTSPayload and GoNext for each packet, with the context locked once
+ * instead of on every call.
+ */
+int AVContext::ProcessTSPackets(size_t count)
+{
+  P8PLATFORM::CLockObject lock(mutex);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    int ret = ts_resync();
+    if (ret != AVCONTEXT_CONTINUE)
+      return ret;
+
+    ret = process_ts_packet();
+    bool more = true;
+    if (this->packet && this->packet->has_stream_data)
+      more = m_demux->OnStreamData();
+    if (this->has_payload)
+    {
+      ret = process_ts_payload();
+      if (ret == AVCONTEXT_PROGRAM_CHANGE)
+        more = m_demux->OnProgramChange() && more;
+    }
+
+    if (ret < 0)
+      DBG(DEMUX_DBG_WARN, "%s: error %d\n", __FUNCTION__, ret);
+
+    if (ret == AVCONTEXT_TS_ERROR)
+      av_pos++;
+    else
+      av_pos += av_pkt_size;
+    reset_packet();
+    if (!more)
+      break;
+  }
+  return AVCONTEXT_CONTINUE;
+}
+
 void AVContext::clear_pmt()
 {
   DBG(DEMUX_DBG_DEBUG, "%s\n", __FUNCTION__);
   std::vector<uint16_t> pid_list;
-  for (std::map<uint16_t, Packet>::iterator it = this->packets.begin(); it != this->packets.end(); ++it)
+  for (size_t i = 0; i < TS_PID_COUNT; i++)
   {
-    if (it->second.packet_type == PACKET_TYPE_PSI && it->second.packet_table.table_id == 0x02)
+    Packet* p = this->packets[i].get();
+    if (p && p->packet_type == PACKET_TYPE_PSI && p->packet_table.table_id == 0x02)
     {
-      pid_list.push_back(it->first);
-      clear_pes(it->second.channel);
+      pid_list.push_back(i);
+      clear_pes(p->channel);
     }
   }
   for (std::vector<uint16_t>::iterator it = pid_list.begin(); it != pid_list.end(); ++it)
-    this->packets.erase(*it);
+    this->packets[*it].reset();
 }
 
 void AVContext::clear_pes(uint16_t channel)
 {
   DBG(DEMUX_DBG_DEBUG, "%s(%u)\n", __FUNCTION__, channel);
   std::vector<uint16_t> pid_list;
-  for (std::map<uint16_t, Packet>::iterator it = this->packets.begin(); it != this->packets.end(); ++it)
+  for (size_t i = 0; i < TS_PID_COUNT; i++)
   {
-    if (it->second.packet_type == PACKET_TYPE_PES && it->second.channel == channel)
-      pid_list.push_back(it->first);
+    Packet* p = this->packets[i].get();
+    if (p && p->packet_type == PACKET_TYPE_PES && p->channel == channel)
+      pid_list.push_back(i);
   }
   for (std::vector<uint16_t>::iterator it = pid_list.begin(); it != pid_list.end(); ++it)
-    this->packets.erase(*it);
+    this->packets[*it].reset();
 }
 
 /*
@@ -740,7 +825,7 @@ int AVContext::parse_ts_psi()
         DBG(DEMUX_DBG_DEBUG, "%s: PAT version %u: new PMT %.4x channel %u\n", __FUNCTION__, version, pmt_pid, channel);
         if (this->channel == 0 || this->channel == channel)
         {
-          Packet& pmt = this->packets[pmt_pid];
+          Packet& pmt = add_packet(pmt_pid);
           pmt.pid = pmt_pid;
           pmt.packet_type = PACKET_TYPE_PSI;
           pmt.channel = channel;
@@ -818,7 +903,7 @@ int AVContext::parse_ts_psi()
                   this->packet->pid, version, pes_pid, ElementaryStream::GetStreamCodecName(stream_type));
         if (stream_type != STREAM_TYPE_UNKNOWN)
         {
-          Packet& pes = this->packets[pes_pid];
+          Packet& pes = add_packet(pes_pid);
           pes.pid = pes_pid;
           pes.packet_type = PACKET_TYPE_PES;
           pes.channel = this->packet->channel;
@@ -864,6 +949,7 @@ int AVContext::parse_ts_psi()
             // No parser: pass-through
             es = new ElementaryStream(pes_pid);
             es->has_stream_info = true;
+            es->pes_packets = true;
             break;
           }
 
@@ -987,7 +1073,8 @@ int AVContext::parse_ts_pes()
   if (!this->has_payload || !this->payload || !this->payload_len || !this->packet)
     return AVCONTEXT_CONTINUE;
 
-  if (!this->packet->stream)
+  // Disabled streams aren't put together or parsed
+  if (!this->packet->stream || !this->packet->streaming)
     return AVCONTEXT_CONTINUE;
 
   if (this->payload_unit_start)
@@ -1051,6 +1138,12 @@ int AVContext::parse_ts_pes()
   {
     uint8_t flags = av_rb8(this->packet->packet_table.buf + 7);
 
+    // A known length lets the whole PES go straight into its packet
+    size_t pes_len = av_rb16(this->packet->packet_table.buf + 4);
+    size_t header_len = this->packet->packet_table.len - 6;
+    if (this->packet->streaming && this->packet->stream->pes_packets && pes_len > header_len)
+      this->packet->stream->StartPESPacket(m_demux, pes_len - header_len);
+
     //this->packet->stream->frame_num++;
 
     switch (flags & 0xc0)
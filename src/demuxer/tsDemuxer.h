@@ -26,7 +26,7 @@
 #include "elementaryStream.h"
 #include <p8-platform/threads/mutex.h>
 
-#include <map>
+#include <memory>
 #include <vector>
 
 #define FLUTS_NORMAL_TS_PACKETSIZE  188
@@ -37,13 +37,21 @@
 #define AV_CONTEXT_PACKETSIZE       208
 #define TS_CHECK_MIN_SCORE          2
 #define TS_CHECK_MAX_SCORE          10
+#define TS_PID_COUNT                0x2000
 
 namespace TSDemux
 {
-  class TSDemuxer
+  class TSDemuxer : public PacketAllocator
   {
   public:
     virtual const unsigned char* ReadAV(uint64_t pos, size_t len) = 0;
+    // Called from ProcessTSPackets with the context locked.  A unit started
+    // on a streaming PID, the finished one has to be taken from
+    // GetPIDStream() before the payload is added.  Returning false ends the
+    // batch after this packet.
+    virtual bool OnStreamData() { return true; }
+    // The program changed, the streams have been replaced
+    virtual bool OnProgramChange() { return true; }
   };
 
   enum {
@@ -61,6 +69,9 @@ namespace TSDemux
   public:
     AVContext(TSDemuxer* const demux, uint64_t pos, uint16_t channel);
     void Reset(void);
+    // Another demuxer reads the data and gets the packets from now on, the
+    // program and the streams carry over
+    void SetDemuxer(TSDemuxer* const demux);
 
     uint16_t GetPID() const;
     PACKET_TYPE GetPIDType() const;
@@ -84,6 +95,10 @@ namespace TSDemux
     uint64_t GetPosition() const;
     int ProcessTSPacket();
     int ProcessTSPayload();
+    // Resyncs, parses and steps over up to count packets with the context
+    // locked once.  Returns the TSResync error that stopped it, otherwise
+    // AVCONTEXT_CONTINUE.
+    int ProcessTSPackets(size_t count);
 
     void StreamDiscontinuity(void);
 
@@ -91,7 +106,17 @@ namespace TSDemux
     AVContext(const AVContext&);
     AVContext& operator=(const AVContext&);
 
+    // Reads len bytes, halving len down to min_len when there aren't that many
+    const unsigned char* read_window(uint64_t pos, size_t* len, size_t min_len);
     int configure_ts();
+    // Unlocked versions of the public calls, for use inside a batch
+    void reset_packet();
+    int ts_resync();
+    int process_ts_packet();
+    int process_ts_payload();
+    Packet* get_packet(uint16_t pid) const;
+    // Registers the PID when it isn't
+    Packet& add_packet(uint16_t pid);
     static STREAM_TYPE get_stream_type(uint8_t pes_type);
     static uint8_t av_rb8(const unsigned char* p);
     static uint16_t av_rb16(const unsigned char* p);
@@ -113,12 +138,14 @@ namespace TSDemux
     uint64_t av_pos;
     size_t av_data_len;
     size_t av_pkt_size;
-    unsigned char av_buf[AV_CONTEXT_PACKETSIZE];
+    // Current packet, parsed in place in the data from ReadAV
+    const unsigned char* av_buf;
 
     // TS Streams context
     bool is_configured;
     uint16_t channel;
-    std::map<uint16_t, Packet> packets;
+    // Indexed by PID, empty for PIDs that aren't registered
+    std::unique_ptr<Packet> packets[TS_PID_COUNT];
 
     // Packet context
     uint16_t pid;
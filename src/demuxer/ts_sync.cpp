@@ -0,0 +1,139 @@
+/*
+ * ts_sync.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "ts_sync.h"
+#include "simd.h"
+#include "tsDemuxer.h"
+
+#include <vector>
+
+#define TS_SYNC_BYTE 0x47
+
+namespace TSDemux
+{
+  static const size_t packet_sizes[] = {
+    FLUTS_NORMAL_TS_PACKETSIZE,
+    FLUTS_M2TS_TS_PACKETSIZE,
+    FLUTS_DVB_ASI_TS_PACKETSIZE,
+    FLUTS_ATSC_TS_PACKETSIZE
+  };
+  static const size_t packet_size_count = sizeof(packet_sizes) / sizeof(packet_sizes[0]);
+
+  size_t FindSyncByte(const unsigned char* data, size_t len)
+  {
+    size_t i = 0;
+#if defined(TSDEMUX_AVX2)
+    const __m256i sync32 = _mm256_set1_epi8(TS_SYNC_BYTE);
+    for (; i + 32 <= len; i += 32)
+    {
+      __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, sync32));
+      if (mask)
+        return i + CountTrailingZeros(mask);
+    }
+#endif
+#if defined(TSDEMUX_SSE2)
+    const __m128i sync16 = _mm_set1_epi8(TS_SYNC_BYTE);
+    for (; i + 16 <= len; i += 16)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+      uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, sync16));
+      if (mask)
+        return i + CountTrailingZeros(mask);
+    }
+#elif defined(TSDEMUX_NEON)
+    const uint8x16_t sync16 = vdupq_n_u8(TS_SYNC_BYTE);
+    for (; i + 16 <= len; i += 16)
+    {
+      // Any match in the 16 bytes, the loop below finds which one
+      if (AnyByteSet(vceqq_u8(vld1q_u8(data + i), sync16)))
+        break;
+    }
+#endif
+    for (; i < len; i++)
+    {
+      if (data[i] == TS_SYNC_BYTE)
+        return i;
+    }
+    return len;
+  }
+
+  int FindTSSync(const unsigned char* data, size_t len, int min_score, int max_score,
+      size_t* offset, size_t* packet_size)
+  {
+    // Every sync byte in the data in one pass, the candidates are checked
+    // against the bits instead of the data
+    std::vector<uint64_t> sync_bits((len + 63) / 64, 0);
+    for (size_t pos = FindSyncByte(data, len); pos < len; pos += 1 + FindSyncByte(data + pos + 1, len - pos - 1))
+      sync_bits[pos / 64] |= (uint64_t)1 << (pos % 64);
+
+    for (size_t word = 0; word < sync_bits.size(); word++)
+    {
+      uint64_t bits = sync_bits[word];
+      while (bits)
+      {
+        size_t pos = word * 64 + CountTrailingZeros(bits);
+        bits &= bits - 1;
+
+        // Sync bytes that follow at each size, up to max_score of them
+        int run[packet_size_count];
+        bool truncated[packet_size_count];
+        for (size_t t = 0; t < packet_size_count; t++)
+        {
+          run[t] = 0;
+          truncated[t] = false;
+          for (int k = 1; k <= max_score; k++)
+          {
+            size_t next = pos + k * packet_sizes[t];
+            if (next >= len)
+            {
+              truncated[t] = true;
+              break;
+            }
+            if (!(sync_bits[next / 64] & ((uint64_t)1 << (next % 64))))
+              break;
+            run[t]++;
+          }
+        }
+
+        for (int score = min_score; score <= max_score; score++)
+        {
+          int count = 0;
+          size_t found = 0;
+          bool undecided = false;
+          for (size_t t = 0; t < packet_size_count; t++)
+          {
+            if (run[t] >= score)
+            {
+              found = t;
+              count++;
+            }
+            else if (truncated[t])
+              undecided = true;
+          }
+          if (undecided)
+          {
+            *offset = pos;
+            return TS_SYNC_NEED_DATA;
+          }
+          if (count == 1)
+          {
+            *offset = pos;
+            *packet_size = packet_sizes[found];
+            return TS_SYNC_FOUND;
+          }
+          if (count == 0)
+            break;
+          if (score == max_score)
+          {
+            *offset = pos;
+            return TS_SYNC_AMBIGUOUS;
+          }
+        }
+      }
+    }
+    *offset = len;
+    return TS_SYNC_NONE;
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <stddef.h>
+
+namespace TSDemux
+{
+  enum
+  {
+    TS_SYNC_FOUND,
+    // No sync byte in the data
+    TS_SYNC_NONE,
+    // A sync byte too close to the end to tell whether packets start there
+    TS_SYNC_NEED_DATA,
+    // More than one packet size still fits at the highest score
+    TS_SYNC_AMBIGUOUS
+  };
+
+  // Offset of the first 0x47 in data, len when there isn't one
+  size_t FindSyncByte(const unsigned char* data, size_t len);
+
+  // Looks for the first sync byte that is followed by score more at the
+  // spacing of exactly one of the TS packet sizes.  The score starts at
+  // min_score and goes up to max_score while more than one size fits.
+  // offset is set to where the packets start, or where to carry on from
+  // with more data.
+  int FindTSSync(const unsigned char* data, size_t len, int min_score, int max_score,
+      size_t* offset, size_t* packet_size);
+}
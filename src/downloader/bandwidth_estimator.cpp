@@ -0,0 +1,150 @@
+/*
+ * bandwidth_estimator.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "bandwidth_estimator.h"
+
+Ewma::Ewma(double half_life) :
+alpha(std::exp(std::log(0.5) / half_life)),
+estimate(0),
+total_weight(0) {
+}
+
+void Ewma::add_sample(double weight, double value) {
+  double adjusted_alpha = std::pow(alpha, weight);
+  estimate = value * (1 - adjusted_alpha) + adjusted_alpha * estimate;
+  total_weight += weight;
+}
+
+double Ewma::get_estimate() const {
+  double zero_factor = 1 - std::pow(alpha, total_weight);
+  return estimate / zero_factor;
+}
+
+BandwidthEstimator::BandwidthEstimator(double initial_bandwidth) :
+initial_bandwidth(initial_bandwidth),
+fast(BANDWIDTH_FAST_HALF_LIFE),
+slow(BANDWIDTH_SLOW_HALF_LIFE),
+latency(LATENCY_HALF_LIFE) {
+}
+
+void BandwidthEstimator::add_sample(size_t bytes, double seconds) {
+  if (bytes == 0 || seconds <= 0) {
+    return;
+  }
+  double bits_per_second = bytes * 8 / seconds;
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  fast.add_sample(seconds, bits_per_second);
+  slow.add_sample(seconds, bits_per_second);
+  samples.push_back({bytes, bits_per_second});
+  if (samples.size() > BANDWIDTH_WINDOW_SAMPLES) {
+    samples.pop_front();
+  }
+}
+
+void BandwidthEstimator::add_latency_sample(double seconds) {
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  latency.add_sample(1, seconds);
+}
+
+double BandwidthEstimator::get_latency() {
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  if (latency.get_total_weight() == 0) {
+    return 0;
+  }
+  return latency.get_estimate();
+}
+
+double BandwidthEstimator::get_fast_estimate() {
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  if (fast.get_total_weight() == 0) {
+    return initial_bandwidth;
+  }
+  return fast.get_estimate();
+}
+
+double BandwidthEstimator::get_slow_estimate() {
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  if (slow.get_total_weight() == 0) {
+    return initial_bandwidth;
+  }
+  return slow.get_estimate();
+}
+
+double BandwidthEstimator::get_estimate() {
+  return std::min(get_fast_estimate(), get_slow_estimate());
+}
+
+double BandwidthEstimator::get_percentile(double percentile) {
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  if (samples.empty()) {
+    return initial_bandwidth;
+  }
+  std::vector<Sample> sorted(samples.begin(), samples.end());
+  std::sort(sorted.begin(), sorted.end(), [](const Sample &a, const Sample &b) {
+    return a.bits_per_second < b.bits_per_second;
+  });
+  size_t total_bytes = 0;
+  for(auto it = sorted.begin(); it != sorted.end(); ++it) {
+    total_bytes += it->bytes;
+  }
+  double wanted_bytes = total_bytes * percentile;
+  size_t bytes = 0;
+  for(auto it = sorted.begin(); it != sorted.end(); ++it) {
+    bytes += it->bytes;
+    if (bytes >= wanted_bytes) {
+      return it->bits_per_second;
+    }
+  }
+  return sorted.back().bits_per_second;
+}
+
+size_t BandwidthEstimator::get_number_of_samples() {
+  std::lock_guard<std::mutex> lock(estimator_mutex);
+  return samples.size();
+}
+
+TransferTimer::TransferTimer(BandwidthEstimator &estimator) :
+estimator(estimator),
+wait_start(std::chrono::steady_clock::now()),
+first_chunk(true),
+total_bytes(0),
+pending_bytes(0),
+pending_seconds(0) {
+}
+
+void TransferTimer::on_chunk(size_t bytes) {
+  std::chrono::duration<double> waited = std::chrono::steady_clock::now() - wait_start;
+  if (first_chunk) {
+    first_chunk = false;
+    estimator.add_latency_sample(waited.count());
+  }
+  total_bytes += bytes;
+  pending_bytes += bytes;
+  pending_seconds += waited.count();
+  if (pending_bytes >= BANDWIDTH_SAMPLE_BYTES) {
+    flush();
+  }
+}
+
+void TransferTimer::resume() {
+  wait_start = std::chrono::steady_clock::now();
+}
+
+void TransferTimer::finish() {
+  if (total_bytes >= BANDWIDTH_MIN_TRANSFER_BYTES) {
+    flush();
+  }
+  pending_bytes = 0;
+  pending_seconds = 0;
+}
+
+void TransferTimer::flush() {
+  estimator.add_sample(pending_bytes, pending_seconds);
+  pending_bytes = 0;
+  pending_seconds = 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Bytes that have to be received before they are turned into a sample,
+// smaller samples are dominated by timer resolution and latency
+const size_t BANDWIDTH_SAMPLE_BYTES = 64 * 1024;
+// Transfers smaller than this (playlists, keys) don't produce samples
+const size_t BANDWIDTH_MIN_TRANSFER_BYTES = 16 * 1024;
+// Half lives in seconds of transfer time
+const double BANDWIDTH_FAST_HALF_LIFE = 2.0;
+const double BANDWIDTH_SLOW_HALF_LIFE = 8.0;
+const size_t BANDWIDTH_WINDOW_SAMPLES = 20;
+// Half life in transfers of the time to the first byte
+const double LATENCY_HALF_LIFE = 4.0;
+
+// Exponentially weighted moving average where every sample is weighted by
+// how long it took, with the bias towards 0 of the start corrected
+class Ewma {
+public:
+  Ewma(double half_life);
+  void add_sample(double weight, double value);
+  double get_estimate() const;
+  double get_total_weight() const { return total_weight; };
+private:
+  double alpha;
+  double estimate;
+  double total_weight;
+};
+
+// Estimates throughput in bits per second from samples reported by the
+// downloaders.  Keeps a fast and a slow EWMA, the estimate is the lower of
+// the two so drops are followed quickly and spikes slowly, and a byte
+// weighted percentile over the last samples.
+class BandwidthEstimator {
+public:
+  BandwidthEstimator(double initial_bandwidth);
+  // bytes received while the transfer was actively receiving for seconds
+  void add_sample(size_t bytes, double seconds);
+  // Seconds from starting a transfer to its first byte
+  void add_latency_sample(double seconds);
+  // 0 until a transfer got its first byte
+  double get_latency();
+  double get_estimate();
+  double get_fast_estimate();
+  double get_slow_estimate();
+  // percentile between 0 and 1 of the recent samples
+  double get_percentile(double percentile);
+  size_t get_number_of_samples();
+private:
+  struct Sample {
+    size_t bytes;
+    double bits_per_second;
+  };
+  std::mutex estimator_mutex;
+  double initial_bandwidth;
+  Ewma fast;
+  Ewma slow;
+  Ewma latency;
+  std::deque<Sample> samples;
+};
+
+// Times the chunks of one transfer.  Only the time spent waiting for data
+// counts, time spent in the consumer's callback and the idle time between
+// transfers is left out.  Not thread safe, one per transfer.
+class TransferTimer {
+public:
+  TransferTimer(BandwidthEstimator &estimator);
+  // Call before handing a chunk to the consumer
+  void on_chunk(size_t bytes);
+  // Call once the consumer is done with the chunk
+  void resume();
+  // Reports what is left, unless the whole transfer was tiny
+  void finish();
+private:
+  void flush();
+  BandwidthEstimator &estimator;
+  std::chrono::steady_clock::time_point wait_start;
+  bool first_chunk;
+  size_t total_bytes;
+  size_t pending_bytes;
+  double pending_seconds;
+};
@@ -0,0 +1,276 @@
+/*
+ * curl_downloader.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+
+#include "../globals.h"
+#include "../helpers.h"
+#include "curl_downloader.h"
+
+#define LOGTAG                  "[CurlDownloader] "
+
+struct CurlTransfer {
+  CurlTransfer(BandwidthEstimator &estimator) : timer(estimator), byte_offset(0), byte_length(0), prewarm(false),
+      easy(nullptr), headers(nullptr), done(false), cancelled(false),
+      result(CURLE_OK), bytes(0), skip_bytes(0), checked_response(false) {};
+  TransferTimer timer;
+  std::string url;
+  uint32_t byte_offset;
+  uint32_t byte_length;
+  DownloadCallback func;
+  // Prewarm transfers are owned by the event loop
+  bool prewarm;
+  CURL *easy;
+  curl_slist *headers;
+  bool done;
+  bool cancelled;
+  CURLcode result;
+  size_t bytes;
+  // Servers that ignore the Range header send the whole file
+  size_t skip_bytes;
+  bool checked_response;
+};
+
+static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+  CurlTransfer *transfer = static_cast<CurlTransfer*>(userdata);
+  size_t length = size * nmemb;
+  if (!transfer->checked_response) {
+    transfer->checked_response = true;
+    long response_code = 0;
+    curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code == 200 && transfer->byte_offset) {
+      transfer->skip_bytes = transfer->byte_offset;
+    }
+  }
+  if (transfer->skip_bytes) {
+    size_t skipped = std::min(transfer->skip_bytes, length);
+    transfer->skip_bytes -= skipped;
+    if (skipped == length) {
+      return length;
+    }
+    ptr += skipped;
+    length -= skipped;
+  }
+  transfer->bytes += length;
+  transfer->timer.on_chunk(length);
+  bool successful = transfer->func(reinterpret_cast<const uint8_t*>(ptr), length);
+  transfer->timer.resume();
+  if (!successful) {
+    transfer->cancelled = true;
+    // Returning a different length aborts the transfer
+    return 0;
+  }
+  return size * nmemb;
+}
+
+CurlDownloader::CurlDownloader(double bandwidth) :
+Downloader(bandwidth),
+multi(nullptr),
+quit_processing(false) {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  multi = curl_multi_init();
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, CURL_MAX_HOST_CONNECTIONS);
+  curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, CURL_MAX_CONNECTS);
+  loop_thread = std::thread(&CurlDownloader::event_loop, this);
+}
+
+CurlDownloader::~CurlDownloader() {
+  {
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    quit_processing = true;
+  }
+  curl_multi_wakeup(multi);
+  loop_thread.join();
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+}
+
+void CurlDownloader::perform(CurlTransfer &transfer) {
+  // Kodi style urls carry extra headers after a |, url|Header=Value&Header2=Value
+  std::string url = transfer.url;
+  size_t header_start = url.find('|');
+  if (header_start != std::string::npos) {
+    std::vector<std::string> headers = split(url.substr(header_start + 1), '&');
+    for(auto it = headers.begin(); it != headers.end(); ++it) {
+      size_t equals = it->find('=');
+      if (equals == std::string::npos) {
+        continue;
+      }
+      std::string header = it->substr(0, equals) + ": " + url_decode(it->substr(equals + 1));
+      transfer.headers = curl_slist_append(transfer.headers, header.c_str());
+    }
+    url = url.substr(0, header_start);
+  }
+
+  CURL *easy = curl_easy_init();
+  transfer.easy = easy;
+  curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(easy, CURLOPT_PRIVATE, &transfer);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, 10L);
+  // Abort when the connection stalls instead of waiting forever
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, 30L);
+  if (transfer.headers) {
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer.headers);
+  }
+  if (transfer.prewarm) {
+    curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+  } else {
+    curl_easy_setopt(easy, CURLOPT_BUFFERSIZE, long(read_size));
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer);
+  }
+  if (transfer.byte_length) {
+    // The end of an HTTP range is the last byte wanted
+    char rangebuf[128];
+    sprintf(rangebuf, "%" PRIu64 "-%" PRIu64, uint64_t(transfer.byte_offset),
+        uint64_t(transfer.byte_offset) + uint64_t(transfer.byte_length) - 1);
+    curl_easy_setopt(easy, CURLOPT_RANGE, rangebuf);
+  } else if (transfer.byte_offset) {
+    char rangebuf[128];
+    sprintf(rangebuf, "%" PRIu64 "-", uint64_t(transfer.byte_offset));
+    curl_easy_setopt(easy, CURLOPT_RANGE, rangebuf);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    pending_transfers.push_back(&transfer);
+  }
+  curl_multi_wakeup(multi);
+}
+
+bool CurlDownloader::download(std::string url, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func) {
+  CurlTransfer transfer(bandwidth_estimator);
+  transfer.url = url;
+  transfer.byte_offset = byte_offset;
+  transfer.byte_length = byte_length;
+  transfer.func = func;
+  perform(transfer);
+
+  std::unique_lock<std::mutex> lock(transfer_mutex);
+  transfer_cv.wait(lock, [&] {
+    return transfer.done;
+  });
+  lock.unlock();
+
+  if (!transfer.bytes) {
+    xbmc->Log(ADDON::LOG_ERROR, LOGTAG "Download %s doesn't provide any data: %s", url.c_str(),
+        curl_easy_strerror(transfer.result));
+  } else if (transfer.cancelled) {
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Download cancelled");
+  }
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Download %s finished, download speed: %0.4lf, average: %0.4lf",
+      url.c_str(), get_current_bandwidth(), get_average_bandwidth());
+  return transfer.result == CURLE_OK && !transfer.cancelled;
+}
+
+std::string CurlDownloader::download(std::string url) {
+  std::string contents;
+  download(url, 0, 0, [&](const uint8_t *data, size_t length) -> bool {
+    contents.append(reinterpret_cast<const char*>(data), length);
+    return true;
+  });
+  return contents;
+}
+
+void CurlDownloader::prewarm(std::string location) {
+  std::string host = get_url_host(location);
+  if (host.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    if (!warm_hosts.insert(host).second) {
+      // Already have a connection to the host in the pool
+      return;
+    }
+  }
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Prewarming connection to %s", host.c_str());
+  CurlTransfer *transfer = new CurlTransfer(bandwidth_estimator);
+  transfer->url = location;
+  transfer->prewarm = true;
+  perform(*transfer);
+}
+
+void CurlDownloader::finish_transfer(CURL *easy, CURLcode result) {
+  CurlTransfer *transfer = nullptr;
+  curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**) &transfer);
+  curl_multi_remove_handle(multi, easy);
+
+  std::lock_guard<std::mutex> lock(transfer_mutex);
+  running_transfers.erase(transfer);
+  if (!transfer->prewarm) {
+    transfer->timer.finish();
+  }
+  curl_easy_cleanup(easy);
+  curl_slist_free_all(transfer->headers);
+  transfer->easy = nullptr;
+  transfer->headers = nullptr;
+  if (transfer->prewarm) {
+    if (result != CURLE_OK) {
+      // Let the next prewarm try again
+      warm_hosts.erase(get_url_host(transfer->url));
+    }
+    delete transfer;
+    return;
+  }
+  transfer->result = result;
+  transfer->done = true;
+  transfer_cv.notify_all();
+}
+
+void CurlDownloader::event_loop() {
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting event loop");
+  while(true) {
+    {
+      std::lock_guard<std::mutex> lock(transfer_mutex);
+      if (quit_processing) {
+        break;
+      }
+      while(!pending_transfers.empty()) {
+        curl_multi_add_handle(multi, pending_transfers.front()->easy);
+        running_transfers.insert(pending_transfers.front());
+        pending_transfers.pop_front();
+      }
+    }
+
+    int running_transfers;
+    curl_multi_perform(multi, &running_transfers);
+
+    int messages_left;
+    CURLMsg *message;
+    while((message = curl_multi_info_read(multi, &messages_left))) {
+      if (message->msg == CURLMSG_DONE) {
+        finish_transfer(message->easy_handle, message->data.result);
+      }
+    }
+
+    curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+
+  // Fail anything still in flight so no caller waits forever
+  std::vector<CURL*> easy_handles;
+  {
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    for(auto it = pending_transfers.begin(); it != pending_transfers.end(); ++it) {
+      curl_multi_add_handle(multi, (*it)->easy);
+      easy_handles.push_back((*it)->easy);
+    }
+    pending_transfers.clear();
+    for(auto it = running_transfers.begin(); it != running_transfers.end(); ++it) {
+      easy_handles.push_back((*it)->easy);
+    }
+  }
+  for(auto it = easy_handles.begin(); it != easy_handles.end(); ++it) {
+    finish_transfer(*it, CURLE_ABORTED_BY_CALLBACK);
+  }
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Exiting event loop");
+}
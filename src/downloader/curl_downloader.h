@@ -0,0 +1,67 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <curl/curl.h>
+
+#include "downloader.h"
+
+// Connections kept open to a single host, segments, playlists and keys
+// usually come from one or two hosts
+const long CURL_MAX_HOST_CONNECTIONS = 4;
+// Total number of idle connections kept in the pool
+const long CURL_MAX_CONNECTS = 16;
+
+struct CurlTransfer;
+
+// Downloader that runs all transfers on one libcurl multi handle.  The multi
+// handle owns the connection cache so every transfer to the same host reuses
+// an already open TCP/TLS connection when one is idle.  Transfers are driven
+// by a single event loop thread, callers block until their transfer is done.
+class CurlDownloader : public Downloader {
+public:
+  CurlDownloader(double bandwidth);
+  ~CurlDownloader();
+  CurlDownloader(const CurlDownloader& other) = delete;
+  CurlDownloader & operator= (const CurlDownloader & other) = delete;
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func);
+  std::string download(std::string location);
+  // Opens a connection to the host of location so the next transfer
+  // doesn't pay for the TCP/TLS setup
+  void prewarm(std::string location);
+private:
+  void perform(CurlTransfer &transfer);
+  void event_loop();
+  void finish_transfer(CURL *easy, CURLcode result);
+private:
+  CURLM *multi;
+  std::thread loop_thread;
+  // Protects everything below
+  std::mutex transfer_mutex;
+  std::condition_variable transfer_cv;
+  std::deque<CurlTransfer*> pending_transfers;
+  // Transfers added to the multi handle
+  std::set<CurlTransfer*> running_transfers;
+  std::set<std::string> warm_hosts;
+  bool quit_processing;
+};
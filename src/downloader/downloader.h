@@ -16,16 +16,52 @@
  *
  */
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <string>
 
+#include "bandwidth_estimator.h"
+
+// Receives the downloaded data as it arrives, the pointer is only valid
+// for the duration of the call. Return false to cancel the download.
+typedef std::function<bool(const uint8_t *data, size_t length)> DownloadCallback;
+
+// Bytes requested from the network per read
+const size_t DEFAULT_READ_SIZE = 64 * 1024;
+
 class Downloader {
 public:
+  Downloader(double initial_bandwidth = 0) :
+    read_size(DEFAULT_READ_SIZE), bandwidth_estimator(initial_bandwidth) {};
+  virtual ~Downloader() {};
   virtual std::string download(std::string location) = 0;
-  virtual void download(std::string location, uint32_t byte_offset, uint32_t byte_length,
-      std::function<bool(std::string)> func) {
-    func(download(location));
+  // Returns true when the whole range was received, false when the transfer
+  // failed or was cancelled part way through.  byte_length 0 downloads
+  // everything from byte_offset on.
+  virtual bool download(std::string location, uint32_t byte_offset, uint32_t byte_length,
+      DownloadCallback func) {
+    std::string contents = download(location);
+    if (byte_offset >= contents.length()) {
+      return false;
+    }
+    size_t length = contents.length() - byte_offset;
+    if (byte_length) {
+      length = std::min<size_t>(length, byte_length);
+    }
+    return func(reinterpret_cast<const uint8_t*>(contents.data()) + byte_offset, length);
   }
-  virtual double get_average_bandwidth() = 0;
-  virtual double get_current_bandwidth() = 0;
+  // Hint that location will be downloaded soon, lets the downloader open
+  // a connection ahead of time
+  virtual void prewarm(std::string /* location */) {};
+  // Bits per second
+  virtual double get_average_bandwidth() { return bandwidth_estimator.get_slow_estimate(); };
+  virtual double get_current_bandwidth() { return bandwidth_estimator.get_fast_estimate(); };
+  BandwidthEstimator &get_bandwidth_estimator() { return bandwidth_estimator; };
+  void set_read_size(size_t read_size) { this->read_size = read_size; };
+  size_t get_read_size() { return read_size; };
+protected:
+  size_t read_size;
+  // Downloaders time their own transfers and report them here
+  BandwidthEstimator bandwidth_estimator;
 };
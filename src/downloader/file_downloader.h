@@ -18,13 +18,11 @@
 
 #include "downloader.h"
 
+// Local files are treated as a 100 MBit/s link
+const double FILE_DOWNLOADER_BANDWIDTH = 100000000;
+
 class FileDownloader : public Downloader {
 public:
+  FileDownloader() : Downloader(FILE_DOWNLOADER_BANDWIDTH) {};
   std::string download(std::string location);
-  double get_current_bandwidth() {
-    return 100000000;
-  };
-  double get_average_bandwidth() {
-    return 100000000;
-  }
 };
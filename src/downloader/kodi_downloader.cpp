@@ -2,98 +2,121 @@
  * download_queue.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
  */
 
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <inttypes.h>
+#include <memory>
 
 #include "../globals.h"
+#include "../kodi.h"
 #include "kodi_downloader.h"
 
 KodiDownloader::KodiDownloader(double bandwidth) :
-  number_of_measurements(1),
-  current_measurement_index(1) {
-  for(uint32_t i = 0; i < BANDWIDTH_BINS; ++i) {
-    bandwidth_measurements[i] = 0;
-  }
-  bandwidth_measurements[0] = bandwidth;
-}
-
-double KodiDownloader::get_current_bandwidth() {
-  return bandwidth_measurements[current_measurement_index];
-}
-
-double KodiDownloader::get_average_bandwidth() {
-  double sum = 0;
-  for(int i = current_measurement_index; i < current_measurement_index + BANDWIDTH_BINS; ++i) {
-    sum += bandwidth_measurements[i % BANDWIDTH_BINS];
-  }
-  if (number_of_measurements > 0) {
-    return sum / (double) number_of_measurements;
-  }
-  return 0;
+  Downloader(bandwidth) {
 }
 
-void KodiDownloader::download(std::string url, uint32_t byte_offset, uint32_t byte_length, std::function<bool(std::string)> func) {
+bool KodiDownloader::download(std::string url, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func) {
   // open the file
   void* file = xbmc->CURLCreate(url.c_str());
   if (!file)
-    func("");
+    return false;
   xbmc->CURLAddOption(file, XFILE::CURL_OPTION_PROTOCOL, "seekable" , "0");
   xbmc->CURLAddOption(file, XFILE::CURL_OPTION_HEADER, "Connection", "keep-alive");
   xbmc->CURLAddOption(file, XFILE::CURL_OPTION_PROTOCOL, "acceptencoding", "gzip, deflate");
   if (byte_length) {
       char rangebuf[128];
+      // The end of an HTTP range is the last byte wanted
       sprintf(rangebuf, "bytes=%" PRIu64 "-%" PRIu64, uint64_t(byte_offset),
-          uint64_t(byte_offset) + uint64_t(byte_length));
+          uint64_t(byte_offset) + uint64_t(byte_length) - 1);
+      xbmc->CURLAddOption(file, XFILE::CURL_OPTION_HEADER, "Range", rangebuf);
+  } else if (byte_offset) {
+      char rangebuf[128];
+      sprintf(rangebuf, "bytes=%" PRIu64 "-", uint64_t(byte_offset));
       xbmc->CURLAddOption(file, XFILE::CURL_OPTION_HEADER, "Range", rangebuf);
   }
 
+  // Time to the first byte counts towards the transfer
+  TransferTimer timer(bandwidth_estimator);
   xbmc->CURLOpen(file, XFILE::READ_CHUNKED | XFILE::READ_NO_CACHE | XFILE::READ_AUDIO_VIDEO);
 
-  // read the file
-  char *buf = (char*)malloc(4*1024);
+  // Servers that ignore the Range header answer 200 with the whole file,
+  // the bytes before the range are skipped and the ones after it left out
+  uint64_t skip_bytes = 0;
+  uint64_t range_length = 0;
+  if (byte_offset || byte_length) {
+    addonstring protocol(xbmc->GetFilePropertyValue(file, XFILE::FILE_PROPERTY_RESPONSE_PROTOCOL, ""));
+    int response_code = 0;
+    sscanf(protocol.c_str(), "HTTP/%*s %d", &response_code);
+    if (response_code == 200) {
+      xbmc->Log(ADDON::LOG_DEBUG, "Download %s ignored the range, skipping %u bytes", url.c_str(), byte_offset);
+      skip_bytes = byte_offset;
+      range_length = byte_length;
+    }
+  }
+
+  // read the file straight into the buffer handed to the callback
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[read_size]);
   size_t nbRead, nbReadOverall = 0;
-  std::string ret;
-  while ((nbRead = xbmc->ReadFile(file, buf, 4 * 1024)) > 0 && ~nbRead) {
+  uint64_t delivered = 0;
+  bool completed = true;
+  bool range_done = false;
+  while ((nbRead = xbmc->ReadFile(file, buf.get(), read_size)) > 0) {
+    if (!~nbRead) {
+      // Read error, the connection was lost
+      completed = false;
+      break;
+    }
     nbReadOverall+= nbRead;
-    bool successfull = func(std::string(buf, nbRead));
+    timer.on_chunk(nbRead);
+    const uint8_t *data = buf.get();
+    size_t length = nbRead;
+    if (skip_bytes) {
+      size_t skipped = static_cast<size_t>(std::min<uint64_t>(skip_bytes, length));
+      skip_bytes -= skipped;
+      data += skipped;
+      length -= skipped;
+    }
+    if (range_length) {
+      length = static_cast<size_t>(std::min<uint64_t>(length, range_length - delivered));
+    }
+    delivered += length;
+    bool successfull = length == 0 || func(data, length);
+    timer.resume();
     if (!successfull) {
       xbmc->Log(ADDON::LOG_DEBUG, "Download cancelled");
+      completed = false;
+      break;
+    }
+    if (range_length && delivered >= range_length) {
+      range_done = true;
       break;
     }
   }
-  free(buf);
 
   if (!nbReadOverall)
   {
     xbmc->Log(ADDON::LOG_ERROR, "Download %s doesn't provide any data: invalid", url.c_str());
-    func("");
-  }
-
-  // Convert to bits/second
-  double current_download_speed_ = xbmc->GetFileDownloadSpeed(file) * 8;
-  //Calculate the new downloadspeed to 1MB
-  static const size_t ref_packet = 1024 * 1024;
-  double bandwidth_measurement;
-  if (nbReadOverall >= ref_packet) {
-    bandwidth_measurement = current_download_speed_;
-  } else {
-    double ratio = (double)nbReadOverall / ref_packet;
-    bandwidth_measurement = (get_current_bandwidth() * (1.0 - ratio)) + current_download_speed_*ratio;
+    completed = false;
   }
-  if (current_measurement_index >= BANDWIDTH_BINS) {
-    current_measurement_index = 0;
-  }
-  bandwidth_measurements[current_measurement_index++] = bandwidth_measurement;
-  if (number_of_measurements < BANDWIDTH_BINS) {
-    ++number_of_measurements;
+  // A dropped connection looks like the end of the file, compare against
+  // the content length to tell them apart
+  int64_t expected_length = xbmc->GetFileLength(file);
+  if (completed && !range_done && expected_length > 0 && nbReadOverall < uint64_t(expected_length)) {
+    xbmc->Log(ADDON::LOG_NOTICE, "Download %s truncated, %zu of %" PRId64 " bytes", url.c_str(),
+        nbReadOverall, expected_length);
+    completed = false;
   }
 
+  timer.finish();
+
   xbmc->CloseFile(file);
 
   xbmc->Log(ADDON::LOG_DEBUG, "Download %s finished, download speed: %0.4lf, average: %0.4lf",
       url.c_str(), get_current_bandwidth(), get_average_bandwidth());
+  return completed;
 }
 
 std::string KodiDownloader::download(std::string url) {
@@ -108,14 +131,17 @@ std::string KodiDownloader::download(std::string url) {
   xbmc->CURLOpen(file, XFILE::READ_CHUNKED | XFILE::READ_NO_CACHE);
 
   // read the file
-  char *buf = (char*)malloc(16*1024);
-  size_t nbRead, nbReadOverall = 0;
   std::string ret;
-  while ((nbRead = xbmc->ReadFile(file, buf, 16 * 1024)) > 0 && ~nbRead) {
-    nbReadOverall+= nbRead;
-    ret += std::string(buf, nbRead);
+  size_t nbRead, nbReadOverall = 0;
+  while (true) {
+    ret.resize(nbReadOverall + read_size);
+    nbRead = xbmc->ReadFile(file, &ret[nbReadOverall], read_size);
+    if (nbRead <= 0 || !~nbRead) {
+      break;
+    }
+    nbReadOverall += nbRead;
   }
-  free(buf);
+  ret.resize(nbReadOverall);
 
   if (!nbReadOverall)
   {
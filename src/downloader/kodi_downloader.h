@@ -18,25 +18,9 @@
 
 #include "downloader.h"
 
-static const int BANDWIDTH_BINS = 5;
-static const double COEFFICIENTS[] = {
-    0.5,
-    0.3,
-    0.1,
-    0.05,
-    0.05
-};
-
 class KodiDownloader : public Downloader {
 public:
   KodiDownloader(double bandwidth);
-  void download(std::string location, uint32_t byte_offset, uint32_t byte_length, std::function<bool(std::string)> func);
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func);
   std::string download(std::string location);
-  // Bytes per second
-  double get_current_bandwidth();
-  double get_average_bandwidth();
-private:
-  double bandwidth_measurements[BANDWIDTH_BINS];
-  uint32_t current_measurement_index;
-  uint32_t number_of_measurements;
 };
@@ -0,0 +1,41 @@
+/*
+ * prefetch_store.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "prefetch_store.h"
+
+void PrefetchStore::start(const std::string &location) {
+  std::lock_guard<std::mutex> guard(lock);
+  Entry &entry = entries[location];
+  entry.done = false;
+  entry.contents.clear();
+}
+
+void PrefetchStore::finish(const std::string &location, std::string contents) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    Entry &entry = entries[location];
+    entry.done = true;
+    entry.contents = std::move(contents);
+  }
+  done_cv.notify_all();
+}
+
+bool PrefetchStore::take(const std::string &location, std::string &contents) {
+  std::unique_lock<std::mutex> guard(lock);
+  if (entries.find(location) == entries.end()) {
+    return false;
+  }
+  done_cv.wait(guard, [&] {
+    auto it = entries.find(location);
+    return it == entries.end() || it->second.done;
+  });
+  auto it = entries.find(location);
+  if (it == entries.end()) {
+    // Another request took it while this one waited
+    return false;
+  }
+  contents = std::move(it->second.contents);
+  entries.erase(it);
+  return !contents.empty();
+}
@@ -0,0 +1,47 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Downloads started before anything asked for them, each is handed to the
+// first request for its location
+class PrefetchStore {
+public:
+  PrefetchStore() {};
+  PrefetchStore(const PrefetchStore& other) = delete;
+  PrefetchStore & operator= (const PrefetchStore & other) = delete;
+  // location is downloading, requests for it wait for it instead of
+  // downloading it again
+  void start(const std::string &location);
+  // Empty contents mean the download failed
+  void finish(const std::string &location, std::string contents);
+  // Waits when location is still downloading, false if it wasn't prefetched
+  // or the prefetch failed
+  bool take(const std::string &location, std::string &contents);
+private:
+  struct Entry {
+    bool done;
+    std::string contents;
+  };
+  std::mutex lock;
+  std::condition_variable done_cv;
+  std::unordered_map<std::string, Entry> entries;
+};
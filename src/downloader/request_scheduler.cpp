@@ -0,0 +1,117 @@
+/*
+ * request_scheduler.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "request_scheduler.h"
+
+static size_t class_index(RequestClass request_class) {
+  return static_cast<size_t>(request_class);
+}
+
+RequestScheduler::RequestScheduler(Downloader *downloader) :
+downloader(downloader),
+prefetch_store(nullptr) {
+  for(size_t i = 0; i < REQUEST_CLASS_COUNT; ++i) {
+    running[i] = 0;
+    waiting[i] = 0;
+  }
+}
+
+bool RequestScheduler::can_start(RequestClass request_class) {
+  size_t index = class_index(request_class);
+  if (running[index] >= REQUEST_CLASS_LIMITS[index]) {
+    return false;
+  }
+  if (request_class < RequestClass::SWITCH_TARGET) {
+    return true;
+  }
+  size_t total_running = 0;
+  for(size_t i = 0; i < REQUEST_CLASS_COUNT; ++i) {
+    total_running += running[i];
+    if (i < index && waiting[i] > 0) {
+      return false;
+    }
+  }
+  if (total_running >= REQUEST_LIMIT) {
+    return false;
+  }
+  // Speculative work only gets the connection while no segment needs it
+  return request_class != RequestClass::SPECULATIVE ||
+      running[class_index(RequestClass::SEGMENT)] == 0;
+}
+
+void RequestScheduler::wait_for_slot(std::unique_lock<std::mutex> &guard, const RequestClass &request_class) {
+  // request_class can be raised by another request while this one waits,
+  // which moves it between the waiting counts
+  ++waiting[class_index(request_class)];
+  slot_cv.wait(guard, [&] {
+    return can_start(request_class);
+  });
+  --waiting[class_index(request_class)];
+  ++running[class_index(request_class)];
+}
+
+void RequestScheduler::finish(RequestClass request_class) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    --running[class_index(request_class)];
+  }
+  slot_cv.notify_all();
+}
+
+std::string RequestScheduler::download(RequestClass request_class, std::string location) {
+  std::string contents;
+  if (prefetch_store && prefetch_store->take(location, contents)) {
+    return contents;
+  }
+  std::unique_lock<std::mutex> guard(lock);
+  auto it = shared_requests.find(location);
+  if (it != shared_requests.end()) {
+    std::shared_ptr<SharedRequest> request = it->second;
+    if (request_class < request->request_class && !request->started) {
+      --waiting[class_index(request->request_class)];
+      ++waiting[class_index(request_class)];
+      request->request_class = request_class;
+      slot_cv.notify_all();
+    }
+    slot_cv.wait(guard, [&] {
+      return request->done;
+    });
+    return request->contents;
+  }
+  std::shared_ptr<SharedRequest> request = std::make_shared<SharedRequest>();
+  request->request_class = request_class;
+  request->started = false;
+  request->done = false;
+  shared_requests.insert({location, request});
+  wait_for_slot(guard, request->request_class);
+  request->started = true;
+  RequestClass started_class = request->request_class;
+  guard.unlock();
+
+  contents = downloader->download(location);
+
+  guard.lock();
+  --running[class_index(started_class)];
+  request->contents = contents;
+  request->done = true;
+  shared_requests.erase(location);
+  guard.unlock();
+  slot_cv.notify_all();
+  return contents;
+}
+
+bool RequestScheduler::download(RequestClass request_class, std::string location, uint32_t byte_offset,
+    uint32_t byte_length, DownloadCallback func) {
+  std::string contents;
+  if (byte_offset == 0 && byte_length == 0 && prefetch_store && prefetch_store->take(location, contents)) {
+    return func(reinterpret_cast<const uint8_t*>(contents.data()), contents.length());
+  }
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    wait_for_slot(guard, request_class);
+  }
+  bool complete = downloader->download(location, byte_offset, byte_length, func);
+  finish(request_class);
+  return complete;
+}
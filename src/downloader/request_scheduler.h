@@ -0,0 +1,101 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "downloader.h"
+#include "prefetch_store.h"
+
+// Most important first
+enum class RequestClass {
+  // Segments the player is waiting on
+  SEGMENT,
+  KEY,
+  ACTIVE_PLAYLIST,
+  // Segments and playlist of a variant we are switching to
+  SWITCH_TARGET,
+  // Background refreshes of other variants
+  SPECULATIVE
+};
+const size_t REQUEST_CLASS_COUNT = 5;
+
+// Requests of each class allowed at the same time
+const size_t REQUEST_CLASS_LIMITS[REQUEST_CLASS_COUNT] = {2, 2, 1, 2, 1};
+// SWITCH_TARGET and SPECULATIVE requests don't start when this many
+// requests are running, the more important classes always can
+const size_t REQUEST_LIMIT = 4;
+
+// Decides when requests go out so the ones playback depends on don't share
+// the connection with work that can wait
+class RequestScheduler {
+public:
+  RequestScheduler(Downloader *downloader);
+  RequestScheduler(const RequestScheduler& other) = delete;
+  RequestScheduler & operator= (const RequestScheduler & other) = delete;
+  // Requests for a location that is already downloading share its result,
+  // raising its class if this one is more important
+  std::string download(RequestClass request_class, std::string location);
+  bool download(RequestClass request_class, std::string location, uint32_t byte_offset,
+      uint32_t byte_length, DownloadCallback func);
+  void prewarm(std::string location) { downloader->prewarm(location); };
+  Downloader *get_downloader() { return downloader; };
+  // Requests are answered from the store when it has their location, set
+  // before any request is made
+  void set_prefetch_store(PrefetchStore *prefetch_store) { this->prefetch_store = prefetch_store; };
+private:
+  struct SharedRequest {
+    RequestClass request_class;
+    bool started;
+    bool done;
+    std::string contents;
+  };
+  // Call with lock held
+  bool can_start(RequestClass request_class);
+  void wait_for_slot(std::unique_lock<std::mutex> &guard, const RequestClass &request_class);
+  void finish(RequestClass request_class);
+private:
+  Downloader *downloader;
+  PrefetchStore *prefetch_store;
+  std::mutex lock;
+  std::condition_variable slot_cv;
+  size_t running[REQUEST_CLASS_COUNT];
+  size_t waiting[REQUEST_CLASS_COUNT];
+  std::unordered_map<std::string, std::shared_ptr<SharedRequest>> shared_requests;
+};
+
+// Sends everything through the scheduler in one class, for code that
+// takes a Downloader
+class ScheduledDownloader : public Downloader {
+public:
+  ScheduledDownloader(RequestScheduler *scheduler, RequestClass request_class) :
+    scheduler(scheduler), request_class(request_class) {};
+  std::string download(std::string location) {
+    return scheduler->download(request_class, location);
+  };
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func) {
+    return scheduler->download(request_class, location, byte_offset, byte_length, func);
+  };
+  void prewarm(std::string location) { scheduler->prewarm(location); };
+private:
+  RequestScheduler *scheduler;
+  RequestClass request_class;
+};
@@ -0,0 +1,65 @@
+/*
+ * retry_download.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "../globals.h"
+#include "retry_download.h"
+
+#define LOGTAG                  "[RetryDownload] "
+
+RetryPolicy::RetryPolicy() :
+max_attempts(4),
+initial_backoff(250),
+max_backoff(4000),
+backoff_multiplier(2.0),
+wait([](std::chrono::milliseconds delay) -> bool {
+  std::this_thread::sleep_for(delay);
+  return true;
+}) {
+}
+
+bool download_with_retry(Downloader *downloader, std::string location,
+    uint32_t byte_offset, uint32_t byte_length, DownloadCallback func,
+    const RetryPolicy &policy) {
+  uint32_t received = 0;
+  bool cancelled = false;
+  std::chrono::milliseconds backoff = policy.initial_backoff;
+  for(uint32_t attempt = 1; ; ++attempt) {
+    uint32_t remaining_length = 0;
+    if (byte_length) {
+      if (received >= byte_length) {
+        // Everything the playlist asked for has arrived
+        return true;
+      }
+      remaining_length = byte_length - received;
+    }
+    bool completed = downloader->download(location, byte_offset + received, remaining_length,
+        [&](const uint8_t *data, size_t length) -> bool {
+      received += length;
+      if (!func(data, length)) {
+        cancelled = true;
+        return false;
+      }
+      return true;
+    });
+    if (completed) {
+      return true;
+    } else if (cancelled || attempt >= policy.max_attempts) {
+      break;
+    }
+    xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Download of %s failed after %u bytes, retrying in %d ms",
+        location.c_str(), received, (int) backoff.count());
+    if (!policy.wait(backoff)) {
+      break;
+    }
+    backoff = std::min(policy.max_backoff,
+        std::chrono::milliseconds((long long) (backoff.count() * policy.backoff_multiplier)));
+  }
+  if (!cancelled) {
+    xbmc->Log(ADDON::LOG_ERROR, LOGTAG "Giving up on %s after %u bytes", location.c_str(), received);
+  }
+  return false;
+}
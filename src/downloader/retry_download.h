@@ -0,0 +1,40 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chrono>
+
+#include "downloader.h"
+
+struct RetryPolicy {
+  RetryPolicy();
+  // Attempts including the first one
+  uint32_t max_attempts;
+  std::chrono::milliseconds initial_backoff;
+  std::chrono::milliseconds max_backoff;
+  double backoff_multiplier;
+  // Waits out the backoff, returns false to give up instead of retrying
+  std::function<bool(std::chrono::milliseconds)> wait;
+};
+
+// Downloads byte_length bytes at byte_offset (everything from byte_offset on
+// if byte_length is 0).  When the transfer fails part way through only the
+// missing bytes are requested again after a backoff, so func sees every byte
+// of the range exactly once.  Returns true if the whole range was received.
+bool download_with_retry(Downloader *downloader, std::string location,
+    uint32_t byte_offset, uint32_t byte_length, DownloadCallback func,
+    const RetryPolicy &policy = RetryPolicy());
@@ -0,0 +1,157 @@
+/*
+ * throughput_history.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "throughput_history.h"
+
+// Key of the history of all sessions
+static const std::string ALL_HOSTS = "*";
+static const std::string HISTORY_HEADER = "throughput_history 1";
+
+static double sample_weight(std::time_t time, std::time_t now) {
+  double age_days = std::max(0.0, std::difftime(now, time) / (24 * 60 * 60));
+  return std::pow(0.5, age_days / HISTORY_HALF_LIFE_DAYS);
+}
+
+bool ThroughputHistory::load(const std::string &path, const std::string &legacy_path) {
+  hosts.clear();
+  std::ifstream file(path);
+  if (!file) {
+    FILE *legacy_file = fopen(legacy_path.c_str(), "rb");
+    if (!legacy_file) {
+      return false;
+    }
+    double bandwidth = 0;
+    bool read = fread(&bandwidth, sizeof(double), 1, legacy_file) == 1;
+    fclose(legacy_file);
+    if (read && bandwidth > 0) {
+      add(ALL_HOSTS, {std::time(nullptr), bandwidth, 0});
+    }
+    return read;
+  }
+  std::string line;
+  if (!std::getline(file, line) || line != HISTORY_HEADER) {
+    return false;
+  }
+  while(std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string host;
+    long long time;
+    Sample sample;
+    if (fields >> host >> time >> sample.bits_per_second >> sample.latency_seconds) {
+      sample.time = static_cast<std::time_t>(time);
+      add(host, sample);
+    }
+  }
+  return true;
+}
+
+bool ThroughputHistory::save(const std::string &path) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file << HISTORY_HEADER << "\n";
+  for(auto host = hosts.begin(); host != hosts.end(); ++host) {
+    for(auto it = host->second.begin(); it != host->second.end(); ++it) {
+      file << host->first << " " << static_cast<long long>(it->time) << " " <<
+          it->bits_per_second << " " << it->latency_seconds << "\n";
+    }
+  }
+  return bool(file);
+}
+
+void ThroughputHistory::add(const std::string &host, const Sample &sample) {
+  std::vector<Sample> &samples = hosts[host];
+  samples.push_back(sample);
+  if (samples.size() > HISTORY_SAMPLES_PER_HOST) {
+    samples.erase(samples.begin());
+  }
+  if (hosts.size() > HISTORY_MAX_HOSTS) {
+    // Forget the host that was used longest ago
+    auto oldest = hosts.end();
+    for(auto it = hosts.begin(); it != hosts.end(); ++it) {
+      if (it->first != ALL_HOSTS && it->first != host &&
+          (oldest == hosts.end() || it->second.back().time < oldest->second.back().time)) {
+        oldest = it;
+      }
+    }
+    if (oldest != hosts.end()) {
+      hosts.erase(oldest);
+    }
+  }
+}
+
+void ThroughputHistory::add_sample(const std::string &host, double bits_per_second, double latency_seconds,
+    std::time_t time) {
+  if (bits_per_second <= 0) {
+    return;
+  }
+  Sample sample = {time, bits_per_second, latency_seconds};
+  if (!host.empty()) {
+    add(host, sample);
+  }
+  add(ALL_HOSTS, sample);
+}
+
+const std::vector<ThroughputHistory::Sample> *ThroughputHistory::get_samples(const std::string &host) {
+  auto it = hosts.find(host);
+  if (it == hosts.end() || host.empty()) {
+    it = hosts.find(ALL_HOSTS);
+  }
+  if (it == hosts.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+double ThroughputHistory::get_throughput(const std::string &host, std::time_t now, double percentile) {
+  const std::vector<Sample> *samples = get_samples(host);
+  if (!samples) {
+    return 0;
+  }
+  std::vector<Sample> sorted(samples->begin(), samples->end());
+  std::sort(sorted.begin(), sorted.end(), [](const Sample &a, const Sample &b) {
+    return a.bits_per_second < b.bits_per_second;
+  });
+  double total_weight = 0;
+  for(auto it = sorted.begin(); it != sorted.end(); ++it) {
+    total_weight += sample_weight(it->time, now);
+  }
+  double wanted_weight = total_weight * percentile;
+  double weight = 0;
+  for(auto it = sorted.begin(); it != sorted.end(); ++it) {
+    weight += sample_weight(it->time, now);
+    if (weight >= wanted_weight) {
+      return it->bits_per_second;
+    }
+  }
+  return sorted.back().bits_per_second;
+}
+
+double ThroughputHistory::get_latency(const std::string &host, std::time_t now) {
+  const std::vector<Sample> *samples = get_samples(host);
+  if (!samples) {
+    return 0;
+  }
+  double total_weight = 0;
+  double latency = 0;
+  for(auto it = samples->begin(); it != samples->end(); ++it) {
+    double weight = sample_weight(it->time, now);
+    total_weight += weight;
+    latency += weight * it->latency_seconds;
+  }
+  return total_weight > 0 ? latency / total_weight : 0;
+}
+
+double ThroughputHistory::get_start_bandwidth(const std::string &host, std::time_t now) {
+  double throughput = get_throughput(host, now, HISTORY_START_PERCENTILE);
+  // The first segment also waits for its first byte
+  double latency = get_latency(host, now);
+  return throughput * HISTORY_NOMINAL_SEGMENT_SECONDS / (HISTORY_NOMINAL_SEGMENT_SECONDS + latency);
+}
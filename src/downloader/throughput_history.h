@@ -0,0 +1,59 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sessions remembered per host
+const size_t HISTORY_SAMPLES_PER_HOST = 16;
+const size_t HISTORY_MAX_HOSTS = 64;
+// Days until a session counts half as much as one from today
+const double HISTORY_HALF_LIFE_DAYS = 7.0;
+// Low so a host that varies a lot starts on a variant it can keep up with
+const double HISTORY_START_PERCENTILE = 0.25;
+// Segment length assumed when taking the latency off the start throughput
+const double HISTORY_NOMINAL_SEGMENT_SECONDS = 6.0;
+
+// Throughput and latency of the sessions with every host, kept between
+// sessions to pick the variant to start on and seed the estimator.  Hosts
+// without a history get the one of all sessions.
+class ThroughputHistory {
+public:
+  ThroughputHistory() {};
+  // Reads the history from path, a legacy file with a single bandwidth in
+  // it becomes the history of all sessions if path doesn't exist yet
+  bool load(const std::string &path, const std::string &legacy_path);
+  bool save(const std::string &path);
+  void add_sample(const std::string &host, double bits_per_second, double latency_seconds, std::time_t time);
+  // Bits per second to choose the first variant with, 0 if nothing is known
+  double get_start_bandwidth(const std::string &host, std::time_t now);
+  double get_throughput(const std::string &host, std::time_t now, double percentile);
+  double get_latency(const std::string &host, std::time_t now);
+private:
+  struct Sample {
+    std::time_t time;
+    double bits_per_second;
+    double latency_seconds;
+  };
+  const std::vector<Sample> *get_samples(const std::string &host);
+  void add(const std::string &host, const Sample &sample);
+private:
+  std::unordered_map<std::string, std::vector<Sample>> hosts;
+};
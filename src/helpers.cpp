@@ -184,6 +184,15 @@ std::string url_decode(std::string text) {
   return escaped;
 }
 
+std::string get_url_host(const std::string &url) {
+  size_t scheme_end = url.find("://");
+  if (scheme_end == std::string::npos) {
+    return "";
+  }
+  size_t host_end = url.find_first_of("/|?", scheme_end + 3);
+  return url.substr(0, host_end);
+}
+
 static unsigned char HexNibble(char c)
 {
   if (c >= '0' && c <= '9')
@@ -32,4 +32,7 @@ std::string &trim(std::string &src);
 
 std::string url_decode(std::string text);
 
+// scheme://host[:port] part of the url, empty when it has no scheme
+std::string get_url_host(const std::string &url);
+
 std::string annexb_to_avc(const char *b16_data);
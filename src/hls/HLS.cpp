@@ -8,25 +8,29 @@
 #include <string>
 #include <algorithm>
 #include <climits>
+#include <cstring>
 
 #include "HLS.h"
 #include "../globals.h"
+#include "../helpers.h"
 
 #define LOGTAG                  "[HLS] "
 
 hls::Segment::Segment() :
 Resource(),
 duration(0),
+time_in_playlist(0),
 description(""),
 media_sequence(0),
 aes_uri(""),
 aes_iv(""),
 encrypted(false),
-byte_length(0),
-byte_offset(0),
 valid(false),
 discontinuity(false),
-time_in_playlist(0)
+discontinuity_sequence(0),
+independent(false),
+byte_length(0),
+byte_offset(0)
 {
 
 }
@@ -49,6 +53,9 @@ bool hls::MasterPlaylist::write_data(std::string line) {
         stream.set_url(line);
       }
       in_stream = false;
+      if (variant_listener) {
+        variant_listener(stream);
+      }
       return true;
   }
   if (line.find("#EXT-X-STREAM-INF") == 0) {
@@ -153,11 +160,33 @@ bool hls::MediaPlaylist::write_data(std::string line) {
       }
       segment.discontinuity = discontinuity;
       discontinuity = false;
+      segment.discontinuity_sequence = current_discontinuity_sequence;
+      segment.independent = independent_segments;
       segments.push_back(segment);
+  } else if (line.find("#EXT-X-SERVER-CONTROL") != std::string::npos) {
+    std::vector<std::string> attributes = get_attributes(line);
+    for(auto it = attributes.begin(); it != attributes.end(); ++it) {
+      // Not PART-HOLD-BACK, that is for low latency parts
+      if (trim(*it).find("HOLD-BACK=") == 0) {
+        start.hold_back = std::stod(it->substr(strlen("HOLD-BACK=")));
+      }
+    }
+  } else if (line.find("#EXT-X-START") != std::string::npos) {
+    std::string time_offset = get_attribute_value(line, "TIME-OFFSET");
+    if (!time_offset.empty()) {
+      start.has_time_offset = true;
+      start.time_offset = std::stod(time_offset);
+    }
+  } else if (line.find("#EXT-X-INDEPENDENT-SEGMENTS") != std::string::npos ||
+      line.find("#EXT-X-I-FRAMES-ONLY") != std::string::npos) {
+    independent_segments = true;
   } else if (line.find("#EXT-X-ENDLIST") != std::string::npos) {
       live = false;
+  } else if (line.find("#EXT-X-DISCONTINUITY-SEQUENCE") != std::string::npos) {
+    current_discontinuity_sequence = std::stoul(get_attributes(line)[0]);
   } else if (line.find("#EXT-X-DISCONTINUITY") != std::string::npos) {
     discontinuity = true;
+    ++current_discontinuity_sequence;
   }
   return true;
 }
@@ -175,15 +204,17 @@ bool hls::MediaPlaylist::load_contents(std::string playlist_contents) {
 
 hls::MediaPlaylist::MediaPlaylist()
 : Playlist(),
-  segment_target_duration(0),
-  starting_media_sequence(0),
-  current_media_sequence(0),
-  in_segment(false),
+  bandwidth(0),
   encrypted(false),
   live(true),
-  bandwidth(0),
+  discontinuity(false),
+  independent_segments(false),
   valid(false),
-  discontinuity(false)
+  in_segment(false),
+  segment_target_duration(0),
+  starting_media_sequence(0),
+  current_media_sequence(0),
+  current_discontinuity_sequence(0)
 {
 
 }
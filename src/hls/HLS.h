@@ -16,6 +16,7 @@
  *
  */
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <mutex>
@@ -66,6 +67,12 @@ namespace hls
     bool encrypted;
     bool valid;
     bool discontinuity;
+    // Counts the discontinuities before the segment, lines segments of
+    // different variants up across discontinuities
+    uint32_t discontinuity_sequence;
+    // Starts with the program and frames that decode without the segments
+    // before, from EXT-X-INDEPENDENT-SEGMENTS or EXT-X-I-FRAMES-ONLY
+    bool independent;
     uint32_t byte_length;
     uint32_t byte_offset;
     bool operator==(Segment segment) const {
@@ -76,6 +83,16 @@ namespace hls
     }
   };
 
+  // EXT-X-SERVER-CONTROL and EXT-X-START of a media playlist
+  struct PlaylistStart {
+    PlaylistStart() : hold_back(0), has_time_offset(false), time_offset(0) {};
+    // Seconds from the end of a live playlist to start at, 0 when not given
+    double hold_back;
+    bool has_time_offset;
+    // Seconds from the start of the playlist, from the end when negative
+    double time_offset;
+  };
+
   class MediaPlaylist : public Playlist {
     friend class MasterPlaylist;
   public:
@@ -94,6 +111,8 @@ namespace hls
     std::string aes_iv;
     bool live;
     bool discontinuity;
+    bool independent_segments;
+    PlaylistStart start;
     float get_segment_target_duration() { return segment_target_duration; };
     bool load_contents(std::string playlist_contents);
     bool valid;
@@ -112,6 +131,7 @@ namespace hls
     double segment_target_duration;
     uint32_t starting_media_sequence;
     uint32_t current_media_sequence;
+    uint32_t current_discontinuity_sequence;
     std::vector<Segment> segments;
   };
 
@@ -123,10 +143,15 @@ namespace hls
     ~MasterPlaylist();
 
     bool write_data(std::string line);
+    // Called with each variant as soon as its url is read
+    void set_variant_listener(std::function<void(const MediaPlaylist&)> variant_listener) {
+      this->variant_listener = variant_listener;
+    };
   protected:
     std::vector<MediaPlaylist> media_playlist;
   private:
     bool in_stream;
+    std::function<void(const MediaPlaylist&)> variant_listener;
   };
 
   class FileMasterPlaylist : public MasterPlaylist {
@@ -0,0 +1,59 @@
+/*
+ * abr.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "abr.h"
+
+size_t hls::ThroughputAbrController::select_variant(const std::vector<uint32_t> &variant_bandwidths,
+    const AbrState &state) {
+  double usable_bandwidth = state.throughput * ABR_BANDWIDTH_SAFETY;
+  size_t selected = 0;
+  for(size_t i = 0; i < variant_bandwidths.size(); ++i) {
+    if (variant_bandwidths.at(i) <= usable_bandwidth) {
+      selected = i;
+    }
+  }
+  return selected;
+}
+
+size_t hls::BufferAbrController::select_variant(const std::vector<uint32_t> &variant_bandwidths,
+    const AbrState &state) {
+  ThroughputAbrController throughput_rule;
+  size_t ideal = throughput_rule.select_variant(variant_bandwidths, state);
+  if (state.current_variant < 0) {
+    return ideal;
+  }
+  size_t current = state.current_variant;
+  if (state.stall_counter > 0) {
+    // Emergency, we already ran out of data
+    return 0;
+  }
+  double buffered_segments = 0;
+  if (state.segment_duration > 0) {
+    buffered_segments = state.buffered_time / state.segment_duration;
+  }
+  if (ideal > current && buffered_segments < ABR_UPSWITCH_BUFFER_SEGMENTS) {
+    // Not enough margin to absorb a wrong guess
+    return current;
+  } else if (ideal < current && buffered_segments >= ABR_DOWNSWITCH_BUFFER_SEGMENTS) {
+    // Enough buffered to ride out the dip
+    return current;
+  }
+  return ideal;
+}
+
+bool hls::should_abandon_download(const DownloadProgress &progress) {
+  if (progress.fallback_size == 0 || progress.expected == 0 || progress.received == 0 ||
+      progress.elapsed < ABANDON_MIN_ELAPSED) {
+    return false;
+  }
+  if (progress.received >= progress.expected * ABANDON_MAX_PROGRESS) {
+    return false;
+  }
+  double rate = progress.received / progress.elapsed;
+  double remaining_time = (progress.expected - progress.received) / rate;
+  if (remaining_time <= progress.buffered_time) {
+    return false;
+  }
+  return progress.fallback_size / rate < remaining_time;
+}
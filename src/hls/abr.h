@@ -0,0 +1,93 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace hls {
+  // Fraction of the measured throughput a variant may use
+  const double ABR_BANDWIDTH_SAFETY = 0.8;
+  // Buffer, in segments, needed before switching up
+  const double ABR_UPSWITCH_BUFFER_SEGMENTS = 1.0;
+  // Buffer, in segments, above which we ride out a throughput drop
+  const double ABR_DOWNSWITCH_BUFFER_SEGMENTS = 1.5;
+
+  // Seconds a download runs before its progress is judged
+  const double ABANDON_MIN_ELAPSED = 1.0;
+  // Downloads this far along are always finished
+  const double ABANDON_MAX_PROGRESS = 0.8;
+
+  struct DownloadProgress {
+    DownloadProgress() : elapsed(0), received(0), expected(0),
+      buffered_time(0), fallback_size(0) {};
+    // Seconds since the download started
+    double elapsed;
+    uint64_t received;
+    // Expected size of the whole segment, 0 if unknown
+    uint64_t expected;
+    // Seconds of media the player has left
+    double buffered_time;
+    // Expected size of the same segment in the next lower variant, 0 if
+    // there is no lower variant
+    uint64_t fallback_size;
+  };
+
+  // True when, at the rate seen so far, the download won't finish before
+  // the player runs out of media and fetching the segment again from the
+  // lower variant would be quicker than finishing it
+  bool should_abandon_download(const DownloadProgress &progress);
+
+  struct AbrState {
+    AbrState() : throughput(0), buffered_time(0), current_variant(-1),
+      stall_counter(0), segment_duration(0) {};
+    // Bits per second
+    double throughput;
+    // Seconds of media downloaded or demuxed but not yet played
+    double buffered_time;
+    // Index of the variant being played, -1 when nothing plays yet
+    int current_variant;
+    // Number of times playback ran dry since the last decision
+    uint32_t stall_counter;
+    double segment_duration;
+  };
+
+  class AbrController {
+  public:
+    virtual ~AbrController() {};
+    // variant_bandwidths is sorted from lowest to highest, returns the
+    // index of the variant to play next
+    virtual size_t select_variant(const std::vector<uint32_t> &variant_bandwidths, const AbrState &state) = 0;
+  };
+
+  // Highest variant that fits in the throughput, ignores the buffer
+  class ThroughputAbrController : public AbrController {
+  public:
+    size_t select_variant(const std::vector<uint32_t> &variant_bandwidths, const AbrState &state);
+  };
+
+  // Throughput rule gated by the buffer level:
+  // - on a stall drop to the lowest variant straight away
+  // - only switch up with at least ABR_UPSWITCH_BUFFER_SEGMENTS buffered
+  // - keep the current variant through throughput dips while there is
+  //   more than ABR_DOWNSWITCH_BUFFER_SEGMENTS buffered
+  class BufferAbrController : public AbrController {
+  public:
+    size_t select_variant(const std::vector<uint32_t> &variant_bandwidths, const AbrState &state);
+  };
+}
@@ -39,7 +39,8 @@ bool convert_hex_to_bytes(std::string hex, AP4_UI08 *iv, uint32_t iv_length) {
 }
 
 
-std::string decrypt(std::string b64_aes_key, std::string iv_str, std::string encrypted_data_str) {
+void decrypt(const std::string &b64_aes_key, std::string iv_str, const uint8_t *encrypted_data,
+    size_t length, uint8_t *output) {
   uint32_t aes_key_len = 16;
   auto aes_key = std::make_unique<uint8_t[]>(aes_key_len);
   if (b64_aes_key.length() == 16) {
@@ -58,12 +59,15 @@ std::string decrypt(std::string b64_aes_key, std::string iv_str, std::string enc
     memcpy(iv.get(), iv_str.c_str(), iv_len);
   }
 
+  decrypt(aes_key.get(), iv.get(), encrypted_data, length, output);
+}
 
+std::string decrypt(std::string b64_aes_key, std::string iv_str, std::string encrypted_data_str) {
   const uint8_t* encrypted_data = reinterpret_cast<const uint8_t*>(encrypted_data_str.c_str());
 
   auto output = std::make_unique<AP4_UI08[]>(encrypted_data_str.length());
 
-  decrypt(aes_key.get(), iv.get(), encrypted_data, encrypted_data_str.length(), output.get());
+  decrypt(b64_aes_key, iv_str, encrypted_data, encrypted_data_str.length(), output.get());
 
   return std::string(reinterpret_cast<char*>(output.get()), encrypted_data_str.length());
 }
@@ -20,3 +20,6 @@
 
 
 std::string decrypt(std::string b64_aes_key, std::string iv_str, std::string encrypted_data_str);
+// Decrypts length bytes, a multiple of the AES block size, into output
+void decrypt(const std::string &b64_aes_key, std::string iv_str, const uint8_t *encrypted_data,
+    size_t length, uint8_t *output);
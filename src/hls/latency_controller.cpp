@@ -0,0 +1,22 @@
+/*
+ * latency_controller.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cmath>
+
+#include "latency_controller.h"
+
+uint32_t hls::LatencyController::update(double latency, double target_latency, double segment_duration) {
+  this->latency = latency;
+  if (segment_duration <= 0) {
+    return 0;
+  }
+  double behind = latency - target_latency;
+  if (behind < LATENCY_SKIP_SEGMENTS * segment_duration) {
+    return 0;
+  }
+  // Never past the target, the player would have to wait for the edge
+  uint32_t segments = static_cast<uint32_t>(std::floor(behind / segment_duration));
+  skipped_segments += segments;
+  return segments;
+}
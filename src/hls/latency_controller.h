@@ -0,0 +1,42 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+
+namespace hls {
+  // Playback this many segments further behind the live edge than the
+  // target skips ahead, closer than that Kodi's real time stream handling
+  // speeds playback up to drain its buffer
+  const double LATENCY_SKIP_SEGMENTS = 3.0;
+
+  // Keeps live playback near the hold-back from the live edge after stalls
+  // or a pause left it behind
+  class LatencyController {
+  public:
+    LatencyController() : latency(-1), skipped_segments(0) {};
+    // latency and target_latency in seconds behind the live edge, returns
+    // the whole segments to skip ahead, 0 to keep playing
+    uint32_t update(double latency, double target_latency, double segment_duration);
+    // Seconds behind the live edge at the last update, -1 before the first
+    double get_latency() const { return latency; };
+    uint32_t get_skipped_segments() const { return skipped_segments; };
+  private:
+    double latency;
+    uint32_t skipped_segments;
+  };
+}
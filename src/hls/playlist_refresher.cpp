@@ -0,0 +1,165 @@
+/*
+ * playlist_refresher.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+
+#include "../globals.h"
+#include "playlist_refresher.h"
+
+#define LOGTAG                  "[PlaylistRefresher] "
+
+hls::PlaylistRefresher::PlaylistRefresher(RequestScheduler *request_scheduler, WorkerPool *worker_pool) :
+request_scheduler(request_scheduler),
+task_group(worker_pool) {
+}
+
+hls::PlaylistRefresher::~PlaylistRefresher() {
+  task_group.cancel();
+}
+
+void hls::PlaylistRefresher::add_variant(const std::string &url) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (variants.find(url) != variants.end()) {
+    return;
+  }
+  Variant *variant = new Variant();
+  variant->url = url;
+  variant->loaded = false;
+  variant->priority = RefreshPriority::BACKGROUND;
+  variant->timer_pending = false;
+  variants.insert({url, std::unique_ptr<Variant>(variant)});
+  schedule(variant, std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(REFRESH_STAGGER_MS * variants.size()));
+}
+
+void hls::PlaylistRefresher::set_priorities(const std::vector<std::string> &active_urls,
+    const std::vector<std::string> &candidate_urls) {
+  std::vector<Variant*> promoted;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for(auto it = variants.begin(); it != variants.end(); ++it) {
+      Variant *variant = it->second.get();
+      RefreshPriority priority = RefreshPriority::BACKGROUND;
+      if (std::find(active_urls.begin(), active_urls.end(), variant->url) != active_urls.end()) {
+        priority = RefreshPriority::ACTIVE;
+      } else if (std::find(candidate_urls.begin(), candidate_urls.end(), variant->url) != candidate_urls.end()) {
+        priority = RefreshPriority::CANDIDATE;
+      }
+      if (priority == RefreshPriority::CANDIDATE && variant->priority != RefreshPriority::CANDIDATE) {
+        promoted.push_back(variant);
+      }
+      variant->priority = priority;
+    }
+  }
+  for(auto it = promoted.begin(); it != promoted.end(); ++it) {
+    // Catches up now if the last refresh is too old for a candidate
+    Variant *variant = *it;
+    task_group.submit([this, variant] {
+      refresh_in_background(variant);
+    });
+  }
+}
+
+bool hls::PlaylistRefresher::get_playlist(const std::string &url, MediaPlaylist &playlist) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = variants.find(url);
+  if (it == variants.end() || !it->second->loaded) {
+    return false;
+  }
+  playlist = it->second->playlist;
+  return true;
+}
+
+bool hls::PlaylistRefresher::download_playlist(const std::string &url, RequestClass request_class,
+    MediaPlaylist &playlist) {
+  std::string contents = request_scheduler->download(request_class, url);
+  if (contents.empty()) {
+    xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Unable to download playlist %s", url.c_str());
+    return false;
+  }
+  playlist.set_url(url);
+  playlist.load_contents(contents);
+  return true;
+}
+
+hls::MediaPlaylist hls::PlaylistRefresher::refresh(const std::string &url, RequestClass request_class) {
+  std::unique_lock<std::mutex> guard(lock);
+  auto it = variants.find(url);
+  if (it == variants.end()) {
+    guard.unlock();
+    MediaPlaylist playlist;
+    playlist.set_url(url);
+    download_playlist(url, request_class, playlist);
+    return playlist;
+  }
+  Variant *variant = it->second.get();
+  if (variant->loaded && std::chrono::steady_clock::now() - variant->refreshed_time <
+      std::chrono::milliseconds(REFRESH_COALESCE_MS)) {
+    return variant->playlist;
+  }
+  guard.unlock();
+
+  MediaPlaylist playlist;
+  bool downloaded = download_playlist(url, request_class, playlist);
+
+  guard.lock();
+  if (downloaded) {
+    variant->playlist = playlist;
+    variant->loaded = true;
+    variant->refreshed_time = std::chrono::steady_clock::now();
+  } else {
+    // Keep the last good copy, an empty one would end a live stream
+    playlist = variant->playlist;
+    playlist.set_url(url);
+  }
+  return playlist;
+}
+
+std::chrono::steady_clock::duration hls::PlaylistRefresher::get_interval(Variant *variant) {
+  double target_duration = std::max(double(variant->playlist.get_segment_target_duration()), MIN_REFRESH_SECONDS);
+  double factor = variant->priority == RefreshPriority::CANDIDATE ? CANDIDATE_REFRESH_FACTOR : BACKGROUND_REFRESH_FACTOR;
+  return std::chrono::milliseconds((int) (target_duration * factor * 1000));
+}
+
+void hls::PlaylistRefresher::schedule(Variant *variant, std::chrono::steady_clock::time_point time) {
+  if (variant->timer_pending && variant->timer_time <= time) {
+    return;
+  }
+  variant->timer_pending = true;
+  variant->timer_time = time;
+  std::chrono::steady_clock::duration delay = std::max(time - std::chrono::steady_clock::now(),
+      std::chrono::steady_clock::duration::zero());
+  task_group.submit_after(std::chrono::duration_cast<std::chrono::milliseconds>(delay), [this, variant] {
+    refresh_in_background(variant);
+  });
+}
+
+void hls::PlaylistRefresher::refresh_in_background(Variant *variant) {
+  bool due;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (variant->timer_pending && variant->timer_time <= now) {
+      variant->timer_pending = false;
+    }
+    due = !variant->loaded ||
+        (variant->priority != RefreshPriority::ACTIVE && now - variant->refreshed_time >= get_interval(variant));
+  }
+  if (due) {
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Refreshing %s", variant->url.c_str());
+    refresh(variant->url, RequestClass::SPECULATIVE);
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  if (variant->loaded && !variant->playlist.live) {
+    // The segments of a finished playlist don't change
+    return;
+  }
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point next = now + get_interval(variant);
+  if (variant->loaded && variant->priority != RefreshPriority::ACTIVE) {
+    next = std::max(variant->refreshed_time + get_interval(variant),
+        now + std::chrono::milliseconds(REFRESH_COALESCE_MS));
+  }
+  schedule(variant, next);
+}
@@ -0,0 +1,86 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "HLS.h"
+#include "../downloader/request_scheduler.h"
+#include "../worker_pool.h"
+
+namespace hls {
+  // Target durations between refreshes of a variant we may switch to next
+  const double CANDIDATE_REFRESH_FACTOR = 1.0;
+  // and of the other variants
+  const double BACKGROUND_REFRESH_FACTOR = 3.0;
+  const double MIN_REFRESH_SECONDS = 2.0;
+  // Gap between the first loads of the variants so they don't all go at once
+  const int REFRESH_STAGGER_MS = 1000;
+  // A refresh this soon after the last one gets the same playlist
+  const int REFRESH_COALESCE_MS = 500;
+
+  enum class RefreshPriority {
+    // Playing or about to, its stream refreshes it
+    ACTIVE,
+    CANDIDATE,
+    BACKGROUND
+  };
+
+  // Keeps a recent copy of every variant playlist so switching to a live
+  // variant doesn't have to download its playlist first
+  class PlaylistRefresher {
+  public:
+    PlaylistRefresher(RequestScheduler *request_scheduler, WorkerPool *worker_pool);
+    ~PlaylistRefresher();
+    PlaylistRefresher(const PlaylistRefresher& other) = delete;
+    PlaylistRefresher & operator= (const PlaylistRefresher & other) = delete;
+    void add_variant(const std::string &url);
+    void set_priorities(const std::vector<std::string> &active_urls,
+        const std::vector<std::string> &candidate_urls);
+    // Latest copy of the playlist, false until it has loaded
+    bool get_playlist(const std::string &url, MediaPlaylist &playlist);
+    // Downloads the playlist now, a refresh that is already downloading it
+    // is shared through the scheduler
+    MediaPlaylist refresh(const std::string &url, RequestClass request_class);
+  private:
+    struct Variant {
+      std::string url;
+      MediaPlaylist playlist;
+      bool loaded;
+      std::chrono::steady_clock::time_point refreshed_time;
+      RefreshPriority priority;
+      bool timer_pending;
+      std::chrono::steady_clock::time_point timer_time;
+    };
+    bool download_playlist(const std::string &url, RequestClass request_class, MediaPlaylist &playlist);
+    void refresh_in_background(Variant *variant);
+    // Call with lock held
+    void schedule(Variant *variant, std::chrono::steady_clock::time_point time);
+    std::chrono::steady_clock::duration get_interval(Variant *variant);
+  private:
+    RequestScheduler *request_scheduler;
+    std::mutex lock;
+    std::unordered_map<std::string, std::unique_ptr<Variant>> variants;
+    // Last so queued refreshes are cancelled before the variants go away
+    TaskGroup task_group;
+  };
+}
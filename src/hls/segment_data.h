@@ -16,14 +16,63 @@
  *
  */
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
 #include "HLS.h"
 
+// A whole number of 188 byte TS packets so packets don't straddle blocks
+const size_t SEGMENT_BLOCK_SIZE = 2048 * 188;
+
+// Segment bytes kept in fixed size blocks, a block never moves once it is
+// allocated so the reader can use the bytes in place while more are appended
+class SegmentContents {
+public:
+  SegmentContents() : size(0) {};
+  size_t length() const { return size; };
+  // Keeps the blocks for the next segment
+  void clear() { size = 0; };
+  void append(const uint8_t *data, size_t length) {
+    while(length > 0) {
+      size_t block_offset = size % SEGMENT_BLOCK_SIZE;
+      if (block_offset == 0 && size / SEGMENT_BLOCK_SIZE == blocks.size()) {
+        blocks.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[SEGMENT_BLOCK_SIZE]));
+      }
+      size_t to_copy = std::min(length, SEGMENT_BLOCK_SIZE - block_offset);
+      std::memcpy(blocks[size / SEGMENT_BLOCK_SIZE].get() + block_offset, data, to_copy);
+      size += to_copy;
+      data += to_copy;
+      length -= to_copy;
+    }
+  };
+  // Bytes at offset up to the end of its block or of the data, available
+  // is set to how many there are
+  const uint8_t *get(size_t offset, size_t &available) const {
+    size_t block_offset = offset % SEGMENT_BLOCK_SIZE;
+    available = std::min(size - offset, SEGMENT_BLOCK_SIZE - block_offset);
+    return blocks[offset / SEGMENT_BLOCK_SIZE].get() + block_offset;
+  };
+private:
+  std::vector<std::unique_ptr<uint8_t[]>> blocks;
+  size_t size;
+};
+
 struct SegmentData {
   SegmentData() : can_overwrite(true), finished(true) {};
   hls::Segment segment;
-  std::string contents;
+  SegmentContents contents;
   bool can_overwrite;
   bool finished;
   uint64_t start_offset;
 };
 
+// Where the stored segment bytes are read from in place
+class SegmentSource {
+public:
+  virtual ~SegmentSource() {};
+  // Points data at the bytes at pos, size is set to how many follow in one
+  // block, 0 when there are none yet
+  virtual hls::Segment view(uint64_t pos, size_t &size, const uint8_t *&data) = 0;
+};
@@ -48,6 +48,11 @@ DemuxContainer hls::Session::get_current_pkt() {
         m_startdts == DVD_NOPTS_VALUE && pkt->dts != DVD_NOPTS_VALUE) {
       double desired_pts = current_pkt.segment.time_in_playlist * DVD_TIME_BASE;
       double diff = pkt->pts - desired_pts;
+      if (seek_start_pts != DVD_NOPTS_VALUE) {
+        // Started at a keyframe inside the segment, not at its first packet
+        diff = seek_start_pts - desired_pts;
+        seek_start_pts = DVD_NOPTS_VALUE;
+      }
       m_startpts = diff;
       m_startdts = diff;
     }
@@ -65,35 +70,72 @@ DemuxContainer hls::Session::get_current_pkt() {
 
 void hls::Session::read_next_pkt() {
   if (active_stream) {
+    hls::Segment abandoned_segment;
+    if (!emergency_switch && active_stream->get_abandoned_segment(abandoned_segment)) {
+      fetch_abandoned_segment(abandoned_segment);
+    }
     current_pkt = active_stream->get_demux()->Read();
+    if (!current_pkt.demux_packet && future_stream) {
+      // The active stream ends at the switch point, everything before it
+      // has been read
+      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Switched stream at segment %d", last_switch_sequence);
+      active_stream.swap(future_stream);
+      future_stream.reset();
+      active_stream->set_critical(true);
+      update_refresh_priorities();
+      splicing = true;
+      splice_sequence_set = false;
+      spliced_streams.clear();
+      if (emergency_switch) {
+        // Part of the abandoned segment has been played already
+        splice_dts = last_dts;
+        emergency_switch = false;
+      }
+      current_pkt = active_stream->get_demux()->Read();
+    }
+    // Packets of disabled streams can be demuxed before they were disabled
+    while((splicing && skip_packet(current_pkt)) || (current_pkt.demux_packet &&
+        disabled_streams.count(current_pkt.demux_packet->iStreamId))) {
+      ipsh->FreeDemuxPacket(current_pkt.demux_packet);
+      current_pkt = active_stream->get_demux()->Read();
+    }
+    if (current_pkt.stalled) {
+      // Only count running dry once playback started, not the initial buffering
+      if (playing && !stalled) {
+        stalled = true;
+        ++stall_counter;
+        xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Stalled in segment %d", last_media_sequence);
+        switch_streams(last_media_sequence + 1);
+      }
+      return;
+    }
+    stalled = false;
+    if (current_pkt.demux_packet && current_pkt.segment.valid) {
+      playing = true;
+      if (!first_packet_read) {
+        first_packet_read = true;
+        xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Time to first packet: %lld ms",
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start_time).count()));
+      }
+      last_media_sequence = current_pkt.segment.media_sequence;
+      if (current_pkt.demux_packet->dts != DVD_NOPTS_VALUE) {
+        last_dts[current_pkt.demux_packet->iStreamId] = current_pkt.demux_packet->dts;
+      }
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (now - last_buffer_report >= std::chrono::milliseconds(BUFFER_REPORT_INTERVAL_MS)) {
+        last_buffer_report = now;
+        active_stream->report_playback_buffer(active_stream->get_buffered_time());
+      }
+    }
     if (current_pkt.segment_changed) {
-      // So we decide to switch in one segment, then the next segment we switch, this gives the demuxer
-      // one segment's worth of time to prepare packets
-        xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Changed to segment %d", current_pkt.segment.media_sequence);
-      if (switch_demux && future_stream) {
-        // Should only switch if future_demux is at the next segment we are looking for
-        if (future_stream->get_demux()->get_current_media_sequence() == current_pkt.segment.media_sequence) {
-          xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Switched stream at segment %d", current_pkt.segment.media_sequence);
-          active_stream.swap(future_stream);
-          delete future_stream.release();
-          ipsh->FreeDemuxPacket(current_pkt.demux_packet);
-          current_pkt = active_stream->get_demux()->Read();
-          switch_demux = false;
-
-          last_switch_sequence = current_pkt.segment.media_sequence;
-        } else {
-            xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Delaying stream switch at %d waiting for %d",
-                      current_pkt.segment.media_sequence, future_stream->get_demux()->get_current_media_sequence());
-            if (current_pkt.segment.media_sequence > future_stream->get_demux()->get_current_media_sequence()) {
-              xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Cancelling switch");
-              delete future_stream.release();
-            }
-            switch_streams(current_pkt.segment.media_sequence + 1);
-            switch_demux = !(future_stream == nullptr);
-        }
-      } else {
+      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Changed to segment %d", current_pkt.segment.media_sequence);
+      if (!future_stream && !catch_up_live()) {
         switch_streams(current_pkt.segment.media_sequence + 1);
-        switch_demux = !(future_stream == nullptr);
+      }
+      double latency = get_live_latency();
+      if (latency >= 0) {
+        xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%.3f seconds behind the live edge", latency);
       }
     }
   } else {
@@ -109,54 +151,174 @@ hls::MediaPlaylist hls::Session::download_playlist(std::string url) {
 }
 
 
+bool hls::Session::skip_packet(const DemuxContainer &container) {
+  DemuxPacket *packet = container.demux_packet;
+  if (!packet || container.stalled || packet->iStreamId == DMX_SPECIALID_STREAMCHANGE) {
+    return false;
+  }
+  if (!splice_sequence_set) {
+    splice_sequence = container.segment.media_sequence;
+    splice_sequence_set = true;
+  } else if (container.segment.media_sequence != splice_sequence) {
+    // Past the first segment of the new variant
+    splicing = false;
+    splice_dts.clear();
+    return false;
+  }
+  auto it = splice_dts.find(packet->iStreamId);
+  if (it != splice_dts.end() && packet->dts != DVD_NOPTS_VALUE && packet->dts <= it->second) {
+    // Played from the previous variant already
+    return true;
+  }
+  if (spliced_streams.find(packet->iStreamId) == spliced_streams.end()) {
+    if (!container.keyframe) {
+      // The decoder can't start on this frame
+      return true;
+    }
+    spliced_streams.insert(packet->iStreamId);
+  }
+  return false;
+}
+
+void hls::Session::set_fallback(StreamContainer *stream_container) {
+  if (manual_streams) {
+    return;
+  }
+  uint32_t bandwidth = stream_container->get_stream()->get_playlist().bandwidth;
+  uint32_t fallback_bandwidth = 0;
+  std::vector<std::vector<MediaPlaylist>::iterator> variants = get_variants();
+  for(auto it = variants.begin(); it != variants.end(); ++it) {
+    if ((*it)->bandwidth < bandwidth) {
+      fallback_bandwidth = (*it)->bandwidth;
+    }
+  }
+  stream_container->set_fallback_bandwidth(fallback_bandwidth);
+}
+
+void hls::Session::fetch_abandoned_segment(const Segment &segment) {
+  uint32_t bandwidth = active_stream->get_stream()->get_playlist().bandwidth;
+  std::vector<std::vector<MediaPlaylist>::iterator> variants = get_variants();
+  auto fallback = master_playlist.get_media_playlists().end();
+  for(auto it = variants.begin(); it != variants.end(); ++it) {
+    if ((*it)->bandwidth < bandwidth) {
+      fallback = *it;
+    }
+  }
+  if (fallback == master_playlist.get_media_playlists().end()) {
+    return;
+  }
+  xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Fetching abandoned segment %d from playlist %d %s",
+      segment.media_sequence, fallback->bandwidth, fallback->get_url().c_str());
+  load_refreshed_segments(*fallback);
+  future_stream = std::unique_ptr<StreamContainer>(new StreamContainer(*fallback,
+      request_scheduler.get(), worker_pool.get(), playlist_refresher.get(), &keyframe_index, switch_point_at(segment)));
+  // The active stream has stopped, the player is waiting on this one
+  future_stream->set_critical(true);
+  disable_streams(future_stream.get());
+  set_fallback(future_stream.get());
+  emergency_switch = true;
+  last_switch_sequence = segment.media_sequence;
+  update_refresh_priorities();
+}
+
+void hls::Session::load_refreshed_segments(MediaPlaylist &playlist) {
+  MediaPlaylist refreshed;
+  if (playlist_refresher->get_playlist(playlist.get_url(), refreshed)) {
+    // Recent enough to start downloading right away, the stream's own
+    // reloads pick up anything newer
+    playlist.live = refreshed.live;
+    playlist.get_segments() = refreshed.get_segments();
+  } else if (playlist.live) {
+    playlist.clear_segments();
+  }
+}
+
+void hls::Session::update_refresh_priorities() {
+  std::vector<std::string> active_urls;
+  std::vector<std::string> candidate_urls;
+  if (!active_stream) {
+    return;
+  }
+  MediaPlaylist &active_playlist = active_stream->get_stream()->get_playlist();
+  active_urls.push_back(active_playlist.get_url());
+  if (future_stream) {
+    active_urls.push_back(future_stream->get_stream()->get_playlist().get_url());
+  }
+  // The variants either side of the active one are where the next switch goes
+  std::vector<std::vector<MediaPlaylist>::iterator> variants = get_variants();
+  for(size_t i = 0; i < variants.size(); ++i) {
+    if (*variants.at(i) == active_playlist) {
+      if (i > 0) {
+        candidate_urls.push_back(variants.at(i - 1)->get_url());
+      }
+      if (i + 1 < variants.size()) {
+        candidate_urls.push_back(variants.at(i + 1)->get_url());
+      }
+    }
+  }
+  playlist_refresher->set_priorities(active_urls, candidate_urls);
+}
+
+std::vector<std::vector<hls::MediaPlaylist>::iterator> hls::Session::get_variants() {
+  std::vector<MediaPlaylist> &media_playlists = master_playlist.get_media_playlists();
+  std::vector<std::vector<MediaPlaylist>::iterator> variants;
+  // Same type as the playlist bandwidths, the settings aren't negative
+  uint32_t min_bps = static_cast<uint32_t>(std::max(min_bandwidth, 0));
+  uint32_t max_bps = static_cast<uint32_t>(std::max(max_bandwidth, 0));
+  for(auto it = media_playlists.begin(); it != media_playlists.end(); ++it) {
+    if (it->bandwidth >= min_bps && (it->bandwidth <= max_bps || max_bps == 0)) {
+      variants.push_back(it);
+    }
+  }
+  if (variants.empty()) {
+    for(auto it = media_playlists.begin(); it != media_playlists.end(); ++it) {
+      variants.push_back(it);
+    }
+  }
+  std::stable_sort(variants.begin(), variants.end(),
+      [](const std::vector<MediaPlaylist>::iterator &a, const std::vector<MediaPlaylist>::iterator &b) {
+    return a->bandwidth < b->bandwidth;
+  });
+  return variants;
+}
+
 // Switch streams up and down based on
 // 1. current bandwidth
-// 2. If we able to keep our buffer full in active_segment_controller
+// 2. how much media is buffered in segment storage and the demuxer
 // 3. If we stalled at all in get next segment
 void hls::Session::switch_streams(uint32_t media_sequence) {
-  if ((media_sequence != 0 && media_sequence < last_switch_sequence + SEGMENTS_BEFORE_SWITCH)) {
+  bool emergency = stall_counter > 0;
+  if (!emergency && media_sequence != 0 && media_sequence < last_switch_sequence + SEGMENTS_BEFORE_SWITCH) {
     // Skip stream switch if we are in the middle of one
     return;
   }
-  // Bits per second
-  uint32_t bandwith_of_current_stream = 0;
-  double average_bandwidth = downloader->get_average_bandwidth();
-  bool switch_up = true;
+  std::vector<MediaPlaylist> &media_playlists = master_playlist.get_media_playlists();
+  std::vector<std::vector<MediaPlaylist>::iterator> variants = get_variants();
+  std::vector<uint32_t> variant_bandwidths;
+  for(auto it = variants.begin(); it != variants.end(); ++it) {
+    variant_bandwidths.push_back((*it)->bandwidth);
+  }
+
+  AbrState state;
+  state.throughput = downloader->get_bandwidth_estimator().get_estimate();
+  state.stall_counter = stall_counter;
   if (active_stream) {
-    bandwith_of_current_stream = active_stream->get_stream()->get_playlist().bandwidth;
-    // TODO: Also update this to detect stalls in the demux waiting for packets
-    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Switch Stream stalls: %d buffer: %f bandwidth: %f media sequence: %d current: %d",
-        stall_counter, active_stream->get_demux()->get_percentage_packet_buffer_full(), average_bandwidth, media_sequence,
-        bandwith_of_current_stream);
-    if (average_bandwidth <= (bandwith_of_current_stream * .80)) {
-      switch_up = false;
-      bandwith_of_current_stream = 0;
+    MediaPlaylist &active_playlist = active_stream->get_stream()->get_playlist();
+    state.buffered_time = active_stream->get_buffered_time();
+    state.segment_duration = active_playlist.get_segment_target_duration();
+    for(size_t i = 0; i < variants.size(); ++i) {
+      if (*variants.at(i) == active_playlist) {
+        state.current_variant = i;
+      }
     }
   }
-  if (average_bandwidth < min_bandwidth) {
-    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Setting average bandwidth to %d", min_bandwidth);
-    average_bandwidth = min_bandwidth;
-  }
-  if (average_bandwidth > max_bandwidth && max_bandwidth != 0) {
-    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Setting average bandwidth to %d", max_bandwidth);
-    average_bandwidth = max_bandwidth;
-  }
-  std::vector<MediaPlaylist> &media_playlists = master_playlist.get_media_playlists();
   auto next_active_playlist = media_playlists.end();
-  for(auto it = media_playlists.begin(); it != media_playlists.end(); ++it) {
-    if (switch_up && it->bandwidth > bandwith_of_current_stream && it->bandwidth < average_bandwidth && it->bandwidth >= min_bandwidth &&
-         (it->bandwidth <= max_bandwidth || max_bandwidth == 0)) {
-       bandwith_of_current_stream = it->bandwidth;
-       next_active_playlist = it;
-       xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "(Up) Variant stream bandwidth: %d url: %s", it->bandwidth, it->get_url().c_str());
-    } else if (!switch_up && it->bandwidth >= bandwith_of_current_stream && it->bandwidth < average_bandwidth && it->bandwidth >= min_bandwidth &&
-        (it->bandwidth <= max_bandwidth || max_bandwidth == 0)) {
-      // Switch down
-       bandwith_of_current_stream = it->bandwidth;
-       next_active_playlist = it;
-       xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "(Down) Variant stream bandwidth: %d url: %s", it->bandwidth, it->get_url().c_str());
-    }
+  if (!variants.empty()) {
+    next_active_playlist = variants.at(abr_controller->select_variant(variant_bandwidths, state));
   }
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Switch Stream stalls: %d buffer: %f seconds bandwidth: %f media sequence: %d current: %d",
+      stall_counter, state.buffered_time, state.throughput, media_sequence, state.current_variant);
+  stall_counter = 0;
 
   if (active_stream && next_active_playlist != media_playlists.end() &&
       *next_active_playlist != active_stream->get_stream()->get_playlist() && !manual_streams) {
@@ -164,22 +326,44 @@ void hls::Session::switch_streams(uint32_t media_sequence) {
     if (future_stream && *next_active_playlist == future_stream->get_stream()->get_playlist()) {
       // Ignore switch to the current playlist
     } else {
-      if (next_active_playlist->live) {
-        next_active_playlist->clear_segments();
+      if (!future_stream) {
+        // Active stream finishes the segment it is on and the new variant
+        // picks up right after it, nothing is downloaded twice
+        Segment last_segment = active_stream->stop_downloading();
+        if (!last_segment.valid) {
+          xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "No segment to switch after yet");
+          return;
+        }
+        pending_switch_point = switch_point_after(last_segment);
       }
-      future_stream = std::unique_ptr<StreamContainer>(new StreamContainer(*next_active_playlist, downloader.get(), media_sequence));
+      load_refreshed_segments(*next_active_playlist);
+      future_stream = std::unique_ptr<StreamContainer>(new StreamContainer(*next_active_playlist,
+          request_scheduler.get(), worker_pool.get(), playlist_refresher.get(), &keyframe_index, pending_switch_point));
+      disable_streams(future_stream.get());
+      set_fallback(future_stream.get());
+      last_switch_sequence = pending_switch_point.media_sequence;
     }
   } else if (!active_stream) {
+    if (startup_prefetcher && startup_prefetcher->is_started()) {
+      // Its playlist and first segment are already on the way
+      for(auto it = variants.begin(); it != variants.end(); ++it) {
+        if ((*it)->get_url() == startup_prefetcher->get_playlist_url()) {
+          next_active_playlist = *it;
+        }
+      }
+    }
     if (next_active_playlist == media_playlists.end()) {
       next_active_playlist = media_playlists.begin();
     }
-    active_stream = std::unique_ptr<StreamContainer>(new StreamContainer(*next_active_playlist, downloader.get(), 0));
-  } else if (next_active_playlist != media_playlists.end() && *next_active_playlist == active_stream->get_stream()->get_playlist() && future_stream){
-      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Cancelling playlist switch because it is the current one");
-      delete future_stream.get();
+    active_stream = std::unique_ptr<StreamContainer>(new StreamContainer(*next_active_playlist,
+        request_scheduler.get(), worker_pool.get(), playlist_refresher.get(), &keyframe_index, start_options));
+    active_stream->set_critical(true);
+    disable_streams(active_stream.get());
+    set_fallback(active_stream.get());
   } else {
     xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Not switching playlist manual: %d, min: %d, max: %d", manual_streams, min_bandwidth, max_bandwidth);
   }
+  update_refresh_priorities();
 }
 
 INPUTSTREAM_IDS hls::Session::get_streams() {
@@ -202,6 +386,26 @@ INPUTSTREAM_INFO hls::Session::get_stream(uint32_t stream_id) {
   return INPUTSTREAM_INFO();
 }
 
+void hls::Session::enable_stream(uint32_t stream_id, bool enable) {
+  if (enable) {
+    disabled_streams.erase(stream_id);
+  } else {
+    disabled_streams.insert(stream_id);
+  }
+  if (active_stream) {
+    active_stream->get_demux()->EnableStream(stream_id, enable);
+  }
+  if (future_stream) {
+    future_stream->get_demux()->EnableStream(stream_id, enable);
+  }
+}
+
+void hls::Session::disable_streams(StreamContainer *stream_container) {
+  for(auto it = disabled_streams.begin(); it != disabled_streams.end(); ++it) {
+    stream_container->get_demux()->EnableStream(*it, false);
+  }
+}
+
 bool hls::Session::seek_time(double time, bool backwards, double *startpts) {
   if (active_stream) {
     // time is in MSEC
@@ -222,13 +426,39 @@ bool hls::Session::seek_time(double time, bool backwards, double *startpts) {
 
 
     hls::Segment seek_to = active_stream->get_stream()->find_segment_at_time(desired);
+    hls::MediaPlaylist &active_playlist = active_stream->get_stream()->get_updated_playlist();
+    bool at_live_edge = false;
+    if (active_playlist.live) {
+      StartOptions live_edge = start_options;
+      live_edge.live_edge = true;
+      std::list<Segment> segments(active_playlist.get_segments().begin(), active_playlist.get_segments().end());
+      auto live_start = find_start_segment(segments, true, active_playlist.get_segment_target_duration(),
+          active_playlist.start, live_edge);
+      if (live_start != segments.end() && seek_to.media_sequence > live_start->media_sequence) {
+        xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Seek is past the hold-back, going to the live edge");
+        seek_to = *live_start;
+        at_live_edge = true;
+      }
+    }
+    // A segment played before can be entered at a keyframe, otherwise
+    // the player decodes from the start of the segment up to the time
+    Keyframe start_keyframe;
     double new_time = seek_to.time_in_playlist;
+    seek_start_pts = DVD_NOPTS_VALUE;
+    if (!at_live_edge && keyframe_index.find(seek_to, desired - seek_to.time_in_playlist, backwards,
+        start_keyframe)) {
+      new_time += start_keyframe.time;
+      seek_start_pts = start_keyframe.pts - start_keyframe.time * DVD_TIME_BASE;
+    }
     xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "seek to %+6.3f", new_time);
 
-    hls::MediaPlaylist &active_playlist = active_stream->get_stream()->get_updated_playlist();
     xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Using playlist %s", active_playlist.get_url().c_str());
     active_stream = std::unique_ptr<StreamContainer>(
-        new StreamContainer(active_playlist, downloader.get(), seek_to.media_sequence));
+        new StreamContainer(active_playlist, request_scheduler.get(), worker_pool.get(),
+            playlist_refresher.get(), &keyframe_index, seek_to, start_keyframe));
+    active_stream->set_critical(true);
+    disable_streams(active_stream.get());
+    set_fallback(active_stream.get());
 
 
     if (current_pkt.demux_packet) {
@@ -240,32 +470,116 @@ bool hls::Session::seek_time(double time, bool backwards, double *startpts) {
 
     *startpts = (new_time * DVD_TIME_BASE);
 
+    // Playback has to buffer again after a seek
+    playing = false;
+    stalled = false;
+
     // Cancel any stream switches
-    switch_demux = false;
-    if (future_stream) {
-      delete future_stream.release();
-    }
+    emergency_switch = false;
+    splicing = false;
+    last_dts.clear();
+    splice_dts.clear();
+    spliced_streams.clear();
+    future_stream.reset();
+    update_refresh_priorities();
     return true;
   }
   return false;
 }
 
+bool hls::Session::is_live() {
+  return active_stream && !active_stream->get_stream()->empty() && active_stream->get_stream()->is_live();
+}
+
+double hls::Session::get_live_latency() {
+  if (!is_live() || !playing) {
+    return -1;
+  }
+  return latency_controller.get_latency();
+}
+
+bool hls::Session::catch_up_live() {
+  Stream *stream = active_stream->get_stream();
+  double live_edge = stream->get_live_edge_time();
+  if (live_edge <= 0 || !current_pkt.segment.valid) {
+    return false;
+  }
+  double latency = live_edge - get_current_time() / 1000.0;
+  uint32_t skip = latency_controller.update(latency, stream->get_hold_back(start_options),
+      current_pkt.segment.duration);
+  if (skip == 0) {
+    return false;
+  }
+  // The active stream finishes the segment it is downloading, the skip
+  // picks up skip segments after it
+  Segment last_segment = active_stream->stop_downloading();
+  if (!last_segment.valid) {
+    return false;
+  }
+  MediaPlaylist &playlist = stream->get_updated_playlist();
+  std::vector<Segment> &segments = playlist.get_segments();
+  // Right after the last segment when the playlist doesn't reach further
+  pending_switch_point = switch_point_after(last_segment);
+  auto skip_to = std::find_if(segments.begin(), segments.end(), [&](const Segment &segment) {
+    return segment.media_sequence == last_segment.media_sequence + 1 + skip;
+  });
+  if (skip_to == segments.end() && !segments.empty()) {
+    // Not listed yet, go as far as the playlist reaches
+    skip_to = segments.end() - 1;
+  }
+  if (skip_to != segments.end() && skip_to->media_sequence > last_segment.media_sequence) {
+    pending_switch_point = switch_point_at(*skip_to);
+  }
+  xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "%f seconds behind the live edge, skipping from segment %d to %d",
+      latency, last_segment.media_sequence, pending_switch_point.media_sequence);
+  future_stream = std::unique_ptr<StreamContainer>(new StreamContainer(playlist,
+      request_scheduler.get(), worker_pool.get(), playlist_refresher.get(), &keyframe_index, pending_switch_point));
+  disable_streams(future_stream.get());
+  set_fallback(future_stream.get());
+  last_switch_sequence = pending_switch_point.media_sequence;
+  update_refresh_priorities();
+  return true;
+}
+
 hls::Session::Session(MasterPlaylist master_playlist, Downloader *downloader,
-    int min_bandwidth, int max_bandwidth, bool manual_streams) :
+    int min_bandwidth, int max_bandwidth, bool manual_streams, StartupPrefetcher *startup_prefetcher,
+    double live_hold_back) :
     min_bandwidth(min_bandwidth),
     max_bandwidth(max_bandwidth),
     manual_streams(manual_streams),
     master_playlist(master_playlist),
+    startup_prefetcher(startup_prefetcher),
+    worker_pool(new WorkerPool()),
+    request_scheduler(new RequestScheduler(downloader)),
+    playlist_refresher(new PlaylistRefresher(request_scheduler.get(), worker_pool.get())),
     active_stream(nullptr),
     future_stream(nullptr),
     downloader(downloader),
-    switch_demux(false),
     m_startpts(DVD_NOPTS_VALUE),
     m_startdts(DVD_NOPTS_VALUE),
+    seek_start_pts(DVD_NOPTS_VALUE),
     last_total_time(0),
     last_current_time(0),
     last_switch_sequence(0),
-    stall_counter(0) {
+    last_media_sequence(0),
+    stall_counter(0),
+    stalled(false),
+    playing(false),
+    start_time(std::chrono::steady_clock::now()),
+    first_packet_read(false),
+    abr_controller(new BufferAbrController()),
+    emergency_switch(false),
+    splicing(false),
+    splice_sequence(0),
+    splice_sequence_set(false) {
+  start_options.hold_back = live_hold_back;
+  if (startup_prefetcher) {
+    request_scheduler->set_prefetch_store(startup_prefetcher->get_store());
+  }
+  std::vector<std::vector<MediaPlaylist>::iterator> variants = get_variants();
+  for(auto it = variants.begin(); it != variants.end(); ++it) {
+    playlist_refresher->add_variant((*it)->get_url());
+  }
   switch_streams(0);
 }
 
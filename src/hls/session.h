@@ -16,22 +16,34 @@
  *
  */
 
+#include <chrono>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <future>
 #include <thread>
 
 #include "HLS.h"
+#include "abr.h"
+#include "latency_controller.h"
+#include "playlist_refresher.h"
+#include "startup_prefetcher.h"
 #include "../downloader/downloader.h"
 #include "../demuxer/demux.h"
 #include "stream.h"
 
 namespace hls {
   const int SEGMENTS_BEFORE_SWITCH = 5;
+  // How often the playback buffer is passed on to the downloads
+  const int BUFFER_REPORT_INTERVAL_MS = 500;
 
   class Session {
   public:
-    Session(MasterPlaylist master_playlist, Downloader *downloader, int min_bandwidth, int max_bandwidth, bool manual_streams);
+    // The session starts on the variant startup_prefetcher has been downloading,
+    // live_hold_back overrides the seconds live playlists ask to stay behind
+    // the live edge when it isn't 0
+    Session(MasterPlaylist master_playlist, Downloader *downloader, int min_bandwidth, int max_bandwidth,
+        bool manual_streams, StartupPrefetcher *startup_prefetcher = nullptr, double live_hold_back = 0);
     virtual ~Session();
     Session(const Session& other) = delete;
     Session & operator= (const Session & other) = delete;
@@ -39,13 +51,25 @@ namespace hls {
 
     INPUTSTREAM_IDS get_streams();
     INPUTSTREAM_INFO get_stream(uint32_t stream_id);
+    // Kept for the streams of variants switched to later
+    void enable_stream(uint32_t stream_id, bool enable);
 
     DemuxContainer get_current_pkt();
     void read_next_pkt();
     uint64_t get_current_time();
+    // Seeks in a live stream don't go closer to the live edge than the hold-back.
+    // Inside a segment played before it goes to the keyframe before time,
+    // or after it when not backwards.
     bool seek_time(double time, bool backwards, double *startpts);
+    // Once the playlist has loaded
+    bool is_live();
+    // Seconds playback is behind the live edge, -1 when not playing live
+    double get_live_latency();
     void demux_abort();
     void demux_flush();
+    void set_abr_controller(AbrController *abr_controller) { this->abr_controller.reset(abr_controller); };
+    // When opening started, the time to the first packet is measured from it
+    void set_start_time(std::chrono::steady_clock::time_point start_time) { this->start_time = start_time; };
   protected:
     virtual MediaPlaylist download_playlist(std::string url);
     // Downloader has to be deleted last
@@ -54,24 +78,81 @@ namespace hls {
     int min_bandwidth;
     int max_bandwidth;
     bool manual_streams;
+    StartOptions start_options;
   private:
     void switch_streams(uint32_t media_sequence);
+    // Variants allowed by the bandwidth settings, lowest first
+    std::vector<std::vector<MediaPlaylist>::iterator> get_variants();
+    // Tells the stream which variant to fall back to if a download is too slow
+    void set_fallback(StreamContainer *stream_container);
+    // Passes the streams the player disabled to a new stream's demuxer
+    void disable_streams(StreamContainer *stream_container);
+    // Fetches a segment the active stream gave up on from the lower variant
+    void fetch_abandoned_segment(const Segment &segment);
+    // Skips the active stream ahead when it fell too far behind the live
+    // edge, true when a skip was planned
+    bool catch_up_live();
+    // Gives a variant we switch to the latest segments from the background refreshes
+    void load_refreshed_segments(MediaPlaylist &playlist);
+    void update_refresh_priorities();
+    // Packet the player already got from the variant we switched away from,
+    // or one before the first keyframe of the new variant
+    bool skip_packet(const DemuxContainer &container);
     uint32_t last_switch_sequence;
+    uint32_t last_media_sequence;
 
     uint32_t stall_counter;
+    // Demuxer ran out of packets and we are waiting on it
+    bool stalled;
+    // Received a packet since starting or seeking
+    bool playing;
+    std::chrono::steady_clock::time_point start_time;
+    bool first_packet_read;
+    std::unique_ptr<AbrController> abr_controller;
+    LatencyController latency_controller;
+    // future_stream replaces a segment the active stream abandoned, switch
+    // as soon as the active stream runs out
+    bool emergency_switch;
+    // Last dts handed out per stream id
+    std::unordered_map<int, double> last_dts;
+    // Packets up to these dts were played from the previous variant
+    std::unordered_map<int, double> splice_dts;
+    // Reading the first segment after a switch
+    bool splicing;
+    uint32_t splice_sequence;
+    bool splice_sequence_set;
+    // Streams that reached a keyframe since the switch
+    std::unordered_set<int> spliced_streams;
+    // Stream ids the player doesn't want packets of
+    std::unordered_set<uint16_t> disabled_streams;
+    // Where future_stream starts, kept when the planned variant changes
+    SwitchPoint pending_switch_point;
+    std::chrono::steady_clock::time_point last_buffer_report;
 
 
     MasterPlaylist master_playlist;
 
+    // Keyframes of the segments demuxed so far, outlives the streams
+    KeyframeIndex keyframe_index;
+    // Its downloads are handed to the first requests of the streams
+    std::unique_ptr<StartupPrefetcher> startup_prefetcher;
+    // Runs the downloads and demuxing of every stream, outlives them
+    std::unique_ptr<WorkerPool> worker_pool;
+    // Every request of the streams goes through it
+    std::unique_ptr<RequestScheduler> request_scheduler;
+    // Used by the streams, outlives them
+    std::unique_ptr<PlaylistRefresher> playlist_refresher;
     std::unique_ptr<StreamContainer> active_stream;
     // For when we want to switch streams
     std::unique_ptr<StreamContainer> future_stream;
-    bool switch_demux;
 
     DemuxContainer current_pkt;
 
     double m_startpts;          ///< start PTS for the program chain
     double m_startdts;          ///< start DTS for the program chain
+    // PTS the segment a seek went into starts at, when the seek went to a
+    // keyframe inside it
+    double seek_start_pts;
     uint64_t last_total_time;
     uint64_t last_current_time;
   };
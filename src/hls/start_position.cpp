@@ -0,0 +1,61 @@
+/*
+ * start_position.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "start_position.h"
+
+double hls::get_hold_back(const PlaylistStart &playlist_start, double target_duration,
+    const StartOptions &options) {
+  if (options.hold_back > 0) {
+    return options.hold_back;
+  }
+  if (playlist_start.hold_back > 0) {
+    return playlist_start.hold_back;
+  }
+  return DEFAULT_HOLD_BACK_TARGET_DURATIONS * target_duration;
+}
+
+// Segment that plays seconds from the start of the list
+static std::list<hls::Segment>::const_iterator segment_from_start(const std::list<hls::Segment> &segments,
+    double seconds) {
+  double time = 0;
+  for(auto it = segments.begin(); it != segments.end(); ++it) {
+    time += it->duration;
+    if (time > seconds) {
+      return it;
+    }
+  }
+  return --segments.end();
+}
+
+// Segment that plays seconds before the end of the list
+static std::list<hls::Segment>::const_iterator segment_from_end(const std::list<hls::Segment> &segments,
+    double seconds) {
+  double time = 0;
+  auto it = segments.end();
+  while(it != segments.begin()) {
+    --it;
+    time += it->duration;
+    if (time >= seconds) {
+      return it;
+    }
+  }
+  return segments.begin();
+}
+
+std::list<hls::Segment>::const_iterator hls::find_start_segment(const std::list<Segment> &segments, bool live,
+    double target_duration, const PlaylistStart &playlist_start, const StartOptions &options) {
+  if (segments.empty()) {
+    return segments.end();
+  }
+  if (playlist_start.has_time_offset && !options.live_edge) {
+    if (playlist_start.time_offset < 0) {
+      return segment_from_end(segments, -playlist_start.time_offset);
+    }
+    return segment_from_start(segments, playlist_start.time_offset);
+  }
+  if (live) {
+    return segment_from_end(segments, get_hold_back(playlist_start, target_duration, options));
+  }
+  return segments.begin();
+}
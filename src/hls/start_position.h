@@ -0,0 +1,46 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <list>
+
+#include "HLS.h"
+
+namespace hls {
+  // Hold-back of a live playlist that doesn't give one, in target durations
+  const double DEFAULT_HOLD_BACK_TARGET_DURATIONS = 3.0;
+
+  // How a stream that isn't a seek or a switch picks its first segment
+  struct StartOptions {
+    StartOptions() : live_edge(false), hold_back(0) {};
+    // Go to the live edge even when the playlist has an EXT-X-START
+    bool live_edge;
+    // Seconds behind the live edge, 0 for what the playlist asks for
+    double hold_back;
+  };
+
+  // Seconds from the end of a live playlist playback starts at
+  double get_hold_back(const PlaylistStart &playlist_start, double target_duration,
+      const StartOptions &options);
+
+  // Segment at EXT-X-START when the playlist has it, the one hold-back
+  // seconds before the end of a live playlist otherwise, or the first
+  // segment.  Starts at the segment containing the time, EXT-X-START PRECISE
+  // isn't honored.  Returns segments.end() when there are no segments.
+  std::list<Segment>::const_iterator find_start_segment(const std::list<Segment> &segments, bool live,
+      double target_duration, const PlaylistStart &playlist_start, const StartOptions &options);
+}
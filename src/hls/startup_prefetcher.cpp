@@ -0,0 +1,54 @@
+/*
+ * startup_prefetcher.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "../globals.h"
+#include "startup_prefetcher.h"
+
+#define LOGTAG                  "[StartupPrefetcher] "
+
+hls::StartupPrefetcher::StartupPrefetcher(Downloader *downloader, const StartOptions &start_options) :
+downloader(downloader),
+start_options(start_options) {
+}
+
+hls::StartupPrefetcher::~StartupPrefetcher() {
+  if (prefetch_thread.joinable()) {
+    prefetch_thread.join();
+  }
+}
+
+void hls::StartupPrefetcher::start(const std::string &playlist_url) {
+  if (is_started() || playlist_url.empty()) {
+    return;
+  }
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Prefetching %s", playlist_url.c_str());
+  this->playlist_url = playlist_url;
+  store.start(playlist_url);
+  prefetch_thread = std::thread(&StartupPrefetcher::prefetch, this);
+}
+
+void hls::StartupPrefetcher::prefetch() {
+  std::string contents = downloader->download(playlist_url);
+  MediaPlaylist playlist;
+  playlist.set_url(playlist_url);
+  playlist.load_contents(contents);
+  if (playlist.get_segments().empty()) {
+    store.finish(playlist_url, contents);
+    return;
+  }
+  std::list<Segment> segments(playlist.get_segments().begin(), playlist.get_segments().end());
+  Segment segment = *find_start_segment(segments, playlist.live, playlist.get_segment_target_duration(),
+      playlist.start, start_options);
+  // A byte range would download the whole file
+  if (segment.byte_offset != 0 || segment.byte_length != 0) {
+    store.finish(playlist_url, contents);
+    return;
+  }
+  // Marked before the playlist is handed out so the stream can't ask for
+  // the segment before it is known to be downloading
+  store.start(segment.get_url());
+  store.finish(playlist_url, contents);
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Prefetching segment %d", segment.media_sequence);
+  store.finish(segment.get_url(), downloader->download(segment.get_url()));
+}
@@ -0,0 +1,53 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string>
+#include <thread>
+
+#include "HLS.h"
+#include "start_position.h"
+#include "../downloader/downloader.h"
+#include "../downloader/prefetch_store.h"
+
+namespace hls {
+  // Gets the first variant playlist and its first segment downloading while
+  // the rest of the master playlist is still being read, the session picks
+  // them up through the request scheduler
+  class StartupPrefetcher {
+  public:
+    // start_options has to be the one the session starts its stream with
+    StartupPrefetcher(Downloader *downloader, const StartOptions &start_options = StartOptions());
+    ~StartupPrefetcher();
+    StartupPrefetcher(const StartupPrefetcher& other) = delete;
+    StartupPrefetcher & operator= (const StartupPrefetcher & other) = delete;
+    // Only the first call starts anything
+    void start(const std::string &playlist_url);
+    bool is_started() { return !playlist_url.empty(); };
+    // Variant the session should start on, empty when nothing was prefetched
+    std::string get_playlist_url() { return playlist_url; };
+    PrefetchStore *get_store() { return &store; };
+  private:
+    void prefetch();
+  private:
+    Downloader *downloader;
+    StartOptions start_options;
+    std::string playlist_url;
+    PrefetchStore store;
+    std::thread prefetch_thread;
+  };
+}
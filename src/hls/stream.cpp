@@ -9,21 +9,79 @@
 Stream::Stream(hls::MediaPlaylist &playlist, uint32_t media_sequence) :
 playlist(playlist),
 media_sequence(media_sequence),
+has_switch_point(false),
+has_start_options(false),
 segments(playlist.get_segments().begin(), playlist.get_segments().end()),
 live(playlist.live),
+playlist_start(playlist.start),
+target_duration(playlist.get_segment_target_duration()),
+last_growth_time(std::chrono::steady_clock::now()),
 download_itr(segments.end()),
 set_promise(false) {
   xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting stream", __FUNCTION__);
 }
 
+Stream::Stream(hls::MediaPlaylist &playlist, const hls::SwitchPoint &switch_point) :
+playlist(playlist),
+media_sequence(switch_point.media_sequence),
+has_switch_point(true),
+switch_point(switch_point),
+has_start_options(false),
+segments(playlist.get_segments().begin(), playlist.get_segments().end()),
+live(playlist.live),
+playlist_start(playlist.start),
+target_duration(playlist.get_segment_target_duration()),
+last_growth_time(std::chrono::steady_clock::now()),
+download_itr(segments.end()),
+set_promise(false) {
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting stream at switch point %d %f", __FUNCTION__,
+      switch_point.media_sequence, switch_point.time);
+}
+
+Stream::Stream(hls::MediaPlaylist &playlist, const hls::StartOptions &start_options) :
+playlist(playlist),
+media_sequence(0),
+has_switch_point(false),
+has_start_options(true),
+start_options(start_options),
+segments(playlist.get_segments().begin(), playlist.get_segments().end()),
+live(playlist.live),
+playlist_start(playlist.start),
+target_duration(playlist.get_segment_target_duration()),
+last_growth_time(std::chrono::steady_clock::now()),
+download_itr(segments.end()),
+set_promise(false) {
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting stream at the start of the playlist", __FUNCTION__);
+}
+
 Stream::~Stream() {
   xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Deconstruct stream", __FUNCTION__);
 }
 
-StreamContainer::StreamContainer(hls::MediaPlaylist &playlist, Downloader *downloader, uint32_t media_sequence) :
-stream(new Stream(playlist, media_sequence)),
-segment_storage(new SegmentStorage(downloader, stream.get())),
-demux(new Demux(segment_storage.get()))
+StreamContainer::StreamContainer(hls::MediaPlaylist &playlist, RequestScheduler *request_scheduler, WorkerPool *worker_pool,
+    hls::PlaylistRefresher *playlist_refresher, KeyframeIndex *keyframe_index, const hls::Segment &segment,
+    const Keyframe &start_keyframe) :
+stream(new Stream(playlist, segment.media_sequence)),
+segment_storage(new SegmentStorage(request_scheduler, stream.get(), worker_pool, playlist_refresher)),
+demux(new Demux(segment_storage.get(), worker_pool, keyframe_index, segment, start_keyframe))
+{
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting stream container", __FUNCTION__);
+}
+
+StreamContainer::StreamContainer(hls::MediaPlaylist &playlist, RequestScheduler *request_scheduler, WorkerPool *worker_pool,
+    hls::PlaylistRefresher *playlist_refresher, KeyframeIndex *keyframe_index, const hls::SwitchPoint &switch_point) :
+stream(new Stream(playlist, switch_point)),
+segment_storage(new SegmentStorage(request_scheduler, stream.get(), worker_pool, playlist_refresher)),
+demux(new Demux(segment_storage.get(), worker_pool, keyframe_index))
+{
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting stream container", __FUNCTION__);
+}
+
+StreamContainer::StreamContainer(hls::MediaPlaylist &playlist, RequestScheduler *request_scheduler, WorkerPool *worker_pool,
+    hls::PlaylistRefresher *playlist_refresher, KeyframeIndex *keyframe_index, const hls::StartOptions &start_options) :
+stream(new Stream(playlist, start_options)),
+segment_storage(new SegmentStorage(request_scheduler, stream.get(), worker_pool, playlist_refresher)),
+demux(new Demux(segment_storage.get(), worker_pool, keyframe_index))
 {
   xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting stream container", __FUNCTION__);
 }
@@ -55,6 +113,19 @@ bool Stream::has_download_item() {
 
 void Stream::reset_download_itr() {
   std::lock_guard<std::mutex> lock(data_mutex);
+  if (has_switch_point) {
+    // At the end for a live playlist that doesn't have the segment yet,
+    // merge picks up from the newly added segments
+    download_itr = hls::find_switch_segment(segments, switch_point, !live);
+    return;
+  }
+  if (has_start_options) {
+    download_itr = hls::find_start_segment(segments, live, target_duration, playlist_start, start_options);
+    if (download_itr != segments.end()) {
+      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting at segment %d", download_itr->media_sequence);
+    }
+    return;
+  }
   download_itr = std::find_if(segments.begin(), segments.end(), [&](hls::Segment segment) -> bool {
       return segment.media_sequence == media_sequence;
   });
@@ -98,12 +169,36 @@ hls::Segment Stream::find_segment_at_time(double time_in_seconds) {
 }
 
 
+double Stream::get_live_edge_time() {
+  std::lock_guard<std::mutex> lock(data_mutex);
+  if (!live || segments.empty()) {
+    return 0;
+  }
+  std::chrono::duration<double> since_growth = std::chrono::steady_clock::now() - last_growth_time;
+  // The next segment shows up about a target duration after the last one
+  double growth = std::min(since_growth.count(), target_duration);
+  return segments.back().time_in_playlist + segments.back().duration + growth;
+}
+
+double Stream::get_hold_back(const hls::StartOptions &options) {
+  std::lock_guard<std::mutex> lock(data_mutex);
+  return hls::get_hold_back(playlist_start, target_duration, options);
+}
+
+double Stream::get_target_duration() {
+  std::lock_guard<std::mutex> lock(data_mutex);
+  return target_duration;
+}
+
 void Stream::merge(hls::MediaPlaylist &other_playlist) {
   std::lock_guard<std::mutex> lock(data_mutex);
   live = other_playlist.live;
+  playlist_start = other_playlist.start;
+  target_duration = other_playlist.get_segment_target_duration();
   auto other_segments = other_playlist.get_segments();
   if (segments.empty()) {
     segments.insert(segments.end(), other_segments.begin(), other_segments.end());
+    last_growth_time = std::chrono::steady_clock::now();
   } else {
     bool reset = false;
     if (download_itr == segments.end()) {
@@ -126,8 +221,24 @@ void Stream::merge(hls::MediaPlaylist &other_playlist) {
          }
        }
     }
+    if (last_added_sequence) {
+      last_growth_time = std::chrono::steady_clock::now();
+    }
     if (reset) {
       ++download_itr;
+      if (has_switch_point) {
+        // The target's playlist can lag behind the one switched from, its
+        // new segments before the switch point have been played already
+        auto first_added = download_itr;
+        download_itr = hls::find_switch_segment(segments, switch_point, !live);
+        if (download_itr == segments.end()) {
+          download_itr = std::find_if(first_added, segments.cend(), [&](const hls::Segment &segment) -> bool {
+            return segment.discontinuity_sequence > switch_point.discontinuity_sequence ||
+                (segment.discontinuity_sequence == switch_point.discontinuity_sequence &&
+                segment.media_sequence > switch_point.media_sequence);
+          });
+        }
+      }
     }
     xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Added segment sequence %d", last_added_sequence);
     if (download_itr != segments.end()) {
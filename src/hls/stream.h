@@ -3,12 +3,15 @@
  * stream.h Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
  */
 
+#include <chrono>
 #include <list>
 #include <memory>
 
 #include "../globals.h"
-#include "../downloader/downloader.h"
+#include "../downloader/request_scheduler.h"
 #include "HLS.h"
+#include "start_position.h"
+#include "switch_planner.h"
 #include "../segment_storage.h"
 #include "../demuxer/demux.h"
 
@@ -19,6 +22,10 @@ const int SEGMENT_LIST_LIMIT = 3000;
 class Stream {
 public:
   Stream(hls::MediaPlaylist &playlist, uint32_t media_sequence);
+  // Starts at the segment of this variant that begins at the switch point
+  Stream(hls::MediaPlaylist &playlist, const hls::SwitchPoint &switch_point);
+  // Starts where the playlist says playback starts, see find_start_segment
+  Stream(hls::MediaPlaylist &playlist, const hls::StartOptions &start_options);
   Stream(const Stream& other) = delete;
   void operator=(const Stream& other) = delete;
   ~Stream();
@@ -41,11 +48,26 @@ public:
   void go_to_next_segment();
   uint64_t get_total_duration();
   hls::Segment find_segment_at_time(double time_in_seconds);
+  // Where the live edge is now on the segment timeline, the end of the
+  // last segment plus the time since the playlist last grew. 0 when the
+  // stream isn't live.
+  double get_live_edge_time();
+  // Seconds behind the live edge playback should stay
+  double get_hold_back(const hls::StartOptions &options);
+  double get_target_duration();
 private:
   hls::MediaPlaylist &playlist;
   uint32_t media_sequence;
+  bool has_switch_point;
+  hls::SwitchPoint switch_point;
+  bool has_start_options;
+  hls::StartOptions start_options;
   std::list<hls::Segment> segments;
   bool live;
+  // Of the latest playlist
+  hls::PlaylistStart playlist_start;
+  double target_duration;
+  std::chrono::steady_clock::time_point last_growth_time;
   std::list<hls::Segment>::const_iterator download_itr;
   std::mutex data_mutex;
   bool set_promise;
@@ -54,11 +76,26 @@ private:
 
 class StreamContainer {
 public:
-  StreamContainer(hls::MediaPlaylist &playlist, Downloader *downloader, uint32_t media_sequence);
+  // Starts at start_keyframe inside the segment, at its start when the
+  // keyframe's offset is 0
+  StreamContainer(hls::MediaPlaylist &playlist, RequestScheduler *request_scheduler, WorkerPool *worker_pool,
+      hls::PlaylistRefresher *playlist_refresher, KeyframeIndex *keyframe_index, const hls::Segment &segment,
+      const Keyframe &start_keyframe);
+  StreamContainer(hls::MediaPlaylist &playlist, RequestScheduler *request_scheduler, WorkerPool *worker_pool,
+      hls::PlaylistRefresher *playlist_refresher, KeyframeIndex *keyframe_index, const hls::SwitchPoint &switch_point);
+  StreamContainer(hls::MediaPlaylist &playlist, RequestScheduler *request_scheduler, WorkerPool *worker_pool,
+      hls::PlaylistRefresher *playlist_refresher, KeyframeIndex *keyframe_index, const hls::StartOptions &start_options);
   void operator=(const StreamContainer& other) = delete;
   StreamContainer(const StreamContainer& other) = delete;
   Demux *get_demux() { return demux.get(); };
   Stream *get_stream() { return stream.get(); };
+  // Seconds of media buffered ahead of the reader, call from the reading thread
+  double get_buffered_time() { return segment_storage->get_buffered_time() + demux->get_buffered_time(); };
+  void report_playback_buffer(double seconds) { segment_storage->report_playback_buffer(seconds); };
+  void set_fallback_bandwidth(uint32_t bandwidth) { segment_storage->set_fallback_bandwidth(bandwidth); };
+  bool get_abandoned_segment(hls::Segment &segment) { return segment_storage->get_abandoned_segment(segment); };
+  hls::Segment stop_downloading() { return segment_storage->stop_downloading(); };
+  void set_critical(bool critical) { segment_storage->set_critical(critical); };
 private:
   std::unique_ptr<Stream> stream;
   std::unique_ptr<SegmentStorage> segment_storage;
@@ -0,0 +1,50 @@
+/*
+ * switch_planner.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cmath>
+
+#include "switch_planner.h"
+
+hls::SwitchPoint hls::switch_point_at(const Segment &segment) {
+  SwitchPoint switch_point;
+  switch_point.media_sequence = segment.media_sequence;
+  switch_point.discontinuity_sequence = segment.discontinuity_sequence;
+  switch_point.time = segment.time_in_playlist;
+  return switch_point;
+}
+
+hls::SwitchPoint hls::switch_point_after(const Segment &segment) {
+  SwitchPoint switch_point = switch_point_at(segment);
+  ++switch_point.media_sequence;
+  switch_point.time += segment.duration;
+  return switch_point;
+}
+
+std::list<hls::Segment>::const_iterator hls::find_switch_segment(const std::list<Segment> &segments,
+    const SwitchPoint &switch_point, bool compare_times) {
+  auto by_sequence = segments.end();
+  for(auto it = segments.begin(); it != segments.end(); ++it) {
+    if (it->media_sequence == switch_point.media_sequence &&
+        it->discontinuity_sequence == switch_point.discontinuity_sequence) {
+      by_sequence = it;
+      break;
+    }
+  }
+  if (!compare_times) {
+    return by_sequence;
+  } else if (by_sequence != segments.end() &&
+      std::fabs(by_sequence->time_in_playlist - switch_point.time) <= SWITCH_TIME_TOLERANCE) {
+    return by_sequence;
+  }
+  // Sequence numbers don't line up, go by time
+  for(auto it = segments.begin(); it != segments.end(); ++it) {
+    if (it->discontinuity_sequence > switch_point.discontinuity_sequence) {
+      return it;
+    } else if (it->discontinuity_sequence == switch_point.discontinuity_sequence &&
+        it->time_in_playlist + SWITCH_TIME_TOLERANCE >= switch_point.time) {
+      return it;
+    }
+  }
+  return segments.end();
+}
@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <list>
+
+#include "HLS.h"
+
+namespace hls {
+  // Segment start times of different variants may differ by this much and
+  // still be the same boundary, EXTINF durations are rounded
+  const double SWITCH_TIME_TOLERANCE = 0.5;
+
+  // A segment boundary on the timeline all variants share
+  struct SwitchPoint {
+    SwitchPoint() : media_sequence(0), discontinuity_sequence(0), time(0) {};
+    // Media sequence of the segment that starts at the boundary
+    uint32_t media_sequence;
+    uint32_t discontinuity_sequence;
+    // Seconds, in terms of time_in_playlist
+    double time;
+  };
+
+  // Boundary at the start of segment
+  SwitchPoint switch_point_at(const Segment &segment);
+  // Boundary at the end of segment, where the next one starts
+  SwitchPoint switch_point_after(const Segment &segment);
+
+  // Finds the segment of another variant that starts at the switch point,
+  // the one with the same media and discontinuity sequence when its start
+  // time agrees, otherwise the first segment of the discontinuity that
+  // starts at or after the switch time.  Live variants only compare by
+  // sequence, their times count from when each playlist was first loaded.
+  // Returns segments.end() when the variant doesn't list the segment yet.
+  std::list<Segment>::const_iterator find_switch_segment(const std::list<Segment> &segments,
+      const SwitchPoint &switch_point, bool compare_times);
+}
@@ -9,6 +9,23 @@
 #include "globals.h"
 
 #include "kodi_hls.h"
+#ifdef HAVE_LIBCURL
+#include "downloader/curl_downloader.h"
+#endif
+
+Downloader *create_downloader(double bandwidth, bool native_downloader) {
+#ifdef HAVE_LIBCURL
+  if (native_downloader) {
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Using native libcurl downloader");
+    return new CurlDownloader(bandwidth);
+  }
+#else
+  if (native_downloader) {
+    xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Native downloader not available, using Kodi downloader");
+  }
+#endif
+  return new KodiDownloader(bandwidth);
+}
 
 bool download_playlist_impl(const char *url, hls::Playlist &playlist) {
   // open the file
@@ -46,12 +63,18 @@ hls::MediaPlaylist KodiSession::download_playlist(std::string url) {
 }
 
 KodiSession::~KodiSession() {
-  std::string fn(profile_path + "bandwidth.bin");
-  FILE* f = fopen(fn.c_str(), "wb");
-  if (f) {
-    double val(downloader->get_average_bandwidth());
-    fwrite((const char*)&val, sizeof(double), 1, f);
-    fclose(f);
+  BandwidthEstimator &estimator = downloader->get_bandwidth_estimator();
+  if (estimator.get_number_of_samples() == 0) {
+    // Nothing was measured, the estimate is still the one we started with
+    return;
+  }
+  std::string path(profile_path + THROUGHPUT_HISTORY_FILE);
+  std::string legacy_path(profile_path + LEGACY_BANDWIDTH_FILE);
+  ThroughputHistory history;
+  history.load(path, legacy_path);
+  history.add_sample(host, downloader->get_average_bandwidth(), estimator.get_latency(), std::time(nullptr));
+  if (history.save(path)) {
+    remove(legacy_path.c_str());
   }
 }
 
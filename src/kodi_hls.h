@@ -19,6 +19,13 @@
 #include "hls/HLS.h"
 #include "hls/session.h"
 #include "downloader/kodi_downloader.h"
+#include "downloader/throughput_history.h"
+#include "helpers.h"
+
+// In the profile folder
+const char THROUGHPUT_HISTORY_FILE[] = "throughput_history.txt";
+// Single bandwidth of the last session, replaced by the history
+const char LEGACY_BANDWIDTH_FILE[] = "bandwidth.bin";
 
 class KodiMasterPlaylist : public hls::MasterPlaylist {
   public:
@@ -26,16 +33,24 @@ class KodiMasterPlaylist : public hls::MasterPlaylist {
     void select_media_playlist();
 };
 
+// Native downloader is only available when built with libcurl
+Downloader *create_downloader(double bandwidth, bool native_downloader);
+
 class KodiSession : public hls::Session {
 public:
-  KodiSession(KodiMasterPlaylist master_playlist, double bandwidth, std::string profile_path,
-      int min_bandwidth, int max_bandwidth, bool manual_streams) :
-    hls::Session(master_playlist, new KodiDownloader(bandwidth), min_bandwidth, max_bandwidth, manual_streams),
-    profile_path(profile_path) { };
+  KodiSession(KodiMasterPlaylist master_playlist, Downloader *downloader, std::string profile_path,
+      int min_bandwidth, int max_bandwidth, bool manual_streams,
+      hls::StartupPrefetcher *startup_prefetcher = nullptr, double live_hold_back = 0) :
+    hls::Session(master_playlist, downloader, min_bandwidth, max_bandwidth, manual_streams,
+        startup_prefetcher, live_hold_back),
+    profile_path(profile_path),
+    host(get_url_host(master_playlist.get_url())) { };
   ~KodiSession();
 protected:
   hls::MediaPlaylist download_playlist(std::string url);
   std::string download_aes_key(std::string aes_uri);
 private:
   std::string profile_path;
+  // Of the master playlist, the history is kept by it
+  std::string host;
 };
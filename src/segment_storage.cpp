@@ -2,34 +2,49 @@
  * segment_storage.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
  */
 
+#include <algorithm>
 #include <cstring>
 
 #include "globals.h"
 #include "segment_storage.h"
 #include "downloader/file_downloader.h"
+#include "downloader/retry_download.h"
+#include "hls/abr.h"
 #include "hls/decrypter.h"
+#include "hls/playlist_refresher.h"
 #include "hls/stream.h"
 
 #define LOGTAG                  "[SegmentStorage] "
 
-SegmentStorage::SegmentStorage(Downloader *downloader, Stream *stream) :
+SegmentStorage::SegmentStorage(RequestScheduler *request_scheduler, Stream *stream, WorkerPool *worker_pool,
+    hls::PlaylistRefresher *playlist_refresher) :
 offset(0),
+read_position(0),
 read_segment_data_index(0),
 write_segment_data_index(0),
 segment_data(MAX_SEGMENTS),
 segment_locks(MAX_SEGMENTS),
-downloader(downloader),
-stream(stream),
 quit_processing(false),
-no_more_data(false) {
+no_more_data(false),
+request_scheduler(request_scheduler),
+stream(stream),
+playlist_refresher(playlist_refresher),
+started_download(false),
+task_group(worker_pool),
+download_task(&task_group, [this] { download_next_segment(); }),
+reload_task(&task_group, [this] { reload_next_playlist(); }),
+fallback_bandwidth(0),
+abandoned(false),
+stop_requested(false),
+critical(false),
+playback_buffer(-1) {
   xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Starting segment storage", __FUNCTION__);
-  download_thread = std::thread(&SegmentStorage::download_next_segment, this);
-  download_cv.notify_all();
-  reload_thread = std::thread(&SegmentStorage::reload_playlist_thread, this);
+  download_task.trigger();
+  reload_task.trigger_after(get_reload_interval());
 }
 
 bool SegmentStorage::can_download_segment() {
-  // Don't need to lock data_lock because it is locked by the download thread
+  // Don't need to lock data_lock because it is locked by the download task
   std::lock_guard<std::mutex> segment_lock(segment_locks.at(write_segment_data_index));
   SegmentData &current_segment_data = segment_data.at(write_segment_data_index);
   if (current_segment_data.can_overwrite == false) {
@@ -40,6 +55,9 @@ bool SegmentStorage::can_download_segment() {
 
 bool SegmentStorage::start_segment(hls::Segment segment) {
   std::lock_guard<std::mutex> lock(data_lock);
+  if (stop_requested) {
+    return false;
+  }
   std::lock_guard<std::mutex> segment_lock(segment_locks.at(write_segment_data_index));
   SegmentData &current_segment_data = segment_data.at(write_segment_data_index);
   if (current_segment_data.can_overwrite == false) {
@@ -56,18 +74,19 @@ bool SegmentStorage::start_segment(hls::Segment segment) {
   current_segment_data.contents.clear();
   current_segment_data.can_overwrite = false;
   current_segment_data.finished = false;
+  last_started_segment = segment;
   return true;
 }
 
-void SegmentStorage::write_segment(hls::Segment segment, std::string data) {
+void SegmentStorage::write_segment(const hls::Segment &segment, const uint8_t *data, size_t length) {
   std::lock_guard<std::mutex> lock(segment_locks.at(write_segment_data_index));
   if (segment_data.at(write_segment_data_index).segment == segment) {
-    segment_data.at(write_segment_data_index).contents += data;
+    segment_data.at(write_segment_data_index).contents.append(data, length);
     segment_data.at(write_segment_data_index).can_overwrite = false;
     // xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Wrote %d bytes, %d total bytes", __FUNCTION__, data.length(),
     //    segment_data.at(write_segment_data_index).contents.length());
-    data_cv.notify_all();
   }
+  notify_data();
 }
 
 void SegmentStorage::end_segment(hls::Segment segment) {
@@ -77,10 +96,27 @@ void SegmentStorage::end_segment(hls::Segment segment) {
     xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s End segment %d at %d with %d bytes", __FUNCTION__,
         segment.media_sequence, offset, segment_data.at(write_segment_data_index).contents.length());
     write_segment_data_index = (write_segment_data_index + 1) % MAX_SEGMENTS;
-    data_cv.notify_all();
+  }
+  notify_data();
+}
+
+void SegmentStorage::notify_data() {
+  std::lock_guard<std::mutex> lock(data_listener_lock);
+  if (data_listener) {
+    data_listener();
   }
 }
 
+void SegmentStorage::set_data_listener(std::function<void()> listener) {
+  std::lock_guard<std::mutex> lock(data_listener_lock);
+  data_listener = listener;
+}
+
+bool SegmentStorage::is_finished() {
+  std::lock_guard<std::mutex> lock(data_lock);
+  return quit_processing || no_more_data;
+}
+
 size_t SegmentStorage::get_size() {
   size_t size(0);
   for(size_t i = 0; i < segment_data.size(); ++i) {
@@ -96,110 +132,161 @@ bool SegmentStorage::has_data(uint64_t pos, size_t size) {
   return pos >= offset && ((pos - offset) + size) <= (get_size());
 }
 
-hls::Segment SegmentStorage::read(uint64_t pos, size_t &size, uint8_t * const destination, size_t min_read) {
-  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
-  size_t desired_size = size;
-  size_t data_read = 0;
-  hls::Segment segment = read_impl(pos, size, destination);
-  if (size >= min_read) {
-    return segment;
+double SegmentStorage::get_buffered_time() {
+  std::lock_guard<std::mutex> lock(data_lock);
+  double buffered_time = 0;
+  uint32_t current_read_segment_index = read_segment_data_index;
+  uint64_t segment_start = offset;
+  for(size_t i = 0; i < MAX_SEGMENTS; ++i) {
+    std::lock_guard<std::mutex> segment_lock(segment_locks.at(current_read_segment_index));
+    SegmentData &current_segment = segment_data.at(current_read_segment_index);
+    if (!current_segment.segment.valid) {
+      break;
+    }
+    size_t length = current_segment.contents.length();
+    uint64_t segment_end = segment_start + length;
+    if (current_segment.finished && length > 0 && segment_end > read_position) {
+      uint64_t unread = segment_end - std::max(read_position, segment_start);
+      buffered_time += current_segment.segment.duration * unread / length;
+    }
+    segment_start = segment_end;
+    current_read_segment_index = (current_read_segment_index + 1) % MAX_SEGMENTS;
   }
+  return buffered_time;
+}
+
+void SegmentStorage::report_playback_buffer(double seconds) {
+  std::lock_guard<std::mutex> lock(playback_buffer_lock);
+  playback_buffer = seconds;
+  playback_buffer_time = std::chrono::steady_clock::now();
+}
+
+bool SegmentStorage::get_abandoned_segment(hls::Segment &segment) {
+  if (!abandoned) {
+    return false;
+  }
+  segment = abandoned_segment;
+  return true;
+}
+
+hls::Segment SegmentStorage::stop_downloading() {
+  hls::Segment last_segment;
   {
     std::lock_guard<std::mutex> lock(data_lock);
-    if (size < min_read && no_more_data) {
-      return segment;
+    last_segment = last_started_segment;
+    if (last_segment.valid) {
+      stop_requested = true;
     }
   }
-  data_read += size;
-  // Size == 0
-  while(data_read < min_read) {
-    // xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Waiting for data to be downloaded, pos %d size %d bytes_read %d", __FUNCTION__,pos, size, bytes_read);
-    download_cv.notify_all();
-    std::unique_lock<std::mutex> lock(data_lock);
-    data_cv.wait_for(lock, std::chrono::milliseconds(500));
-    if (quit_processing || no_more_data) {
-      return segment;
-    }
-    lock.unlock();
-    size = desired_size - data_read;
-    segment = read_impl(pos + data_read, size, destination + data_read);
-    data_read += size;
-    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>( t2 - t1 ).count();
-    if (duration >= READ_TIMEOUT_MS) {
-        xbmc->Log(ADDON::LOG_ERROR, LOGTAG "%s Read timeout", __FUNCTION__);
-        break;
+  download_task.trigger();
+  return last_segment;
+}
+
+bool SegmentStorage::should_abandon(const hls::Segment &segment, double elapsed, uint64_t received) {
+  hls::DownloadProgress progress;
+  {
+    std::lock_guard<std::mutex> lock(playback_buffer_lock);
+    if (playback_buffer < 0) {
+      // Not playing yet, nothing to run dry
+      return false;
     }
+    std::chrono::duration<double> since_report = std::chrono::steady_clock::now() - playback_buffer_time;
+    progress.buffered_time = std::max(0.0, playback_buffer - since_report.count());
   }
-  size = data_read;
-  if (!segment.valid) {
-      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s segment is invalid", __FUNCTION__);
+  progress.elapsed = elapsed;
+  progress.received = received;
+  if (segment.byte_length) {
+    progress.expected = segment.byte_length;
+  } else {
+    progress.expected = stream->get_playlist().bandwidth * segment.duration / 8;
   }
-  return segment;
+  progress.fallback_size = fallback_bandwidth * segment.duration / 8;
+  return hls::should_abandon_download(progress);
 }
 
-hls::Segment SegmentStorage::read_impl(uint64_t pos, size_t &size, uint8_t * const destination) {
-  std::lock_guard<std::mutex> lock(data_lock);
-  uint64_t destination_offset = 0;
+const uint8_t *SegmentStorage::find_data(uint64_t &pos, size_t &size, hls::Segment &segment) {
   uint32_t current_read_segment_index = read_segment_data_index;
   uint64_t next_offset = offset;
-  hls::Segment first_segment;
-  uint64_t data_read = 0;
-  uint64_t wanted_data = size;
-  while(size > 0) {
-    uint64_t relative_offset;
-    if (pos >= next_offset) {
-      relative_offset = pos - next_offset;
-    } else {
-      relative_offset = 0; // start at beginning of segment
+  for(size_t i = 0; i < MAX_SEGMENTS; ++i) {
+    if (pos < next_offset) {
+      pos = next_offset; // start at beginning of segment
     }
+    uint64_t relative_offset = pos - next_offset;
     std::lock_guard<std::mutex> segment_lock(segment_locks.at(current_read_segment_index));
     SegmentData &current_segment = segment_data.at(current_read_segment_index);
     if (!current_segment.segment.valid) {
-      break;
+      return nullptr;
     }
-    bool go_to_next_segment = false;
     if (relative_offset < current_segment.contents.length()) {
-      if (!first_segment.valid) {
-        first_segment = current_segment.segment;
-      }
-      size_t data_left_in_segment = current_segment.contents.length() - relative_offset;
-      size_t data_to_read_from_segment;
-      if (data_left_in_segment < size) {
-        data_to_read_from_segment = data_left_in_segment;
-        next_offset += current_segment.contents.length();
-      } else {
-        data_to_read_from_segment = size;
-      }
-      std::memcpy(destination + destination_offset,
-          current_segment.contents.c_str() + relative_offset, data_to_read_from_segment);
-      destination_offset += data_to_read_from_segment;
-      size -= data_to_read_from_segment;
-      data_read += data_to_read_from_segment;
+      size_t available;
+      const uint8_t *data = current_segment.contents.get(relative_offset, available);
+      size = std::min(size, available);
+      segment = current_segment.segment;
+      return data;
     } else if (current_segment.finished) {
-      // We read all of the data in this segment so it is safe to overwrite
-      if (!current_segment.can_overwrite) {
-        // data_lock is locked up top
-        xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Triggering download", __FUNCTION__);
-        current_segment.can_overwrite = true;
-        download_cv.notify_all();
-      }
       next_offset += current_segment.contents.length();
     } else {
       // The segment we are reading from isn't finished so we cannot read anymore
-      break;
+      return nullptr;
     }
-    current_read_segment_index = (current_read_segment_index + 1)% MAX_SEGMENTS;
-    if (current_read_segment_index == read_segment_data_index) {
-      // We looped around
-      break;
+    current_read_segment_index = (current_read_segment_index + 1) % MAX_SEGMENTS;
+  }
+  return nullptr;
+}
+
+void SegmentStorage::release_before(uint64_t pos) {
+  uint32_t current_read_segment_index = read_segment_data_index;
+  uint64_t segment_start = offset;
+  for(size_t i = 0; i < MAX_SEGMENTS; ++i) {
+    std::lock_guard<std::mutex> segment_lock(segment_locks.at(current_read_segment_index));
+    SegmentData &current_segment = segment_data.at(current_read_segment_index);
+    if (!current_segment.segment.valid || !current_segment.finished) {
+      return;
+    }
+    uint64_t segment_end = segment_start + current_segment.contents.length();
+    if (segment_end > pos) {
+      return;
+    }
+    // Nothing reads this segment anymore so it is safe to overwrite
+    if (!current_segment.can_overwrite) {
+      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Triggering download", __FUNCTION__);
+      current_segment.can_overwrite = true;
+      download_task.trigger();
     }
+    segment_start = segment_end;
+    current_read_segment_index = (current_read_segment_index + 1) % MAX_SEGMENTS;
   }
-  if (data_read < wanted_data) {
-//    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Not enough data read pos: %d, data read %d data wanted %d", __FUNCTION__, pos, data_read, wanted_data);
-  } else {
-//    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s Read %d bytes at %d", __FUNCTION__, data_read, pos);
+}
+
+void SegmentStorage::release(uint64_t pos) {
+  std::lock_guard<std::mutex> lock(data_lock);
+  release_before(pos);
+}
+
+hls::Segment SegmentStorage::read(uint64_t pos, size_t &size, uint8_t * const destination) {
+  std::lock_guard<std::mutex> lock(data_lock);
+  release_before(pos);
+  hls::Segment first_segment;
+  uint64_t data_read = 0;
+  while(data_read < size) {
+    size_t data_to_read = size - data_read;
+    hls::Segment segment;
+    uint64_t read_pos = pos + data_read;
+    const uint8_t *data = find_data(read_pos, data_to_read, segment);
+    if (!data) {
+      break;
+    }
+    if (!first_segment.valid) {
+      first_segment = segment;
+      // Reading from before the stored data starts at the first segment
+      pos = read_pos;
+    }
+    // The blocks don't move and the writer only appends, the segment lock
+    // doesn't have to be held to copy
+    std::memcpy(destination + data_read, data, data_to_read);
+    data_read += data_to_read;
   }
+  read_position = std::max(read_position, pos + data_read);
   size = data_read;
   if (!first_segment.valid) {
       xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "%s First segment is invalid", __FUNCTION__);
@@ -207,125 +294,229 @@ hls::Segment SegmentStorage::read_impl(uint64_t pos, size_t &size, uint8_t * con
   return first_segment;
 }
 
-void reload_playlist(Stream *stream, Downloader  *downloader) {
+hls::Segment SegmentStorage::view(uint64_t pos, size_t &size, const uint8_t *&data) {
+  std::lock_guard<std::mutex> lock(data_lock);
+  hls::Segment segment;
+  data = find_data(pos, size, segment);
+  if (!data) {
+    size = 0;
+    return segment;
+  }
+  read_position = std::max(read_position, pos + size);
+  return segment;
+}
+
+// False when the reload came back without segments
+bool reload_playlist(Stream *stream, RequestScheduler *request_scheduler, hls::PlaylistRefresher *playlist_refresher,
+    RequestClass request_class) {
   xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Reloading playlist");
   if (stream->is_live() || stream->empty()) {
-     std::string playlist_contents = downloader->download(stream->get_playlist_url());
-     if (playlist_contents.empty()) {
-       std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+     // Shares the download with a background refresh of the same playlist
+     hls::MediaPlaylist new_media_playlist = playlist_refresher->refresh(stream->get_playlist_url(), request_class);
+     if (new_media_playlist.get_segments().empty()) {
+       return false;
      }
-     hls::MediaPlaylist new_media_playlist;
-     new_media_playlist.set_url(stream->get_playlist_url());
-     new_media_playlist.load_contents(playlist_contents);
+     // Get a connection to the segment host going while the segments are merged
+     request_scheduler->prewarm(new_media_playlist.get_segments().front().get_url());
      stream->merge(new_media_playlist);
   }
+  return true;
 }
 
 void SegmentStorage::download_next_segment() {
-  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting download of segments");
-  if (!stream->has_download_item()) {
-    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Have to reload playlist to get segment");
-    reload_playlist(stream, downloader);
-    stream->reset_download_itr();
+  if (!started_download) {
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting download of segments");
+    started_download = true;
     if (!stream->has_download_item()) {
-       xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Unable to find segment starting at beginning");
+      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Have to reload playlist to get segment");
+      reload_playlist(stream, request_scheduler, playlist_refresher, get_playlist_class());
+      stream->reset_download_itr();
+      if (!stream->has_download_item()) {
+         xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Unable to find segment starting at beginning");
+      }
     }
   }
 
-  while(!quit_processing) {
-    std::unique_lock<std::mutex> lock(data_lock);
-    download_cv.wait(lock, [&] {
-      return quit_processing || can_download_segment();
-    });
-
+  {
+    std::lock_guard<std::mutex> lock(data_lock);
     if (quit_processing || no_more_data) {
-      break;
+      return;
+    } else if (!stop_requested && !can_download_segment()) {
+      // Runs again once the reader frees up a segment
+      return;
     }
-    lock.unlock();
-
-    if (stream->has_download_item()) {
-      hls::Segment segment = stream->get_current_segment();
-      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting download of %d", segment.media_sequence);
-
-      DataHelper data_helper;
-      data_helper.aes_iv = segment.aes_iv;
-      data_helper.aes_uri = segment.aes_uri;
-      data_helper.encrypted = segment.encrypted;
-      data_helper.segment = segment;
-
-      bool continue_download = start_segment(segment);
-      if (!continue_download) {
-        xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Demuxer says not to download");
-        continue;
-      }
-      std::string url = segment.get_url();
-      if (url.find("http") != std::string::npos) {
-        downloader->download(url, segment.byte_offset, segment.byte_length,
-            [&](std::string data) -> bool {
-              this->process_data(data_helper, data);
-              if (data_lock.try_lock()) {
-                if (quit_processing) {
-                  data_lock.unlock();
-                  return false;
-                } else {
-                  data_lock.unlock();
-                }
-              }
-              return true;
+  }
+  if (stop_requested) {
+    stop_after_segment();
+    return;
+  }
+
+  if (stream->has_download_item()) {
+    hls::Segment segment = stream->get_current_segment();
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting download of %d", segment.media_sequence);
+
+    DataHelper data_helper;
+    data_helper.aes_iv = segment.aes_iv;
+    data_helper.aes_uri = segment.aes_uri;
+    data_helper.encrypted = segment.encrypted;
+    data_helper.segment = segment;
+
+    bool continue_download = start_segment(segment);
+    if (!continue_download && stop_requested) {
+      stop_after_segment();
+      return;
+    } else if (!continue_download) {
+      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Demuxer says not to download");
+      return;
+    }
+    std::string url = segment.get_url();
+    if (url.find("http") != std::string::npos) {
+      RetryPolicy retry_policy;
+      retry_policy.wait = [&](std::chrono::milliseconds delay) -> bool {
+        std::unique_lock<std::mutex> lock(data_lock);
+        return !download_cv.wait_for(lock, delay, [&] {
+          return quit_processing;
         });
-      } else {
-        FileDownloader file_downloader;
-        std::string contents = file_downloader.download(url);
-        this->process_data(data_helper, contents);
+      };
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      uint64_t received = 0;
+      bool abandon = false;
+      // Resumes where a dropped connection left off, appending to the same segment
+      ScheduledDownloader segment_downloader(request_scheduler,
+          critical ? RequestClass::SEGMENT : RequestClass::SWITCH_TARGET);
+      download_with_retry(&segment_downloader, url, segment.byte_offset, segment.byte_length,
+          [&](const uint8_t *data, size_t length) -> bool {
+            this->process_data(data_helper, data, length);
+            received += length;
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (should_abandon(segment, elapsed.count(), received)) {
+              abandon = true;
+              return false;
+            }
+            if (data_lock.try_lock()) {
+              if (quit_processing) {
+                data_lock.unlock();
+                return false;
+              } else {
+                data_lock.unlock();
+              }
+            }
+            return true;
+      }, retry_policy);
+      if (abandon) {
+        // The session fetches this segment from a lower variant, the reader
+        // gets what arrived and then sees the end of the data
+        xbmc->Log(ADDON::LOG_NOTICE, LOGTAG "Abandoned download of %d after %d bytes",
+            segment.media_sequence, (int) received);
+        abandoned_segment = segment;
+        abandoned = true;
+        {
+          std::lock_guard<std::mutex> lock(data_lock);
+          no_more_data = true;
+        }
+        notify_data();
+        return;
       }
-      end_segment(segment);
-      stream->go_to_next_segment();
-      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Finished download of %d", segment.media_sequence);
-    } else if (!stream->is_live()) {
-        no_more_data = true;
-        break;
+    } else {
+      FileDownloader file_downloader;
+      std::string contents = file_downloader.download(url);
+      this->process_data(data_helper, reinterpret_cast<const uint8_t*>(contents.data()),
+          contents.length());
+    }
+    end_segment(segment);
+    stream->go_to_next_segment();
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Finished download of %d", segment.media_sequence);
+    download_task.trigger();
+  } else if (!stream->is_live()) {
+    {
+      std::lock_guard<std::mutex> lock(data_lock);
+      no_more_data = true;
     }
+    notify_data();
   }
-  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Exiting download thread");
+  // A live stream runs again when a reload brings new segments
 }
 
-void SegmentStorage::reload_playlist_thread() {
-  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Starting reload of threads");
+void SegmentStorage::stop_after_segment() {
+  // The next variant takes over after the last segment
+  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Stopped after %d for a stream switch", last_started_segment.media_sequence);
+  {
+    std::lock_guard<std::mutex> lock(data_lock);
+    no_more_data = true;
+  }
+  notify_data();
+}
 
-  while(!quit_processing) {
-    double target_duration = stream->get_playlist().get_segment_target_duration() / 2.0;
-    target_duration = std::max(target_duration, 4.0);
-    std::unique_lock<std::mutex> lock(data_lock);
-    reload_cv.wait_for(lock, std::chrono::milliseconds((int) target_duration * 1000), [&] {
-      return quit_processing;
-    });
+RequestClass SegmentStorage::get_playlist_class() {
+  return critical ? RequestClass::ACTIVE_PLAYLIST : RequestClass::SWITCH_TARGET;
+}
 
-    if (quit_processing || !stream->is_live()) {
-      break;
+std::chrono::milliseconds SegmentStorage::get_reload_interval() {
+  double target_duration = stream->get_playlist().get_segment_target_duration() / 2.0;
+  target_duration = std::max(target_duration, 4.0);
+  return std::chrono::milliseconds((int) target_duration * 1000);
+}
+
+void SegmentStorage::reload_next_playlist() {
+  {
+    std::lock_guard<std::mutex> lock(data_lock);
+    if (quit_processing) {
+      return;
     }
-    lock.unlock();
-    reload_playlist(stream, downloader);
   }
-  xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Exiting reload thread");
+  if (!stream->is_live()) {
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Not live, stopping reloads");
+    return;
+  }
+  if (!reload_playlist(stream, request_scheduler, playlist_refresher, get_playlist_class())) {
+    // Tries again soon without holding a worker in the meantime
+    reload_task.trigger_after(std::chrono::milliseconds(1000));
+    return;
+  }
+  download_task.trigger();
+  reload_task.trigger_after(get_reload_interval());
 }
 
-void SegmentStorage::process_data(DataHelper &data_helper, std::string data) {
-  if (data_helper.encrypted) {
-    auto aes_key_it = aes_uri_to_key.find(data_helper.aes_uri);
-    std::string aes_key;
-    if (aes_key_it == aes_uri_to_key.end()) {
-      xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Getting AES Key from %s", data_helper.aes_uri.c_str());
-        aes_key = downloader->download(data_helper.aes_uri);
-        aes_uri_to_key.insert({data_helper.aes_uri, aes_key});
-    } else {
-        aes_key = aes_key_it->second;
+void SegmentStorage::decrypt_data(DataHelper &data_helper, const uint8_t *data, size_t length) {
+  auto aes_key_it = aes_uri_to_key.find(data_helper.aes_uri);
+  if (aes_key_it == aes_uri_to_key.end()) {
+    xbmc->Log(ADDON::LOG_DEBUG, LOGTAG "Getting AES Key from %s", data_helper.aes_uri.c_str());
+    aes_key_it = aes_uri_to_key.insert({data_helper.aes_uri, request_scheduler->download(RequestClass::KEY, data_helper.aes_uri)}).first;
+  }
+  if (data_helper.decrypted_data.size() < length) {
+    data_helper.decrypted_data.resize(length);
+  }
+  decrypt(aes_key_it->second, data_helper.aes_iv, data, length, data_helper.decrypted_data.data());
+  // CBC, the last encrypted block is the iv of the next chunk
+  data_helper.aes_iv = std::string(reinterpret_cast<const char*>(data + length - AES_BLOCK_SIZE), AES_BLOCK_SIZE);
+  write_segment(data_helper.segment, data_helper.decrypted_data.data(), length);
+}
+
+void SegmentStorage::process_data(DataHelper &data_helper, const uint8_t *data, size_t length) {
+  if (!data_helper.encrypted) {
+    write_segment(data_helper.segment, data, length);
+    return;
+  }
+  // Chunks from the network don't line up with AES blocks, hold on to the
+  // partial block until the rest of it arrives
+  std::string &remainder = data_helper.encrypted_remainder;
+  if (!remainder.empty()) {
+    size_t needed = std::min(AES_BLOCK_SIZE - remainder.length(), length);
+    remainder.append(reinterpret_cast<const char*>(data), needed);
+    data += needed;
+    length -= needed;
+    if (remainder.length() < AES_BLOCK_SIZE) {
+      return;
     }
-    std::string next_iv = data.substr(data.length() - 16);
-    data = decrypt(aes_key, data_helper.aes_iv, data);
-    // Prepare the iv for the next segment
-    data_helper.aes_iv = next_iv;
+    std::string block;
+    block.swap(remainder);
+    decrypt_data(data_helper, reinterpret_cast<const uint8_t*>(block.data()), block.length());
   }
-  write_segment(data_helper.segment, data);
+  size_t whole_blocks = length - (length % AES_BLOCK_SIZE);
+  if (whole_blocks) {
+    decrypt_data(data_helper, data, whole_blocks);
+  }
+  remainder.assign(reinterpret_cast<const char*>(data + whole_blocks), length - whole_blocks);
 }
 
 SegmentStorage::~SegmentStorage() {
@@ -335,9 +526,5 @@ SegmentStorage::~SegmentStorage() {
     quit_processing = true;
   }
   download_cv.notify_all();
-  data_cv.notify_all();
-  download_thread.join();
-  reload_thread.join();
+  task_group.cancel();
 }
-
-
@@ -21,61 +21,132 @@
 #include <thread>
 #include <vector>
 #include <atomic>
+#include <chrono>
 #include <mutex>
+#include <functional>
+#include "worker_pool.h"
 #include "hls/HLS.h"
 #include "hls/segment_data.h"
-#include "downloader/downloader.h"
+#include "downloader/request_scheduler.h"
 
 class Stream;
+namespace hls {
+  class PlaylistRefresher;
+}
 
-const size_t MAX_SEGMENTS = 2;
-const size_t READ_TIMEOUT_MS = 60000;
+// The segments being demuxed stay stored until they are done, one more can
+// be downloading
+const size_t MAX_SEGMENTS = 4;
+const size_t AES_BLOCK_SIZE = 16;
 
 struct DataHelper {
   std::string aes_uri;
   std::string aes_iv;
   bool encrypted;
   hls::Segment segment;
+  // Encrypted bytes that don't fill a whole AES block yet
+  std::string encrypted_remainder;
+  // Reused between chunks so decrypting doesn't allocate each time
+  std::vector<uint8_t> decrypted_data;
 };
 
 
-class SegmentStorage {
+class SegmentStorage : public SegmentSource {
 public:
-  SegmentStorage(Downloader *downloader, Stream *stream);
+  SegmentStorage(RequestScheduler *request_scheduler, Stream *stream, WorkerPool *worker_pool,
+      hls::PlaylistRefresher *playlist_refresher);
   ~SegmentStorage();
   bool has_data(uint64_t pos, size_t size);
-  hls::Segment read(uint64_t pos, size_t &size, uint8_t * const destination, size_t min_read);
+  // Doesn't wait for data, size is set to what was available.  The
+  // segments before pos can be overwritten afterwards.
+  hls::Segment read(uint64_t pos, size_t &size, uint8_t * const destination);
+  // Like read but points data at the stored bytes instead of copying them,
+  // size is set to how many follow in one block.  They stay valid until
+  // release is called with a position past the end of their segment.
+  hls::Segment view(uint64_t pos, size_t &size, const uint8_t *&data) override;
+  // Nothing before pos is read anymore, the finished segments that end by
+  // then make room for the next downloads
+  void release(uint64_t pos);
+  // Nothing more is going to be written
+  bool is_finished();
+  // Called from the download task whenever data arrives or the data ends
+  void set_data_listener(std::function<void()> listener);
+  // Seconds of media in finished segments that haven't been read yet
+  double get_buffered_time();
+  // Seconds of media the player has left, reported by the reading side so
+  // a download can tell whether it will finish in time
+  void report_playback_buffer(double seconds);
+  // Bandwidth of the variant to fall back to when a download is too slow,
+  // 0 when there is no lower variant
+  void set_fallback_bandwidth(uint32_t bandwidth) { fallback_bandwidth = bandwidth; };
+  // True once a segment download has been abandoned, nothing after it is
+  // downloaded
+  bool get_abandoned_segment(hls::Segment &segment);
+  // Finishes the segment being downloaded and ends the data after it, for
+  // switching to another variant at that boundary.  Returns the last
+  // segment that will be delivered, invalid when nothing was started yet
+  // in which case downloading carries on.
+  hls::Segment stop_downloading();
+  // Whether playback depends on these downloads now rather than after a
+  // switch, decides how the requests are scheduled
+  void set_critical(bool critical) { this->critical = critical; };
 public:
   // These three are all executed from another thread that stays the same
   bool start_segment(hls::Segment segment);
-  void write_segment(hls::Segment segment, std::string data);
+  void write_segment(const hls::Segment &segment, const uint8_t *data, size_t length);
   void end_segment(hls::Segment segment);
 private:
-  hls::Segment read_impl(uint64_t pos, size_t &size, uint8_t * const destination);
   size_t get_size();
+  // Call with data_lock held, pos moves up to the first stored byte when it
+  // is before it
+  const uint8_t *find_data(uint64_t &pos, size_t &size, hls::Segment &segment);
+  // Call with data_lock held
+  void release_before(uint64_t pos);
   bool can_download_segment();
   void download_next_segment();
-  void reload_playlist_thread();
-  void process_data(DataHelper &data_helper, std::string data);
+  void reload_next_playlist();
+  std::chrono::milliseconds get_reload_interval();
+  RequestClass get_playlist_class();
+  void notify_data();
+  void stop_after_segment();
+  void process_data(DataHelper &data_helper, const uint8_t *data, size_t length);
+  void decrypt_data(DataHelper &data_helper, const uint8_t *data, size_t length);
+  bool should_abandon(const hls::Segment &segment, double elapsed, uint64_t received);
 private:
   uint64_t offset;
+  // Furthest position read so far
+  uint64_t read_position;
   uint32_t read_segment_data_index;
   uint32_t write_segment_data_index;
   std::vector<SegmentData> segment_data;
   std::vector<std::mutex> segment_locks;
   bool quit_processing;
   bool no_more_data;
-  Downloader *downloader;
+  RequestScheduler *request_scheduler;
   Stream *stream;
+  hls::PlaylistRefresher *playlist_refresher;
 
   std::unordered_map<std::string, std::string> aes_uri_to_key;
 
-  // Download thread
-  std::condition_variable download_cv;
-  std::thread download_thread;
   std::mutex data_lock;
-  std::condition_variable data_cv;
+  // Cuts short the wait between download retries
+  std::condition_variable download_cv;
+  bool started_download;
+  std::mutex data_listener_lock;
+  std::function<void()> data_listener;
+
+  TaskGroup task_group;
+  SerialTask download_task;
+  SerialTask reload_task;
 
-  std::condition_variable reload_cv;
-  std::thread reload_thread;
+  std::atomic<uint32_t> fallback_bandwidth;
+  std::atomic<bool> abandoned;
+  hls::Segment abandoned_segment;
+  std::atomic<bool> stop_requested;
+  std::atomic<bool> critical;
+  hls::Segment last_started_segment;
+  std::mutex playback_buffer_lock;
+  // Negative until the player reports
+  double playback_buffer;
+  std::chrono::steady_clock::time_point playback_buffer_time;
 };
@@ -0,0 +1,242 @@
+/*
+ * worker_pool.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+
+#include "worker_pool.h"
+
+// Worker the current thread belongs to, if any
+static thread_local WorkerPool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+WorkerPool::WorkerPool(size_t worker_count) :
+queued(0),
+next_worker(0),
+quit(false) {
+  worker_count = std::max(worker_count, size_t(1));
+  for(size_t i = 0; i < worker_count; ++i) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+  for(size_t i = 0; i < worker_count; ++i) {
+    workers.at(i)->thread = std::thread(&WorkerPool::run_worker, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(pool_lock);
+    quit = true;
+  }
+  pool_cv.notify_all();
+  for(auto &worker : workers) {
+    worker->thread.join();
+  }
+}
+
+size_t WorkerPool::default_worker_count() {
+  return std::max(size_t(std::thread::hardware_concurrency()), MIN_WORKERS);
+}
+
+void WorkerPool::push_task(size_t index, std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(workers.at(index)->lock);
+    workers.at(index)->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(pool_lock);
+    ++queued;
+  }
+  pool_cv.notify_one();
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+  size_t index;
+  if (current_pool == this) {
+    index = current_worker;
+  } else {
+    std::lock_guard<std::mutex> lock(pool_lock);
+    index = next_worker;
+    next_worker = (next_worker + 1) % workers.size();
+  }
+  push_task(index, std::move(task));
+}
+
+void WorkerPool::submit_after(std::chrono::milliseconds delay, std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(pool_lock);
+    timers.insert({std::chrono::steady_clock::now() + delay, std::move(task)});
+  }
+  pool_cv.notify_one();
+}
+
+bool WorkerPool::pop_task(size_t index, std::function<void()> &task) {
+  {
+    // Newest first from our own queue, it is the most likely to be warm
+    Worker &worker = *workers.at(index);
+    std::lock_guard<std::mutex> lock(worker.lock);
+    if (!worker.tasks.empty()) {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      --queued;
+      return true;
+    }
+  }
+  for(size_t i = 1; i < workers.size(); ++i) {
+    // Oldest first from the others
+    Worker &victim = *workers.at((index + i) % workers.size());
+    std::lock_guard<std::mutex> lock(victim.lock);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --queued;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkerPool::run_worker(size_t index) {
+  current_pool = this;
+  current_worker = index;
+  while(true) {
+    std::function<void()> task;
+    if (pop_task(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(pool_lock);
+    if (quit) {
+      break;
+    }
+    if (!timers.empty() && timers.begin()->first <= std::chrono::steady_clock::now()) {
+      task = std::move(timers.begin()->second);
+      timers.erase(timers.begin());
+      lock.unlock();
+      task();
+      continue;
+    }
+    auto wake_up = [this] {
+      return quit || queued > 0;
+    };
+    if (timers.empty()) {
+      pool_cv.wait(lock, wake_up);
+    } else {
+      pool_cv.wait_until(lock, timers.begin()->first, wake_up);
+    }
+  }
+}
+
+TaskGroup::TaskGroup(WorkerPool *pool) :
+pool(pool),
+state(std::make_shared<State>()) {
+  state->running = 0;
+  state->cancelled = false;
+}
+
+TaskGroup::~TaskGroup() {
+  cancel();
+}
+
+std::function<void()> TaskGroup::wrap(std::function<void()> task) {
+  // Holds on to the state so tasks still queued after the group is gone
+  // find out they were cancelled
+  std::shared_ptr<State> state = this->state;
+  return [state, task] {
+    {
+      std::lock_guard<std::mutex> lock(state->lock);
+      if (state->cancelled) {
+        return;
+      }
+      ++state->running;
+    }
+    task();
+    {
+      std::lock_guard<std::mutex> lock(state->lock);
+      --state->running;
+    }
+    state->cv.notify_all();
+  };
+}
+
+void TaskGroup::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(state->lock);
+    if (state->cancelled) {
+      return;
+    }
+  }
+  pool->submit(wrap(std::move(task)));
+}
+
+void TaskGroup::submit_after(std::chrono::milliseconds delay, std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(state->lock);
+    if (state->cancelled) {
+      return;
+    }
+  }
+  pool->submit_after(delay, wrap(std::move(task)));
+}
+
+void TaskGroup::cancel() {
+  std::unique_lock<std::mutex> lock(state->lock);
+  state->cancelled = true;
+  state->cv.wait(lock, [this] {
+    return state->running == 0;
+  });
+}
+
+SerialTask::SerialTask(TaskGroup *group, std::function<void()> function) :
+group(group),
+function(function),
+queued(false),
+running(false),
+rerun(false) {
+}
+
+void SerialTask::trigger() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (running) {
+      rerun = true;
+      return;
+    } else if (queued) {
+      return;
+    }
+    queued = true;
+  }
+  group->submit([this] {
+    run();
+  });
+}
+
+void SerialTask::trigger_after(std::chrono::milliseconds delay) {
+  group->submit_after(delay, [this] {
+    trigger();
+  });
+}
+
+void SerialTask::run() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queued = false;
+    running = true;
+  }
+  function();
+  bool again;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+    again = rerun;
+    rerun = false;
+    if (again) {
+      queued = true;
+    }
+  }
+  if (again) {
+    group->submit([this] {
+      run();
+    });
+  }
+}
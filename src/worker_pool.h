@@ -0,0 +1,108 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Downloads block a worker for as long as they take, with an active and a
+// future stream each downloading and reloading there are four of them
+const size_t MIN_WORKERS = 4;
+
+// Fixed set of threads shared by every stream in a session.  Each worker
+// has its own queue, tasks submitted from a worker go on its queue and idle
+// workers steal from the others.
+class WorkerPool {
+public:
+  explicit WorkerPool(size_t worker_count = default_worker_count());
+  ~WorkerPool();
+  WorkerPool(const WorkerPool& other) = delete;
+  WorkerPool & operator= (const WorkerPool & other) = delete;
+  void submit(std::function<void()> task);
+  void submit_after(std::chrono::milliseconds delay, std::function<void()> task);
+  size_t get_worker_count() const { return workers.size(); };
+  static size_t default_worker_count();
+private:
+  struct Worker {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+    std::thread thread;
+  };
+  void run_worker(size_t index);
+  bool pop_task(size_t index, std::function<void()> &task);
+  void push_task(size_t index, std::function<void()> task);
+private:
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex pool_lock;
+  std::condition_variable pool_cv;
+  // Tasks waiting in the worker queues, only incremented with pool_lock held
+  std::atomic<size_t> queued;
+  std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers;
+  size_t next_worker;
+  bool quit;
+};
+
+// Tasks of one owner.  Cancelling drops the tasks that haven't started and
+// waits for the running ones, after that the owner can go away.
+class TaskGroup {
+public:
+  explicit TaskGroup(WorkerPool *pool);
+  ~TaskGroup();
+  TaskGroup(const TaskGroup& other) = delete;
+  TaskGroup & operator= (const TaskGroup & other) = delete;
+  void submit(std::function<void()> task);
+  void submit_after(std::chrono::milliseconds delay, std::function<void()> task);
+  void cancel();
+private:
+  struct State {
+    std::mutex lock;
+    std::condition_variable cv;
+    size_t running;
+    bool cancelled;
+  };
+  std::function<void()> wrap(std::function<void()> task);
+  WorkerPool *pool;
+  std::shared_ptr<State> state;
+};
+
+// Work that runs again whenever something changes, e.g. the next download.
+// Never runs twice at the same time, triggering it while it runs makes it
+// run once more afterwards.
+class SerialTask {
+public:
+  SerialTask(TaskGroup *group, std::function<void()> function);
+  SerialTask(const SerialTask& other) = delete;
+  SerialTask & operator= (const SerialTask & other) = delete;
+  void trigger();
+  void trigger_after(std::chrono::milliseconds delay);
+private:
+  void run();
+  TaskGroup *group;
+  std::function<void()> function;
+  std::mutex lock;
+  bool queued;
+  bool running;
+  bool rerun;
+};
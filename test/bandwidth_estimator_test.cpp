@@ -0,0 +1,136 @@
+/*
+ * bandwidth_estimator_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include <thread>
+
+#include "../src/downloader/bandwidth_estimator.h"
+
+TEST(BandwidthEstimatorTest, InitialBandwidth) {
+  BandwidthEstimator estimator(4000000);
+  EXPECT_EQ(4000000, estimator.get_estimate());
+  EXPECT_EQ(4000000, estimator.get_percentile(0.5));
+  EXPECT_EQ(0, estimator.get_number_of_samples());
+}
+
+TEST(BandwidthEstimatorTest, SteadyThroughput) {
+  BandwidthEstimator estimator(4000000);
+  for(int i = 0; i < 10; ++i) {
+    // 1 MBit/s
+    estimator.add_sample(125000, 1.0);
+  }
+  EXPECT_NEAR(1000000, estimator.get_fast_estimate(), 1);
+  EXPECT_NEAR(1000000, estimator.get_slow_estimate(), 1);
+  EXPECT_NEAR(1000000, estimator.get_estimate(), 1);
+  EXPECT_NEAR(1000000, estimator.get_percentile(0.5), 1);
+}
+
+TEST(BandwidthEstimatorTest, FollowsDropsQuickly) {
+  BandwidthEstimator estimator(0);
+  for(int i = 0; i < 20; ++i) {
+    estimator.add_sample(1250000, 1.0);
+  }
+  estimator.add_sample(125000, 1.0);
+  estimator.add_sample(125000, 1.0);
+  // The fast average reacts more than the slow one and the estimate uses it
+  EXPECT_LT(estimator.get_fast_estimate(), estimator.get_slow_estimate());
+  EXPECT_EQ(estimator.get_fast_estimate(), estimator.get_estimate());
+  EXPECT_LT(estimator.get_estimate(), 7000000);
+}
+
+TEST(BandwidthEstimatorTest, FollowsSpikesSlowly) {
+  BandwidthEstimator estimator(0);
+  for(int i = 0; i < 20; ++i) {
+    estimator.add_sample(125000, 1.0);
+  }
+  estimator.add_sample(1250000, 1.0);
+  EXPECT_EQ(estimator.get_slow_estimate(), estimator.get_estimate());
+  EXPECT_LT(estimator.get_estimate(), 2000000);
+}
+
+TEST(BandwidthEstimatorTest, PercentileWeightedByBytes) {
+  BandwidthEstimator estimator(0);
+  estimator.add_sample(1000, 1.0);
+  estimator.add_sample(100000, 1.0);
+  estimator.add_sample(1000, 1.0);
+  // Most of the bytes came at 800 KBit/s
+  EXPECT_EQ(800000, estimator.get_percentile(0.5));
+  EXPECT_EQ(8000, estimator.get_percentile(0.0));
+}
+
+TEST(BandwidthEstimatorTest, SlidingWindow) {
+  BandwidthEstimator estimator(0);
+  estimator.add_sample(125000, 1.0);
+  for(size_t i = 0; i < BANDWIDTH_WINDOW_SAMPLES; ++i) {
+    estimator.add_sample(250000, 1.0);
+  }
+  EXPECT_EQ(BANDWIDTH_WINDOW_SAMPLES, estimator.get_number_of_samples());
+  EXPECT_EQ(2000000, estimator.get_percentile(0.0));
+}
+
+TEST(BandwidthEstimatorTest, IgnoresEmptySamples) {
+  BandwidthEstimator estimator(4000000);
+  estimator.add_sample(0, 1.0);
+  estimator.add_sample(1000, 0);
+  EXPECT_EQ(0, estimator.get_number_of_samples());
+  EXPECT_EQ(4000000, estimator.get_estimate());
+}
+
+TEST(TransferTimerTest, TinyTransferIgnored) {
+  BandwidthEstimator estimator(4000000);
+  TransferTimer timer(estimator);
+  timer.on_chunk(BANDWIDTH_MIN_TRANSFER_BYTES - 1);
+  timer.resume();
+  timer.finish();
+  EXPECT_EQ(0, estimator.get_number_of_samples());
+}
+
+TEST(TransferTimerTest, SamplesLargeTransfer) {
+  BandwidthEstimator estimator(4000000);
+  TransferTimer timer(estimator);
+  for(int i = 0; i < 4; ++i) {
+    timer.on_chunk(BANDWIDTH_SAMPLE_BYTES / 2);
+    timer.resume();
+  }
+  EXPECT_EQ(2, estimator.get_number_of_samples());
+  timer.on_chunk(BANDWIDTH_MIN_TRANSFER_BYTES);
+  timer.resume();
+  timer.finish();
+  EXPECT_EQ(3, estimator.get_number_of_samples());
+}
+
+TEST(TransferTimerTest, ConsumerTimeNotCounted) {
+  BandwidthEstimator estimator(0);
+  TransferTimer timer(estimator);
+  timer.on_chunk(BANDWIDTH_SAMPLE_BYTES / 2);
+  // Consumer holds on to the data for a while
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  timer.resume();
+  timer.on_chunk(BANDWIDTH_SAMPLE_BYTES / 2);
+  timer.finish();
+  ASSERT_EQ(1, estimator.get_number_of_samples());
+  // 64 KB in well under 200ms
+  EXPECT_GT(estimator.get_estimate(), BANDWIDTH_SAMPLE_BYTES * 8 / 0.2);
+}
+
+TEST(BandwidthEstimatorTest, Latency) {
+  BandwidthEstimator estimator(0);
+  EXPECT_EQ(0, estimator.get_latency());
+  estimator.add_latency_sample(0.2);
+  estimator.add_latency_sample(0.2);
+  EXPECT_NEAR(0.2, estimator.get_latency(), 0.0001);
+}
+
+TEST(TransferTimerTest, FirstByteLatency) {
+  BandwidthEstimator estimator(0);
+  TransferTimer timer(estimator);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  timer.on_chunk(1000);
+  timer.resume();
+  timer.on_chunk(1000);
+  timer.finish();
+  EXPECT_GE(estimator.get_latency(), 0.05);
+  EXPECT_LT(estimator.get_latency(), 1.0);
+}
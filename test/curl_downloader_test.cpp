@@ -0,0 +1,126 @@
+/*
+ * curl_downloader_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "local_http_server.h"
+#include "../src/downloader/curl_downloader.h"
+
+class CurlDownloaderTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    for(size_t i = 0; i < 1024 * 1024; ++i) {
+      large_file += char('a' + i % 26);
+    }
+    server.add_file("/playlist.m3u8", "#EXTM3U\n#EXTINF:10,\nsegment.ts\n");
+    server.add_file("/large.ts", large_file);
+    downloader = new CurlDownloader(4000000);
+  }
+
+  virtual void TearDown() {
+    delete downloader;
+  }
+
+  std::string large_file;
+  LocalHttpServer server;
+  CurlDownloader *downloader;
+};
+
+TEST_F(CurlDownloaderTest, DownloadContents) {
+  EXPECT_EQ("#EXTM3U\n#EXTINF:10,\nsegment.ts\n", downloader->download(server.get_url("/playlist.m3u8")));
+  EXPECT_EQ(large_file, downloader->download(server.get_url("/large.ts")));
+}
+
+TEST_F(CurlDownloaderTest, MissingFile) {
+  EXPECT_EQ("", downloader->download(server.get_url("/missing.ts")));
+}
+
+TEST_F(CurlDownloaderTest, ReusesConnection) {
+  for(int i = 0; i < 5; ++i) {
+    EXPECT_EQ(large_file, downloader->download(server.get_url("/large.ts")));
+  }
+  EXPECT_EQ(5, server.get_request_count());
+  EXPECT_EQ(1, server.get_connection_count());
+}
+
+TEST_F(CurlDownloaderTest, ByteRange) {
+  std::string contents;
+  downloader->download(server.get_url("/large.ts"), 100, 50, [&](const uint8_t *data, size_t length) -> bool {
+    contents.append(reinterpret_cast<const char*>(data), length);
+    return true;
+  });
+  EXPECT_EQ(50u, contents.length());
+  EXPECT_EQ(large_file.substr(100, 50), contents);
+}
+
+TEST_F(CurlDownloaderTest, ByteRangeOfOneByte) {
+  std::string contents;
+  EXPECT_TRUE(downloader->download(server.get_url("/large.ts"), 2000, 1, [&](const uint8_t *data, size_t length) -> bool {
+    contents.append(reinterpret_cast<const char*>(data), length);
+    return true;
+  }));
+  EXPECT_EQ(large_file.substr(2000, 1), contents);
+}
+
+TEST_F(CurlDownloaderTest, OpenEndedRange) {
+  std::string contents;
+  EXPECT_TRUE(downloader->download(server.get_url("/large.ts"), 1000, 0, [&](const uint8_t *data, size_t length) -> bool {
+    contents.append(reinterpret_cast<const char*>(data), length);
+    return true;
+  }));
+  EXPECT_EQ(large_file.substr(1000), contents);
+}
+
+TEST_F(CurlDownloaderTest, CancelDownload) {
+  size_t received = 0;
+  EXPECT_FALSE(downloader->download(server.get_url("/large.ts"), 0, 0, [&](const uint8_t *data, size_t length) -> bool {
+    received += length;
+    return false;
+  }));
+  EXPECT_LT(received, large_file.length());
+  // Downloader is still usable afterwards
+  EXPECT_EQ(large_file, downloader->download(server.get_url("/large.ts")));
+}
+
+TEST_F(CurlDownloaderTest, ConcurrentDownloads) {
+  const int number_of_downloads = 8;
+  std::vector<std::string> results(number_of_downloads);
+  std::vector<std::thread> threads;
+  for(int i = 0; i < number_of_downloads; ++i) {
+    threads.push_back(std::thread([&, i] {
+      results[i] = downloader->download(server.get_url("/large.ts"));
+    }));
+  }
+  for(auto it = threads.begin(); it != threads.end(); ++it) {
+    it->join();
+  }
+  for(auto it = results.begin(); it != results.end(); ++it) {
+    EXPECT_EQ(large_file, *it);
+  }
+  EXPECT_LE(server.get_connection_count(), CURL_MAX_HOST_CONNECTIONS);
+}
+
+TEST_F(CurlDownloaderTest, PrewarmOpensConnection) {
+  downloader->prewarm(server.get_url("/large.ts"));
+  // Prewarming the same host twice doesn't open another connection
+  downloader->prewarm(server.get_url("/playlist.m3u8"));
+  for(int i = 0; i < 100 && server.get_request_count() == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(1, server.get_connection_count());
+  // Give the HEAD request time to return its connection to the pool
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(large_file, downloader->download(server.get_url("/large.ts")));
+  EXPECT_EQ(1, server.get_connection_count());
+}
+
+TEST_F(CurlDownloaderTest, BandwidthMeasured) {
+  downloader->download(server.get_url("/large.ts"));
+  EXPECT_GT(downloader->get_current_bandwidth(), 0);
+  EXPECT_NE(4000000, downloader->get_current_bandwidth());
+}
@@ -4,6 +4,7 @@
 
 #include <limits.h>
 #include <iostream>
+#include <vector>
 #include "gtest/gtest.h"
 #include "helpers.h"
 
@@ -49,4 +50,17 @@ TEST(DecrypterTest, DecryptPartial) {
   EXPECT_TRUE(decrypted_data == gold_decrypted_data.substr(128, 256));
 }
 
+TEST(DecrypterTest, DecryptIntoBuffer) {
+  std::string aes_key = load_file_contents("test/encrypted/aes_key");
+  std::string aes_iv = load_file_contents("test/encrypted/aes_iv");
+  std::string encrypted_data = load_file_contents("test/encrypted/D00000002.ts");
+  std::string gold_decrypted_data = load_file_contents("test/encrypted/D00000002-decrypted.ts");
+
+  std::vector<uint8_t> output(256);
+  const uint8_t *input = reinterpret_cast<const uint8_t*>(encrypted_data.data());
+  decrypt(aes_key, aes_iv, input, 128, output.data());
+  decrypt(aes_key, encrypted_data.substr(112, 16), input + 128, 128, output.data() + 128);
+  EXPECT_EQ(gold_decrypted_data.substr(0, 256), std::string(output.begin(), output.end()));
+}
+
 }
@@ -0,0 +1,209 @@
+/*
+ * bitstream_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../helpers.h"
+#include "../../src/demuxer/bitstream.h"
+
+namespace TSDemux {
+
+// The bit at a time reader CBitstream replaced, what it has to match
+class ReferenceBitstream {
+public:
+  ReferenceBitstream(uint8_t *data, size_t bits, bool doEP3) :
+    m_data(data), m_offset(doEP3 ? 16 : 0), m_len(bits), m_error(false), m_doEP3(doEP3) {}
+
+  void skipBits(unsigned int num) {
+    if (m_doEP3) {
+      while (num) {
+        unsigned int tmp = m_offset >> 3;
+        if (!(m_offset & 7) && (m_data[tmp--] == 3) && (m_data[tmp--] == 0) && (m_data[tmp] == 0))
+          m_offset += 8;
+        if (!(m_offset & 7) && (num >= 8)) {
+          m_offset += 8;
+          num -= 8;
+        } else if ((tmp = 8-(m_offset & 7)) <= num) {
+          m_offset += tmp;
+          num -= tmp;
+        } else {
+          m_offset += num;
+          num = 0;
+        }
+        if (m_offset >= m_len) {
+          m_error = true;
+          break;
+        }
+      }
+      return;
+    }
+    m_offset += num;
+  }
+
+  unsigned int readBits(int num) {
+    unsigned int r = 0;
+    while(num > 0) {
+      if (m_doEP3) {
+        size_t tmp = m_offset >> 3;
+        if (!(m_offset & 7) && (m_data[tmp--] == 3) && (m_data[tmp--] == 0) && (m_data[tmp] == 0))
+          m_offset += 8;
+      }
+      if(m_offset >= m_len) {
+        m_error = true;
+        return 0;
+      }
+      num--;
+      if(m_data[m_offset / 8] & (1 << (7 - (m_offset & 7))))
+        r |= 1u << num;
+      m_offset++;
+    }
+    return r;
+  }
+
+  unsigned int showBits(int num) {
+    unsigned int r = 0;
+    size_t offs = m_offset;
+    while(num > 0) {
+      if(offs >= m_len) {
+        m_error = true;
+        return 0;
+      }
+      num--;
+      if(m_data[offs / 8] & (1 << (7 - (offs & 7))))
+        r |= 1u << num;
+      offs++;
+    }
+    return r;
+  }
+
+  unsigned int readGolombUE(int maxbits = 32) {
+    int lzb = -1;
+    int bits = 0;
+    for(int b = 0; !b; lzb++, bits++) {
+      if (bits > maxbits)
+        return 0;
+      b = readBits(1);
+    }
+    return (1 << lzb) - 1 + readBits(lzb);
+  }
+
+  signed int readGolombSE() {
+    int v, pos;
+    v = readGolombUE();
+    if(v == 0)
+      return 0;
+    pos = (v & 1);
+    v = (v + 1) >> 1;
+    return pos ? v : -v;
+  }
+
+  bool isError() { return m_error; }
+
+private:
+  uint8_t *m_data;
+  size_t m_offset;
+  size_t m_len;
+  bool m_error;
+  bool m_doEP3;
+};
+
+// Runs the same reads through both readers, showBits only without EP3 as
+// the old one didn't skip the EP3 bytes for it
+static void expect_same_reads(std::vector<uint8_t> data, size_t bits, bool doEP3, unsigned int seed) {
+  // The old reader keeps looking for EP3 after the end, further with every
+  // skip
+  data.resize(data.size() + 512, 0xff);
+  CBitstream bs = doEP3 ? CBitstream(data.data(), bits, true) : CBitstream(data.data(), bits);
+  ReferenceBitstream reference(data.data(), bits, doEP3);
+  srand(seed);
+  for(int op = 0; op < 200; ++op) {
+    int num;
+    switch(rand() % 6) {
+    case 0:
+      num = rand() % 33;
+      ASSERT_EQ(reference.readBits(num), bs.readBits(num)) << "readBits " << num << " op " << op;
+      break;
+    case 1:
+      ASSERT_EQ(reference.readBits(1), bs.readBits1()) << "readBits1 op " << op;
+      break;
+    case 2:
+      num = rand() % 80;
+      reference.skipBits(num);
+      bs.skipBits(num);
+      break;
+    case 3:
+      num = rand() % 33;
+      if (!doEP3) {
+        ASSERT_EQ(reference.showBits(num), bs.showBits(num)) << "showBits " << num << " op " << op;
+      }
+      break;
+    case 4:
+      num = rand() % 32;
+      ASSERT_EQ(reference.readGolombUE(num), bs.readGolombUE(num)) << "readGolombUE " << num << " op " << op;
+      break;
+    case 5:
+      ASSERT_EQ(reference.readGolombSE(), bs.readGolombSE()) << "readGolombSE op " << op;
+      break;
+    }
+    ASSERT_EQ(reference.isError(), bs.isError()) << "op " << op;
+  }
+}
+
+// Random bytes with emulation prevention and start code like runs in them,
+// never enough zeros in a row for a 32 bit Exp-Golomb code
+static std::vector<uint8_t> random_data(size_t length) {
+  std::vector<uint8_t> data;
+  while(data.size() < length) {
+    switch(rand() % 8) {
+    case 0:
+      data.push_back(0);
+      data.push_back(0);
+      data.push_back(3);
+      data.push_back(1 + rand() % 4);
+      break;
+    case 1:
+      data.push_back(0);
+      data.push_back(0);
+      data.push_back(1 + rand() % 255);
+      break;
+    case 2:
+      data.push_back(3);
+      break;
+    default:
+      data.push_back(1 + rand() % 255);
+      break;
+    }
+  }
+  data.resize(length);
+  return data;
+}
+
+TEST(BitstreamTest, MatchesReferenceReader) {
+  for(unsigned int seed = 0; seed < 2000; ++seed) {
+    srand(seed);
+    size_t length = rand() % 48;
+    std::vector<uint8_t> data = random_data(length);
+    size_t bits = length * 8;
+    expect_same_reads(data, bits, false, seed);
+    expect_same_reads(data, bits, true, seed);
+    if (bits > 0) {
+      expect_same_reads(data, bits - 1 - seed % 7, false, seed);
+    }
+  }
+}
+
+TEST(BitstreamTest, MatchesReferenceReaderOnVideo) {
+  std::string video = load_file_contents("test/encrypted/video.h264");
+  ASSERT_LT(4096u, video.length());
+  for(size_t start = 0; start < 4096; start += 61) {
+    std::vector<uint8_t> data(video.begin() + start, video.begin() + start + 64);
+    expect_same_reads(data, data.size() * 8, false, start);
+    expect_same_reads(data, data.size() * 8, true, start);
+  }
+}
+
+}
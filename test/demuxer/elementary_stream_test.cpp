@@ -0,0 +1,146 @@
+/*
+ * elementary_stream_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "../../src/demuxer/elementaryStream.h"
+
+namespace TSDemux {
+
+class TestStream : public ElementaryStream {
+public:
+  TestStream(size_t alloc_init) : ElementaryStream(0x100) {
+    es_alloc_init = alloc_init;
+  }
+  void consume(size_t len) {
+    es_consumed += len;
+    es_parsed = es_consumed;
+  }
+  std::string unconsumed() {
+    return std::string(reinterpret_cast<char*>(es_buf) + es_consumed, es_len - es_consumed);
+  }
+  const unsigned char* buffer() { return es_buf; }
+  size_t alloc() { return es_alloc; }
+  size_t consumed() { return es_consumed; }
+  size_t pts_pointer() { return es_pts_pointer; }
+};
+
+// Packets in std::strings
+class TestAllocator : public PacketAllocator {
+public:
+  TestAllocator() : freed(0) {};
+  unsigned char* AllocatePacket(size_t size, void** handle) {
+    std::string *packet = new std::string(size, '\0');
+    *handle = packet;
+    return reinterpret_cast<unsigned char*>(&(*packet)[0]);
+  }
+  void FreePacket(void* handle) {
+    delete static_cast<std::string*>(handle);
+    ++freed;
+  }
+  int freed;
+};
+
+static int append(TestStream &stream, const std::string &data, bool new_pts = false) {
+  return stream.Append(reinterpret_cast<const unsigned char*>(data.data()), data.length(), new_pts);
+}
+
+TEST(ElementaryStreamTest, MovesDataOnlyWhenFull) {
+  TestStream stream(100);
+  ASSERT_EQ(0, append(stream, std::string(40, 'a')));
+  stream.consume(30);
+  ASSERT_EQ(0, append(stream, std::string(40, 'b'), true));
+  // Room after the data, nothing moved
+  EXPECT_EQ(30u, stream.consumed());
+  EXPECT_EQ(40u, stream.pts_pointer());
+  EXPECT_EQ(std::string(10, 'a') + std::string(40, 'b'), stream.unconsumed());
+
+  // The buffer can come from the pool and be larger than asked for
+  size_t alloc = stream.alloc();
+  stream.consume(20);
+  ASSERT_EQ(0, append(stream, std::string(alloc - 79, 'c')));
+  EXPECT_EQ(alloc, stream.alloc());
+  EXPECT_EQ(0u, stream.consumed());
+  EXPECT_EQ(0u, stream.pts_pointer());
+  EXPECT_EQ(std::string(30, 'b') + std::string(alloc - 79, 'c'), stream.unconsumed());
+}
+
+TEST(ElementaryStreamTest, StartsAtFrontWhenAllConsumed) {
+  TestStream stream(100);
+  ASSERT_EQ(0, append(stream, std::string(40, 'a')));
+  stream.consume(40);
+  ASSERT_EQ(0, append(stream, std::string(10, 'b')));
+  EXPECT_EQ(0u, stream.consumed());
+  EXPECT_EQ(std::string(10, 'b'), stream.unconsumed());
+}
+
+TEST(ElementaryStreamTest, ReusesBuffers) {
+  const unsigned char *buffer;
+  {
+    TestStream stream(123457);
+    ASSERT_EQ(0, append(stream, "data"));
+    buffer = stream.buffer();
+  }
+  TestStream stream(123457);
+  ASSERT_EQ(0, append(stream, "data"));
+  EXPECT_EQ(buffer, stream.buffer());
+  stream.Reset();
+  ASSERT_EQ(0, append(stream, "more"));
+  EXPECT_EQ(buffer, stream.buffer());
+}
+
+TEST(ElementaryStreamTest, PutsPESTogetherInPacket) {
+  TestAllocator allocator;
+  TestStream stream(100);
+  stream.pes_packets = true;
+  stream.StartPESPacket(&allocator, 10);
+  ASSERT_EQ(0, append(stream, "abcd", true));
+  ASSERT_EQ(0, append(stream, "efghij"));
+  EXPECT_EQ(nullptr, stream.buffer());
+
+  STREAM_PKT pkt;
+  ASSERT_TRUE(stream.GetStreamPacket(&pkt));
+  ASSERT_NE(nullptr, pkt.handle);
+  std::string *packet = static_cast<std::string*>(pkt.handle);
+  EXPECT_EQ(pkt.data, reinterpret_cast<const unsigned char*>(packet->data()));
+  EXPECT_EQ(10u, pkt.size);
+  EXPECT_EQ("abcdefghij", *packet);
+  EXPECT_FALSE(stream.GetStreamPacket(&pkt));
+  allocator.FreePacket(packet);
+}
+
+TEST(ElementaryStreamTest, LongerPESGoesThroughBuffer) {
+  TestAllocator allocator;
+  TestStream stream(100);
+  stream.pes_packets = true;
+  stream.StartPESPacket(&allocator, 6);
+  ASSERT_EQ(0, append(stream, "abcd", true));
+  ASSERT_EQ(0, append(stream, "efgh"));
+  EXPECT_EQ(1, allocator.freed);
+
+  STREAM_PKT pkt;
+  ASSERT_TRUE(stream.GetStreamPacket(&pkt));
+  EXPECT_EQ(nullptr, pkt.handle);
+  EXPECT_EQ("abcdefgh", std::string(reinterpret_cast<const char*>(pkt.data), pkt.size));
+}
+
+TEST(ElementaryStreamTest, FreesUnfinishedPESPacket) {
+  TestAllocator allocator;
+  {
+    TestStream stream(100);
+    stream.pes_packets = true;
+    stream.StartPESPacket(&allocator, 10);
+    ASSERT_EQ(0, append(stream, "abcd", true));
+    stream.StartPESPacket(&allocator, 10);
+    EXPECT_EQ(1, allocator.freed);
+    stream.Reset();
+    EXPECT_EQ(2, allocator.freed);
+    stream.StartPESPacket(&allocator, 10);
+  }
+  EXPECT_EQ(3, allocator.freed);
+}
+
+}
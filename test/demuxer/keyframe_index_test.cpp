@@ -0,0 +1,82 @@
+/*
+ * keyframe_index_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "../../src/globals.h"
+#include "../../src/demuxer/keyframe_index.h"
+
+static hls::Segment create_segment(uint32_t media_sequence) {
+  hls::Segment segment;
+  segment.set_url("segment" + std::to_string(media_sequence) + ".ts");
+  segment.media_sequence = media_sequence;
+  return segment;
+}
+
+class KeyframeIndexTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    segment = create_segment(1);
+    // Keyframes every 2 seconds, the segment starts at 10 seconds with one
+    index.set_start_pts(segment, 10 * DVD_TIME_BASE);
+    for(int i = 1; i < 3; ++i) {
+      index.add_keyframe(segment, 376 + i * 100000, (10 + 2 * i) * DVD_TIME_BASE);
+    }
+  }
+
+  KeyframeIndex index;
+  hls::Segment segment;
+};
+
+TEST_F(KeyframeIndexTest, FindsKeyframeBefore) {
+  Keyframe keyframe;
+  ASSERT_TRUE(index.find(segment, 3.5, true, keyframe));
+  EXPECT_EQ(100376u, keyframe.offset);
+  EXPECT_DOUBLE_EQ(2, keyframe.time);
+  EXPECT_DOUBLE_EQ(12 * DVD_TIME_BASE, keyframe.pts);
+  ASSERT_TRUE(index.find(segment, 4, true, keyframe));
+  EXPECT_EQ(200376u, keyframe.offset);
+}
+
+TEST_F(KeyframeIndexTest, FindsKeyframeAfter) {
+  Keyframe keyframe;
+  ASSERT_TRUE(index.find(segment, 0.5, false, keyframe));
+  EXPECT_EQ(100376u, keyframe.offset);
+  ASSERT_TRUE(index.find(segment, 2, false, keyframe));
+  EXPECT_EQ(100376u, keyframe.offset);
+  // Nothing known after the last one
+  ASSERT_TRUE(index.find(segment, 5, false, keyframe));
+  EXPECT_EQ(200376u, keyframe.offset);
+}
+
+TEST_F(KeyframeIndexTest, StartsSegmentBeforeFirstKeyframe) {
+  Keyframe keyframe;
+  EXPECT_FALSE(index.find(segment, 1, true, keyframe));
+  EXPECT_FALSE(index.find(segment, 0, false, keyframe));
+  EXPECT_FALSE(index.find(create_segment(2), 3, true, keyframe));
+}
+
+TEST_F(KeyframeIndexTest, KeepsFirstDemux) {
+  // Demuxing the segment again adds nothing
+  index.set_start_pts(segment, 11 * DVD_TIME_BASE);
+  index.add_keyframe(segment, 100376, 12 * DVD_TIME_BASE);
+  Keyframe keyframe;
+  ASSERT_TRUE(index.find(segment, 3, true, keyframe));
+  EXPECT_DOUBLE_EQ(2, keyframe.time);
+  ASSERT_TRUE(index.find(segment, 10, true, keyframe));
+  EXPECT_EQ(200376u, keyframe.offset);
+}
+
+TEST(KeyframeIndexLimitTest, DropsOldestSegments) {
+  KeyframeIndex index;
+  for(uint32_t i = 0; i <= KEYFRAME_INDEX_SEGMENTS; ++i) {
+    hls::Segment segment = create_segment(i);
+    index.set_start_pts(segment, 0);
+    index.add_keyframe(segment, 1000, DVD_TIME_BASE);
+  }
+  Keyframe keyframe;
+  EXPECT_FALSE(index.find(create_segment(0), 2, true, keyframe));
+  EXPECT_TRUE(index.find(create_segment(1), 2, true, keyframe));
+  EXPECT_TRUE(index.find(create_segment(KEYFRAME_INDEX_SEGMENTS), 2, true, keyframe));
+}
@@ -0,0 +1,286 @@
+/*
+ * segment_demuxer_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../helpers.h"
+#include "../../src/globals.h"
+#include "../../src/demuxer/segment_demuxer.h"
+
+const size_t TS_PACKET_SIZE = 188;
+// SDT, PAT and PMT lead the test segment
+const size_t TS_HEADER_SIZE = 3 * TS_PACKET_SIZE;
+
+struct TestPacket {
+  int stream_id;
+  double dts;
+  double pts;
+  std::string data;
+  bool has_keyframe_offset;
+  uint64_t keyframe_offset;
+};
+
+static std::map<int, std::vector<TestPacket>> by_stream(const std::vector<TestPacket> &packets) {
+  std::map<int, std::vector<TestPacket>> streams;
+  for(auto it = packets.begin(); it != packets.end(); ++it) {
+    streams[it->stream_id].push_back(*it);
+  }
+  return streams;
+}
+
+// Start of the first TS packet from pos on that starts a PES with an H.264
+// SPS in it, where the next IDR frame starts
+static size_t find_keyframe(const std::string &contents, size_t pos) {
+  const std::string sps("\x00\x00\x01\x67", 4);
+  for(; pos + TS_PACKET_SIZE <= contents.length(); pos += TS_PACKET_SIZE) {
+    bool unit_start = (contents[pos + 1] & 0x40) != 0;
+    if (unit_start && contents.substr(pos, TS_PACKET_SIZE).find(sps) != std::string::npos) {
+      return pos;
+    }
+  }
+  return std::string::npos;
+}
+
+// The segments in one string, handed out in blocks that don't line up with
+// the TS packets so reads have to cross them
+class TestSource : public SegmentSource {
+public:
+  TestSource(const std::string &contents, size_t block_size) : contents(contents), block_size(block_size) {};
+  hls::Segment view(uint64_t pos, size_t &size, const uint8_t *&data) {
+    size_t available = 0;
+    if (pos < contents.length()) {
+      available = std::min(contents.length() - pos, block_size - pos % block_size);
+    }
+    size = std::min(size, available);
+    data = reinterpret_cast<const uint8_t*>(contents.data()) + pos;
+    return hls::Segment();
+  };
+private:
+  std::string contents;
+  size_t block_size;
+};
+
+// A parser that starts at a frame keeps its 4 byte start code, one that
+// ran into it leaves a 3 byte one, both are the same frame
+static std::string without_leading_zeros(const std::string &data) {
+  size_t start = data.find(std::string("\x00\x00\x01", 3));
+  if (start == std::string::npos || data.find_first_not_of('\0') < start + 2) {
+    return data;
+  }
+  return data.substr(start);
+}
+
+class SegmentDemuxerTest : public ::testing::Test {
+protected:
+  SegmentDemuxerTest() : worker_pool(2) {};
+
+  virtual void SetUp() {
+    contents = load_file_contents("test/hls/decrypted_segment.ts");
+    ASSERT_LT(TS_HEADER_SIZE, contents.length());
+  }
+
+  std::unique_ptr<SegmentDemuxer> create(SegmentSource *source, uint32_t media_sequence, uint64_t start_pos,
+      uint64_t skip_to = 0) {
+    hls::Segment segment;
+    segment.media_sequence = media_sequence;
+    return std::unique_ptr<SegmentDemuxer>(new SegmentDemuxer(source, segment, start_pos, std::set<uint16_t>(),
+        &worker_pool, [this] {
+      std::lock_guard<std::mutex> guard(lock);
+      cv.notify_all();
+    }, skip_to));
+  }
+
+  // Packets of the demuxer once it is done, program changes left out
+  std::vector<TestPacket> collect(SegmentDemuxer *demuxer) {
+    std::vector<TestPacket> result;
+    while(true) {
+      SegmentPacket packet;
+      while(demuxer->pop_packet(packet)) {
+        if (packet.demux_packet) {
+          DemuxPacket *dxp = packet.demux_packet;
+          TestPacket test_packet;
+          test_packet.stream_id = dxp->iStreamId;
+          test_packet.dts = dxp->dts;
+          test_packet.pts = dxp->pts;
+          test_packet.data = std::string(reinterpret_cast<char*>(dxp->pData), dxp->iSize);
+          test_packet.has_keyframe_offset = packet.has_keyframe_offset;
+          test_packet.keyframe_offset = packet.keyframe_offset;
+          result.push_back(test_packet);
+          ipsh->FreeDemuxPacket(dxp);
+        }
+      }
+      if (demuxer->is_done()) {
+        return result;
+      }
+      std::unique_lock<std::mutex> guard(lock);
+      cv.wait_for(guard, std::chrono::milliseconds(10));
+    }
+  }
+
+  WorkerPool worker_pool;
+  std::string contents;
+  std::mutex lock;
+  std::condition_variable cv;
+};
+
+TEST_F(SegmentDemuxerTest, DemuxesSegment) {
+  TestSource source(contents, 10000);
+  std::unique_ptr<SegmentDemuxer> demuxer = create(&source, 0, 0);
+  // Comes in like a download
+  for(size_t pos = 0; pos < contents.length(); pos += 10000) {
+    demuxer->extend(std::min(pos + 10000, contents.length()));
+  }
+  demuxer->end_data();
+  EXPECT_FALSE(demuxer->wants_data());
+  std::vector<TestPacket> packets = collect(demuxer.get());
+  EXPECT_LT(100u, packets.size());
+  EXPECT_EQ(contents.length(), demuxer->get_position());
+}
+
+TEST_F(SegmentDemuxerTest, StartsWithProgram) {
+  TestSource source(contents, SEGMENT_BLOCK_SIZE);
+  std::unique_ptr<SegmentDemuxer> demuxer = create(&source, 0, 0);
+  demuxer->extend(contents.length());
+  demuxer->end_data();
+  SegmentPacket packet;
+  while(!demuxer->pop_packet(packet)) {
+    ASSERT_FALSE(demuxer->is_done());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(packet.program_change);
+  EXPECT_EQ(2u, packet.streams.size());
+  collect(demuxer.get());
+}
+
+TEST_F(SegmentDemuxerTest, SplitSegmentsMatchWhole) {
+  // Two segments, the second one starts with the program and a keyframe
+  // like in HLS
+  size_t split = find_keyframe(contents, contents.length() / 2 / TS_PACKET_SIZE * TS_PACKET_SIZE);
+  ASSERT_NE(std::string::npos, split);
+  std::string first = contents.substr(0, split);
+  std::string second = contents.substr(0, TS_HEADER_SIZE) + contents.substr(split);
+
+  TestSource source(first + second, SEGMENT_BLOCK_SIZE);
+  std::unique_ptr<SegmentDemuxer> whole = create(&source, 0, 0);
+  whole->extend(first.length() + second.length());
+  whole->end_data();
+  std::vector<TestPacket> expected = collect(whole.get());
+
+  std::unique_ptr<SegmentDemuxer> first_demuxer = create(&source, 0, 0);
+  std::unique_ptr<SegmentDemuxer> second_demuxer = create(&source, 1, first.length());
+  first_demuxer->extend(first.length());
+  first_demuxer->end_segment();
+  for(size_t pos = 0; pos < second.length(); pos += TS_PACKET_SIZE) {
+    uint64_t end = first.length() + std::min(pos + TS_PACKET_SIZE, second.length());
+    second_demuxer->extend(end);
+    if (first_demuxer->wants_data()) {
+      first_demuxer->extend(end);
+    }
+  }
+  first_demuxer->end_data();
+  second_demuxer->end_data();
+  std::vector<TestPacket> packets = collect(first_demuxer.get());
+  size_t first_count = packets.size();
+  std::vector<TestPacket> second_packets = collect(second_demuxer.get());
+  packets.insert(packets.end(), second_packets.begin(), second_packets.end());
+
+  EXPECT_LT(0u, first_count);
+  EXPECT_LT(0u, second_packets.size());
+  // Near the split the streams can come in another order, each stream's
+  // packets have to be the same
+  std::map<int, std::vector<TestPacket>> expected_streams = by_stream(expected);
+  std::map<int, std::vector<TestPacket>> streams = by_stream(packets);
+  ASSERT_EQ(2u, expected_streams.size());
+  ASSERT_EQ(expected_streams.size(), streams.size());
+  for(auto it = expected_streams.begin(); it != expected_streams.end(); ++it) {
+    std::vector<TestPacket> &stream = streams[it->first];
+    ASSERT_EQ(it->second.size(), stream.size()) << "stream " << it->first;
+    for(size_t i = 0; i < stream.size(); ++i) {
+      EXPECT_EQ(it->second[i].dts, stream[i].dts) << "stream " << it->first << " packet " << i;
+      EXPECT_EQ(it->second[i].pts, stream[i].pts) << "stream " << it->first << " packet " << i;
+      EXPECT_EQ(without_leading_zeros(it->second[i].data), without_leading_zeros(stream[i].data))
+          << "stream " << it->first << " packet " << i;
+    }
+  }
+}
+
+TEST_F(SegmentDemuxerTest, SkipsToKeyframe) {
+  TestSource source(contents, SEGMENT_BLOCK_SIZE);
+  std::unique_ptr<SegmentDemuxer> whole = create(&source, 0, 0);
+  whole->extend(contents.length());
+  whole->end_data();
+  std::vector<TestPacket> expected = collect(whole.get());
+
+  // The last keyframe, the one the segment starts with has no offset
+  size_t keyframe = expected.size();
+  for(size_t i = 0; i < expected.size(); ++i) {
+    if (expected[i].has_keyframe_offset) {
+      keyframe = i;
+    }
+  }
+  ASSERT_NE(expected.size(), keyframe);
+  ASSERT_LT(TS_HEADER_SIZE, expected[keyframe].keyframe_offset);
+  ASSERT_EQ(0u, expected[keyframe].keyframe_offset % TS_PACKET_SIZE);
+
+  std::unique_ptr<SegmentDemuxer> skipping = create(&source, 0, 0, expected[keyframe].keyframe_offset);
+  skipping->extend(contents.length());
+  skipping->end_data();
+  std::map<int, std::vector<TestPacket>> streams = by_stream(collect(skipping.get()));
+  int video = expected[keyframe].stream_id;
+  ASSERT_FALSE(streams[video].empty());
+  // The keyframe and the frames after it, nothing before
+  std::vector<TestPacket> expected_video;
+  for(size_t i = keyframe; i < expected.size(); ++i) {
+    if (expected[i].stream_id == video) {
+      expected_video.push_back(expected[i]);
+    }
+  }
+  ASSERT_EQ(expected_video.size(), streams[video].size());
+  EXPECT_EQ(expected_video.front().pts, streams[video].front().pts);
+  EXPECT_EQ(expected_video.back().pts, streams[video].back().pts);
+}
+
+TEST_F(SegmentDemuxerTest, ContinuesWithContext) {
+  // The second segment starts in the middle of a frame and of a TS packet,
+  // without a program of its own
+  size_t split = contents.length() / 2 / TS_PACKET_SIZE * TS_PACKET_SIZE + 100;
+  TestSource source(contents, 10000);
+  std::unique_ptr<SegmentDemuxer> whole = create(&source, 0, 0);
+  whole->extend(contents.length());
+  whole->end_data();
+  std::vector<TestPacket> expected = collect(whole.get());
+
+  std::unique_ptr<SegmentDemuxer> first_demuxer = create(&source, 0, 0);
+  std::unique_ptr<SegmentDemuxer> second_demuxer = create(&source, 1, split);
+  first_demuxer->extend(split);
+  first_demuxer->continue_with(second_demuxer.get());
+  EXPECT_FALSE(first_demuxer->wants_data());
+  EXPECT_TRUE(first_demuxer->is_segment_complete());
+  second_demuxer->extend(contents.length());
+  second_demuxer->end_data();
+  std::vector<TestPacket> packets = collect(first_demuxer.get());
+  size_t first_count = packets.size();
+  std::vector<TestPacket> second_packets = collect(second_demuxer.get());
+  packets.insert(packets.end(), second_packets.begin(), second_packets.end());
+
+  EXPECT_LT(0u, first_count);
+  EXPECT_LT(0u, second_packets.size());
+  // One parser all the way through, the same packets in the same order
+  ASSERT_EQ(expected.size(), packets.size());
+  for(size_t i = 0; i < packets.size(); ++i) {
+    EXPECT_EQ(expected[i].stream_id, packets[i].stream_id) << "packet " << i;
+    EXPECT_EQ(expected[i].dts, packets[i].dts) << "packet " << i;
+    EXPECT_EQ(expected[i].pts, packets[i].pts) << "packet " << i;
+    EXPECT_EQ(expected[i].data, packets[i].data) << "packet " << i;
+  }
+  EXPECT_EQ(contents.length(), second_demuxer->get_position());
+}
@@ -0,0 +1,94 @@
+/*
+ * start_code_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+#include "../helpers.h"
+#include "../../src/demuxer/start_code.h"
+
+namespace TSDemux {
+
+static size_t find_start_code_scalar(const unsigned char *data, size_t len) {
+  for(size_t i = 0; i + 3 <= len; ++i) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+      return i;
+    }
+  }
+  return len;
+}
+
+static void expect_matches_scalar(const std::string &data, size_t max_start, size_t step) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data.data());
+  // Every start and length so each vector width and the tail get used
+  for(size_t start = 0; start < max_start && start < data.length(); ++start) {
+    for(size_t length = 0; start + length <= data.length(); length += step) {
+      ASSERT_EQ(find_start_code_scalar(bytes + start, length), FindStartCode(bytes + start, length)) <<
+          "start " << start << " length " << length;
+    }
+  }
+}
+
+TEST(StartCodeTest, MatchesScalarSearch) {
+  srand(1);
+  std::string data(1000, 0);
+  for(size_t i = 0; i < data.length(); ++i) {
+    data[i] = rand() % 4;
+  }
+  expect_matches_scalar(data, 70, 1);
+}
+
+TEST(StartCodeTest, StartCodesAcrossBlocks) {
+  // Start codes at every position around the 16 and 32 byte blocks
+  for(size_t pos = 0; pos < 70; ++pos) {
+    std::string data(100, '\x55');
+    data[pos] = 0;
+    data[pos + 1] = 0;
+    data[pos + 2] = 1;
+    expect_matches_scalar(data, 1, 1);
+  }
+}
+
+TEST(StartCodeTest, MatchesScalarSearchOnVideo) {
+  std::string video = load_file_contents("test/encrypted/video.h264");
+  ASSERT_FALSE(video.empty());
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(video.data());
+  size_t count = 0;
+  size_t expected_count = 0;
+  for(size_t pos = 0; pos < video.length(); ++count) {
+    size_t found = pos + FindStartCode(bytes + pos, video.length() - pos);
+    ASSERT_EQ(pos + find_start_code_scalar(bytes + pos, video.length() - pos), found);
+    if (found == video.length()) {
+      break;
+    }
+    pos = found + 1;
+  }
+  for(size_t i = 0; i + 3 <= video.length(); ++i) {
+    if (bytes[i] == 0 && bytes[i + 1] == 0 && bytes[i + 2] == 1) {
+      ++expected_count;
+    }
+  }
+  EXPECT_EQ(expected_count, count);
+  EXPECT_LT(0, count);
+  expect_matches_scalar(video.substr(0, 2000), 40, 97);
+}
+
+TEST(StartCodeTest, SkipToPositionShiftsInBytes) {
+  std::string data = "\x01\x02\x03\x04\x05\x06\x07\x08\x09";
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data.data());
+  for(size_t from = 0; from < data.length(); ++from) {
+    for(size_t to = from; to <= data.length(); ++to) {
+      uint32_t expected = 0xaabbccdd;
+      for(size_t i = from; i < to; ++i) {
+        expected = expected << 8 | bytes[i];
+      }
+      size_t p = from;
+      EXPECT_EQ(expected, SkipToPosition<size_t>(0xaabbccdd, bytes, p, to));
+      EXPECT_EQ(to, p);
+    }
+  }
+}
+
+}
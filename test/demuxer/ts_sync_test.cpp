@@ -0,0 +1,111 @@
+/*
+ * ts_sync_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+#include "../helpers.h"
+#include "../../src/demuxer/ts_sync.h"
+
+namespace TSDemux {
+
+class TSSyncTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    ts = load_file_contents("test/hls/gear1/fileSequence0.ts");
+    ASSERT_EQ(0, ts.length() % 188);
+  }
+  // The TS with extra bytes around every packet, like M2TS or DVB-ASI
+  std::string repacket(size_t prefix, size_t suffix) {
+    std::string packets;
+    for(size_t pos = 0; pos < ts.length(); pos += 188) {
+      packets += std::string(prefix, '\x12');
+      packets += ts.substr(pos, 188);
+      packets += std::string(suffix, '\x34');
+    }
+    return packets;
+  }
+  int find(const std::string &data) {
+    return FindTSSync(reinterpret_cast<const unsigned char*>(data.data()), data.length(), 2, 10,
+        &offset, &packet_size);
+  }
+
+  std::string ts;
+  size_t offset;
+  size_t packet_size;
+};
+
+TEST_F(TSSyncTest, FindSyncByteMatchesScalarSearch) {
+  srand(1);
+  std::string data(1000, 0);
+  for(size_t i = 0; i < data.length(); ++i) {
+    data[i] = rand() % 255;
+  }
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data.data());
+  // Every start and length so each vector width and the tail get used
+  for(size_t start = 0; start < 70; ++start) {
+    for(size_t length = 0; start + length <= data.length(); length += 7) {
+      size_t expected = data.find('\x47', start);
+      if (expected == std::string::npos || expected >= start + length) {
+        expected = start + length;
+      }
+      ASSERT_EQ(expected - start, FindSyncByte(bytes + start, length));
+    }
+  }
+}
+
+TEST_F(TSSyncTest, PacketSizes) {
+  EXPECT_EQ(TS_SYNC_FOUND, find(ts));
+  EXPECT_EQ(0, offset);
+  EXPECT_EQ(188, packet_size);
+  EXPECT_EQ(TS_SYNC_FOUND, find(repacket(4, 0)));
+  EXPECT_EQ(4, offset);
+  EXPECT_EQ(192, packet_size);
+  EXPECT_EQ(TS_SYNC_FOUND, find(repacket(0, 16)));
+  EXPECT_EQ(0, offset);
+  EXPECT_EQ(204, packet_size);
+  EXPECT_EQ(TS_SYNC_FOUND, find(repacket(0, 20)));
+  EXPECT_EQ(208, packet_size);
+}
+
+TEST_F(TSSyncTest, OffsetInput) {
+  // Starts part way through a packet
+  EXPECT_EQ(TS_SYNC_FOUND, find(ts.substr(1000)));
+  EXPECT_EQ(128, offset);
+  EXPECT_EQ(188, packet_size);
+}
+
+TEST_F(TSSyncTest, CorruptedInput) {
+  // Garbage full of sync bytes that aren't a packet apart
+  std::string garbage;
+  for(size_t i = 0; i < 3000; ++i) {
+    garbage += (i % 5 == 0) ? '\x47' : '\x00';
+  }
+  std::string data = garbage + ts;
+  EXPECT_EQ(TS_SYNC_FOUND, find(data));
+  EXPECT_EQ(garbage.length(), offset);
+  EXPECT_EQ(188, packet_size);
+
+  // A packet with a broken sync byte is skipped
+  data = ts;
+  data[188 * 3] = 0;
+  EXPECT_EQ(TS_SYNC_FOUND, find(data.substr(188 * 2)));
+  EXPECT_EQ(188 * 2, offset);
+}
+
+TEST_F(TSSyncTest, NoSync) {
+  std::string data(5000, '\x11');
+  EXPECT_EQ(TS_SYNC_NONE, find(data));
+  EXPECT_EQ(data.length(), offset);
+}
+
+TEST_F(TSSyncTest, NeedsMoreData) {
+  std::string data(1000, '\x11');
+  data += ts.substr(0, 300);
+  EXPECT_EQ(TS_SYNC_NEED_DATA, find(data));
+  EXPECT_EQ(1000, offset);
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "../src/downloader/downloader.h"
+
+// Serves contents from memory and drops the "connection" after a set
+// number of bytes, one entry of drop_after per request.  Requests past the
+// end of drop_after complete normally.
+class FaultInjectingDownloader : public Downloader {
+public:
+  FaultInjectingDownloader(std::string contents, std::deque<size_t> drop_after) :
+    contents(contents), drop_after(drop_after), chunk_size(1000) {};
+  std::string download(std::string location) {
+    return contents;
+  };
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func) {
+    requests.push_back(std::make_pair(byte_offset, byte_length));
+    size_t end = byte_length ? byte_offset + byte_length : contents.length();
+    end = std::min(end, contents.length());
+    size_t limit = contents.length();
+    if (!drop_after.empty()) {
+      limit = drop_after.front();
+      drop_after.pop_front();
+    }
+    size_t sent = 0;
+    for(size_t pos = byte_offset; pos < end; pos += chunk_size) {
+      size_t length = std::min(std::min(chunk_size, end - pos), limit - sent);
+      if (length == 0) {
+        return false;
+      }
+      if (!func(reinterpret_cast<const uint8_t*>(contents.data()) + pos, length)) {
+        return false;
+      }
+      sent += length;
+      if (length < chunk_size && pos + length < end) {
+        return false;
+      }
+    }
+    return true;
+  };
+  double get_current_bandwidth() {
+    return 100000000;
+  };
+  double get_average_bandwidth() {
+    return 100000000;
+  };
+  std::string contents;
+  std::deque<size_t> drop_after;
+  size_t chunk_size;
+  // (byte_offset, byte_length) of every request
+  std::vector<std::pair<uint32_t, uint32_t>> requests;
+};
@@ -0,0 +1,125 @@
+/*
+ * abr_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "../../src/hls/abr.h"
+
+namespace hls {
+
+class BufferAbrControllerTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    variants = {500000, 1000000, 2000000, 4000000};
+    state.segment_duration = 10;
+  }
+
+  BufferAbrController controller;
+  std::vector<uint32_t> variants;
+  AbrState state;
+};
+
+TEST_F(BufferAbrControllerTest, StartupUsesThroughput) {
+  state.throughput = 3000000;
+  EXPECT_EQ(2, controller.select_variant(variants, state));
+  state.throughput = 100000;
+  EXPECT_EQ(0, controller.select_variant(variants, state));
+}
+
+TEST_F(BufferAbrControllerTest, SwitchUpNeedsBuffer) {
+  state.current_variant = 1;
+  state.throughput = 6000000;
+  state.buffered_time = 5;
+  EXPECT_EQ(1, controller.select_variant(variants, state));
+  state.buffered_time = 12;
+  EXPECT_EQ(3, controller.select_variant(variants, state));
+}
+
+TEST_F(BufferAbrControllerTest, RidesOutDipWithBuffer) {
+  state.current_variant = 2;
+  state.throughput = 1500000;
+  state.buffered_time = 18;
+  EXPECT_EQ(2, controller.select_variant(variants, state));
+  state.buffered_time = 8;
+  EXPECT_EQ(1, controller.select_variant(variants, state));
+}
+
+TEST_F(BufferAbrControllerTest, EmergencyDownswitchOnStall) {
+  state.current_variant = 3;
+  state.throughput = 6000000;
+  state.buffered_time = 18;
+  state.stall_counter = 1;
+  EXPECT_EQ(0, controller.select_variant(variants, state));
+}
+
+TEST_F(BufferAbrControllerTest, KeepsCurrentInsideSafetyMargin) {
+  state.current_variant = 2;
+  state.buffered_time = 12;
+  // 2 MBit/s needs 2.5 MBit/s of throughput
+  state.throughput = 2500000;
+  EXPECT_EQ(2, controller.select_variant(variants, state));
+}
+
+TEST(ThroughputAbrControllerTest, HighestVariantThatFits) {
+  ThroughputAbrController controller;
+  AbrState state;
+  std::vector<uint32_t> variants = {500000, 1000000, 2000000, 4000000};
+  state.throughput = 2400000;
+  EXPECT_EQ(1, controller.select_variant(variants, state));
+  state.throughput = 10000000;
+  EXPECT_EQ(3, controller.select_variant(variants, state));
+}
+
+class AbandonDownloadTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    // 10 second segment of a 4 MBit/s variant, 1 MBit/s below it
+    progress.expected = 5000000;
+    progress.fallback_size = 1250000;
+    progress.elapsed = 2;
+    progress.buffered_time = 6;
+  }
+
+  DownloadProgress progress;
+};
+
+TEST_F(AbandonDownloadTest, KeepsDownloadThatFinishesInTime) {
+  // 1 MB/s, done in 3 seconds
+  progress.received = 2000000;
+  EXPECT_FALSE(should_abandon_download(progress));
+}
+
+TEST_F(AbandonDownloadTest, AbandonsWhenBufferRunsOut) {
+  // 100 kB/s, 48 seconds left but only 6 buffered, fallback takes 12.5
+  progress.received = 200000;
+  EXPECT_TRUE(should_abandon_download(progress));
+}
+
+TEST_F(AbandonDownloadTest, KeepsWhenFallbackIsNoFaster) {
+  // 48 seconds left, the fallback on its own would take 50
+  progress.received = 200000;
+  progress.fallback_size = 5000000;
+  EXPECT_FALSE(should_abandon_download(progress));
+}
+
+TEST_F(AbandonDownloadTest, NeedsLowerVariantAndProgress) {
+  progress.received = 200000;
+  progress.fallback_size = 0;
+  EXPECT_FALSE(should_abandon_download(progress));
+  progress.fallback_size = 1250000;
+  progress.elapsed = 0.5;
+  EXPECT_FALSE(should_abandon_download(progress));
+  progress.elapsed = 2;
+  progress.expected = 0;
+  EXPECT_FALSE(should_abandon_download(progress));
+}
+
+TEST_F(AbandonDownloadTest, FinishesNearlyCompleteDownload) {
+  progress.received = 4500000;
+  progress.elapsed = 200;
+  progress.buffered_time = 0;
+  EXPECT_FALSE(should_abandon_download(progress));
+}
+
+}
@@ -55,6 +55,18 @@ TEST(HlsTest, StreamUrl) {
   EXPECT_EQ("test/hls/gear4/prog_index.m3u8", streams[3].get_url());
 }
 
+TEST(HlsTest, VariantListener) {
+  hls::FileMasterPlaylist mp = hls::FileMasterPlaylist();
+  std::vector<std::string> urls;
+  mp.set_variant_listener([&](const MediaPlaylist &variant) {
+    urls.push_back(variant.get_url());
+  });
+  mp.open("test/hls/bipbopall.m3u8");
+  ASSERT_EQ(4, urls.size());
+  EXPECT_EQ("test/hls/gear1/prog_index.m3u8", urls[0]);
+  EXPECT_EQ("test/hls/gear4/prog_index.m3u8", urls[3]);
+}
+
 TEST(HlsTest, LoadMediaPlaylist) {
   hls::FileMediaPlaylist mp;
   bool ret = mp.open("test/hls/gear1/prog_index.m3u8");
@@ -83,6 +95,72 @@ TEST(HlsTest, MediaPlayistUrl) {
   mp.open("test/hls/gear1/prog_index.m3u8");
   EXPECT_EQ("test/hls/gear1/", mp.get_base_url());
 }
+
+TEST(HlsTest, DiscontinuitySequence) {
+  MediaPlaylist mp;
+  mp.load_contents("#EXTM3U\n"
+      "#EXT-X-TARGETDURATION:10\n"
+      "#EXT-X-MEDIA-SEQUENCE:40\n"
+      "#EXT-X-DISCONTINUITY-SEQUENCE:3\n"
+      "#EXTINF:10,\n"
+      "a.ts\n"
+      "#EXT-X-DISCONTINUITY\n"
+      "#EXTINF:10,\n"
+      "b.ts\n"
+      "#EXTINF:10,\n"
+      "c.ts\n");
+  ASSERT_EQ(3, mp.get_segments().size());
+  EXPECT_FALSE(mp.get_segments()[0].discontinuity);
+  EXPECT_EQ(3, mp.get_segments()[0].discontinuity_sequence);
+  EXPECT_TRUE(mp.get_segments()[1].discontinuity);
+  EXPECT_EQ(4, mp.get_segments()[1].discontinuity_sequence);
+  EXPECT_EQ(41, mp.get_segments()[1].media_sequence);
+  EXPECT_EQ(4, mp.get_segments()[2].discontinuity_sequence);
+}
+
+TEST(HlsTest, StartTags) {
+  MediaPlaylist mp;
+  mp.load_contents("#EXTM3U\n"
+      "#EXT-X-TARGETDURATION:4\n"
+      "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=1.5,HOLD-BACK=12.5\n"
+      "#EXT-X-START:TIME-OFFSET=-20.5,PRECISE=YES\n"
+      "#EXTINF:4,\n"
+      "a.ts\n");
+  EXPECT_DOUBLE_EQ(12.5, mp.start.hold_back);
+  EXPECT_TRUE(mp.start.has_time_offset);
+  EXPECT_DOUBLE_EQ(-20.5, mp.start.time_offset);
+  MediaPlaylist no_tags;
+  no_tags.load_contents("#EXTM3U\n"
+      "#EXTINF:4,\n"
+      "a.ts\n");
+  EXPECT_EQ(0, no_tags.start.hold_back);
+  EXPECT_FALSE(no_tags.start.has_time_offset);
+}
+
+TEST(HlsTest, IndependentSegments) {
+  MediaPlaylist mp;
+  mp.load_contents("#EXTM3U\n"
+      "#EXT-X-TARGETDURATION:4\n"
+      "#EXT-X-INDEPENDENT-SEGMENTS\n"
+      "#EXTINF:4,\n"
+      "a.ts\n");
+  ASSERT_EQ(1, mp.get_segments().size());
+  EXPECT_TRUE(mp.independent_segments);
+  EXPECT_TRUE(mp.get_segments()[0].independent);
+  MediaPlaylist i_frames;
+  i_frames.load_contents("#EXTM3U\n"
+      "#EXT-X-I-FRAMES-ONLY\n"
+      "#EXTINF:4,\n"
+      "a.ts\n");
+  ASSERT_EQ(1, i_frames.get_segments().size());
+  EXPECT_TRUE(i_frames.get_segments()[0].independent);
+  MediaPlaylist no_tags;
+  no_tags.load_contents("#EXTM3U\n"
+      "#EXTINF:4,\n"
+      "a.ts\n");
+  ASSERT_EQ(1, no_tags.get_segments().size());
+  EXPECT_FALSE(no_tags.get_segments()[0].independent);
+}
 //
 //TEST(HlsTest, SegmentUrl) {
 //  hls::FileMediaPlaylist mp;
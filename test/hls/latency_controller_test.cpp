@@ -0,0 +1,37 @@
+/*
+ * latency_controller_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "../../src/hls/latency_controller.h"
+
+namespace hls {
+
+TEST(LatencyControllerTest, NoLatencyYet) {
+  LatencyController controller;
+  EXPECT_EQ(-1, controller.get_latency());
+}
+
+TEST(LatencyControllerTest, CloseToTargetKeepsPlaying) {
+  LatencyController controller;
+  EXPECT_EQ(0, controller.update(18, 18, 6));
+  EXPECT_EQ(0, controller.update(35, 18, 6));
+  EXPECT_EQ(35, controller.get_latency());
+}
+
+TEST(LatencyControllerTest, SkipsWholeSegments) {
+  LatencyController controller;
+  // 40 seconds too far behind is six whole segments
+  EXPECT_EQ(6, controller.update(58, 18, 6));
+  EXPECT_EQ(6, controller.get_skipped_segments());
+  EXPECT_EQ(3, controller.update(36, 18, 6));
+  EXPECT_EQ(9, controller.get_skipped_segments());
+}
+
+TEST(LatencyControllerTest, UnknownSegmentDuration) {
+  LatencyController controller;
+  EXPECT_EQ(0, controller.update(100, 18, 0));
+}
+
+}
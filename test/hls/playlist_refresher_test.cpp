@@ -0,0 +1,126 @@
+/*
+ * playlist_refresher_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "../../src/hls/playlist_refresher.h"
+
+namespace hls {
+
+const std::string LIVE_PLAYLIST = "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:6\n"
+    "#EXT-X-MEDIA-SEQUENCE:10\n"
+    "#EXTINF:6,\n"
+    "segment10.ts\n"
+    "#EXTINF:6,\n"
+    "segment11.ts\n";
+
+// Counts the downloads and can hold them until released
+class CountingDownloader : public Downloader {
+public:
+  CountingDownloader() : downloads(0), blocked(false), contents(LIVE_PLAYLIST) {};
+  std::string download(std::string location) {
+    ++downloads;
+    std::unique_lock<std::mutex> lock(block_lock);
+    block_cv.wait(lock, [this] {
+      return !blocked;
+    });
+    return contents;
+  };
+  void set_blocked(bool blocked) {
+    {
+      std::lock_guard<std::mutex> lock(block_lock);
+      this->blocked = blocked;
+    }
+    block_cv.notify_all();
+  };
+  std::atomic<int> downloads;
+  std::mutex block_lock;
+  std::condition_variable block_cv;
+  bool blocked;
+  std::string contents;
+};
+
+class PlaylistRefresherTest : public ::testing::Test {
+protected:
+  PlaylistRefresherTest() : request_scheduler(&downloader), worker_pool(2),
+    refresher(&request_scheduler, &worker_pool) {};
+
+  CountingDownloader downloader;
+  RequestScheduler request_scheduler;
+  WorkerPool worker_pool;
+  PlaylistRefresher refresher;
+};
+
+TEST_F(PlaylistRefresherTest, CandidateLoadsRightAway) {
+  refresher.add_variant("http://host/low.m3u8");
+  refresher.add_variant("http://host/high.m3u8");
+  refresher.set_priorities({"http://host/low.m3u8"}, {"http://host/high.m3u8"});
+  MediaPlaylist playlist;
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+  while(!refresher.get_playlist("http://host/high.m3u8", playlist) && std::chrono::steady_clock::now() < end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(2, playlist.get_segments().size());
+  EXPECT_TRUE(playlist.live);
+  EXPECT_EQ(10, playlist.get_segments().front().media_sequence);
+  EXPECT_FALSE(refresher.get_playlist("http://host/low.m3u8", playlist));
+}
+
+TEST_F(PlaylistRefresherTest, ConcurrentRefreshesShareDownload) {
+  refresher.add_variant("http://host/low.m3u8");
+  downloader.set_blocked(true);
+  MediaPlaylist first;
+  MediaPlaylist second;
+  std::thread first_thread([&] {
+    first = refresher.refresh("http://host/low.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  });
+  while(downloader.downloads == 0) {
+    std::this_thread::yield();
+  }
+  std::thread second_thread([&] {
+    second = refresher.refresh("http://host/low.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  downloader.set_blocked(false);
+  first_thread.join();
+  second_thread.join();
+  EXPECT_EQ(1, downloader.downloads);
+  EXPECT_EQ(2, first.get_segments().size());
+  EXPECT_EQ(2, second.get_segments().size());
+}
+
+TEST_F(PlaylistRefresherTest, RecentRefreshIsReused) {
+  refresher.add_variant("http://host/low.m3u8");
+  refresher.refresh("http://host/low.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  refresher.refresh("http://host/low.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  EXPECT_EQ(1, downloader.downloads);
+}
+
+TEST_F(PlaylistRefresherTest, FailedRefreshKeepsLastCopy) {
+  refresher.add_variant("http://host/low.m3u8");
+  refresher.refresh("http://host/low.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  downloader.contents = "";
+  std::this_thread::sleep_for(std::chrono::milliseconds(REFRESH_COALESCE_MS + 10));
+  MediaPlaylist playlist = refresher.refresh("http://host/low.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  EXPECT_EQ(2, downloader.downloads);
+  EXPECT_EQ(2, playlist.get_segments().size());
+  EXPECT_TRUE(playlist.live);
+  EXPECT_EQ("http://host/low.m3u8", playlist.get_url());
+}
+
+TEST_F(PlaylistRefresherTest, UnknownPlaylistIsDownloaded) {
+  MediaPlaylist playlist = refresher.refresh("http://host/other.m3u8", RequestClass::ACTIVE_PLAYLIST);
+  EXPECT_EQ(1, downloader.downloads);
+  EXPECT_EQ(2, playlist.get_segments().size());
+  EXPECT_FALSE(refresher.get_playlist("http://host/other.m3u8", playlist));
+}
+
+}
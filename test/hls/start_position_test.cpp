@@ -0,0 +1,74 @@
+/*
+ * start_position_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "../../src/hls/start_position.h"
+
+namespace hls {
+
+class StartPositionTest : public ::testing::Test {
+protected:
+  std::list<Segment> make_segments(uint32_t first_sequence, double duration, size_t count) {
+    std::list<Segment> segments;
+    for(size_t i = 0; i < count; ++i) {
+      Segment segment;
+      segment.valid = true;
+      segment.media_sequence = first_sequence + i;
+      segment.duration = duration;
+      segment.time_in_playlist = i * duration;
+      segments.push_back(segment);
+    }
+    return segments;
+  }
+  uint32_t start_sequence(const std::list<Segment> &segments, bool live) {
+    return find_start_segment(segments, live, 6, playlist_start, options)->media_sequence;
+  }
+
+  PlaylistStart playlist_start;
+  StartOptions options;
+};
+
+TEST_F(StartPositionTest, VodStartsAtBeginning) {
+  std::list<Segment> segments = make_segments(100, 6, 10);
+  EXPECT_EQ(100, start_sequence(segments, false));
+}
+
+TEST_F(StartPositionTest, LiveStartsThreeTargetDurationsBack) {
+  std::list<Segment> segments = make_segments(100, 6, 10);
+  EXPECT_EQ(107, start_sequence(segments, true));
+}
+
+TEST_F(StartPositionTest, ServerControlHoldBack) {
+  std::list<Segment> segments = make_segments(100, 6, 10);
+  playlist_start.hold_back = 12;
+  EXPECT_EQ(108, start_sequence(segments, true));
+  // The setting wins over the playlist
+  options.hold_back = 30;
+  EXPECT_EQ(105, start_sequence(segments, true));
+}
+
+TEST_F(StartPositionTest, HoldBackLongerThanPlaylist) {
+  std::list<Segment> segments = make_segments(100, 6, 2);
+  EXPECT_EQ(100, start_sequence(segments, true));
+}
+
+TEST_F(StartPositionTest, StartTimeOffset) {
+  std::list<Segment> segments = make_segments(100, 6, 10);
+  playlist_start.has_time_offset = true;
+  playlist_start.time_offset = 13;
+  EXPECT_EQ(102, start_sequence(segments, false));
+  playlist_start.time_offset = -7;
+  EXPECT_EQ(108, start_sequence(segments, true));
+  // Going live ignores it
+  options.live_edge = true;
+  EXPECT_EQ(107, start_sequence(segments, true));
+}
+
+TEST_F(StartPositionTest, Empty) {
+  std::list<Segment> segments;
+  EXPECT_TRUE(find_start_segment(segments, true, 6, playlist_start, options) == segments.end());
+}
+
+}
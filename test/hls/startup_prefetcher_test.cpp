@@ -0,0 +1,94 @@
+/*
+ * startup_prefetcher_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <map>
+#include <mutex>
+
+#include "gtest/gtest.h"
+
+#include "../../src/hls/startup_prefetcher.h"
+#include "../../src/downloader/request_scheduler.h"
+
+namespace hls {
+
+class MapDownloader : public Downloader {
+public:
+  std::string download(std::string location) {
+    std::lock_guard<std::mutex> guard(lock);
+    ++downloads[location];
+    return contents[location];
+  };
+  int get_downloads(std::string location) {
+    std::lock_guard<std::mutex> guard(lock);
+    return downloads[location];
+  };
+  std::map<std::string, std::string> contents;
+private:
+  std::mutex lock;
+  std::map<std::string, int> downloads;
+};
+
+class StartupPrefetcherTest : public ::testing::Test {
+protected:
+  StartupPrefetcherTest() : prefetcher(&downloader), request_scheduler(&downloader) {
+    downloader.contents["http://host/low.m3u8"] = "#EXTM3U\n"
+        "#EXT-X-TARGETDURATION:6\n"
+        "#EXT-X-MEDIA-SEQUENCE:10\n"
+        "#EXTINF:6,\n"
+        "segment10.ts\n"
+        "#EXTINF:6,\n"
+        "segment11.ts\n";
+    downloader.contents["http://host/segment10.ts"] = "segment";
+    request_scheduler.set_prefetch_store(prefetcher.get_store());
+  };
+
+  MapDownloader downloader;
+  StartupPrefetcher prefetcher;
+  RequestScheduler request_scheduler;
+};
+
+TEST_F(StartupPrefetcherTest, RequestsGetPrefetchedDownloads) {
+  prefetcher.start("http://host/low.m3u8");
+  prefetcher.start("http://host/high.m3u8");
+  EXPECT_EQ("http://host/low.m3u8", prefetcher.get_playlist_url());
+  EXPECT_EQ(downloader.contents["http://host/low.m3u8"],
+      request_scheduler.download(RequestClass::ACTIVE_PLAYLIST, "http://host/low.m3u8"));
+  std::string segment;
+  EXPECT_TRUE(request_scheduler.download(RequestClass::SEGMENT, "http://host/segment10.ts", 0, 0,
+      [&](const uint8_t *data, size_t length) {
+    segment.append(reinterpret_cast<const char*>(data), length);
+    return true;
+  }));
+  EXPECT_EQ("segment", segment);
+  EXPECT_EQ(1, downloader.get_downloads("http://host/low.m3u8"));
+  EXPECT_EQ(1, downloader.get_downloads("http://host/segment10.ts"));
+  EXPECT_EQ(0, downloader.get_downloads("http://host/high.m3u8"));
+}
+
+TEST_F(StartupPrefetcherTest, PrefetchIsUsedOnce) {
+  prefetcher.start("http://host/low.m3u8");
+  request_scheduler.download(RequestClass::ACTIVE_PLAYLIST, "http://host/low.m3u8");
+  request_scheduler.download(RequestClass::ACTIVE_PLAYLIST, "http://host/low.m3u8");
+  EXPECT_EQ(2, downloader.get_downloads("http://host/low.m3u8"));
+}
+
+TEST_F(StartupPrefetcherTest, FailedPrefetchDownloadsAgain) {
+  downloader.contents["http://host/low.m3u8"] = "";
+  prefetcher.start("http://host/low.m3u8");
+  request_scheduler.download(RequestClass::ACTIVE_PLAYLIST, "http://host/low.m3u8");
+  EXPECT_EQ(2, downloader.get_downloads("http://host/low.m3u8"));
+}
+
+TEST_F(StartupPrefetcherTest, ByteRangeSegmentIsntPrefetched) {
+  downloader.contents["http://host/low.m3u8"] = "#EXTM3U\n"
+      "#EXT-X-TARGETDURATION:6\n"
+      "#EXTINF:6,\n"
+      "#EXT-X-BYTERANGE:1000@0\n"
+      "segment10.ts\n";
+  prefetcher.start("http://host/low.m3u8");
+  request_scheduler.download(RequestClass::ACTIVE_PLAYLIST, "http://host/low.m3u8");
+  EXPECT_EQ(0, downloader.get_downloads("http://host/segment10.ts"));
+}
+
+}
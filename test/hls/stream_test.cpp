@@ -0,0 +1,58 @@
+/*
+ * stream_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "../../src/hls/stream.h"
+
+// Live playlist with count 6 second segments from first_sequence on
+static hls::MediaPlaylist live_playlist(uint32_t first_sequence, size_t count) {
+  std::string contents = "#EXTM3U\n#EXT-X-TARGETDURATION:6\n#EXT-X-MEDIA-SEQUENCE:" +
+      std::to_string(first_sequence) + "\n";
+  for(size_t i = 0; i < count; ++i) {
+    contents += "#EXTINF:6,\nsegment" + std::to_string(first_sequence + i) + ".ts\n";
+  }
+  hls::MediaPlaylist playlist;
+  playlist.set_url("http://example.com/playlist.m3u8");
+  playlist.load_contents(contents);
+  return playlist;
+}
+
+TEST(StreamTest, LaggingSwitchTargetWaitsForSwitchPoint) {
+  // The stream switched from is at 105, this variant's playlist is older
+  hls::MediaPlaylist playlist = live_playlist(100, 3);
+  ASSERT_TRUE(playlist.live);
+  hls::SwitchPoint switch_point;
+  switch_point.media_sequence = 105;
+  Stream stream(playlist, switch_point);
+  stream.reset_download_itr();
+  EXPECT_FALSE(stream.has_download_item());
+
+  // Still behind, 103 and 104 have been played from the other variant
+  hls::MediaPlaylist update = live_playlist(101, 4);
+  stream.merge(update);
+  EXPECT_FALSE(stream.has_download_item());
+
+  update = live_playlist(103, 4);
+  stream.merge(update);
+  ASSERT_TRUE(stream.has_download_item());
+  EXPECT_EQ(105, stream.get_current_segment().media_sequence);
+}
+
+TEST(StreamTest, SwitchTargetSkipsPastMissedSwitchPoint) {
+  hls::MediaPlaylist playlist = live_playlist(100, 3);
+  hls::SwitchPoint switch_point;
+  switch_point.media_sequence = 105;
+  Stream stream(playlist, switch_point);
+  stream.reset_download_itr();
+  EXPECT_FALSE(stream.has_download_item());
+
+  // The switch segment has already left the playlist window
+  hls::MediaPlaylist update = live_playlist(106, 3);
+  stream.merge(update);
+  ASSERT_TRUE(stream.has_download_item());
+  EXPECT_EQ(106, stream.get_current_segment().media_sequence);
+}
@@ -0,0 +1,93 @@
+/*
+ * switch_planner_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "../../src/hls/switch_planner.h"
+
+namespace hls {
+
+class SwitchPlannerTest : public ::testing::Test {
+protected:
+  std::list<Segment> make_segments(uint32_t first_sequence, double duration, size_t count,
+      uint32_t discontinuity_at = 0) {
+    std::list<Segment> segments;
+    double time = 0;
+    uint32_t discontinuity_sequence = 0;
+    for(size_t i = 0; i < count; ++i) {
+      Segment segment;
+      segment.valid = true;
+      segment.media_sequence = first_sequence + i;
+      if (discontinuity_at && segment.media_sequence == discontinuity_at) {
+        ++discontinuity_sequence;
+        segment.discontinuity = true;
+      }
+      segment.discontinuity_sequence = discontinuity_sequence;
+      segment.duration = duration;
+      segment.time_in_playlist = time;
+      time += duration;
+      segments.push_back(segment);
+    }
+    return segments;
+  }
+};
+
+TEST_F(SwitchPlannerTest, SwitchPointAfterSegment) {
+  std::list<Segment> segments = make_segments(10, 6, 3);
+  SwitchPoint switch_point = switch_point_after(*(++segments.begin()));
+  EXPECT_EQ(12, switch_point.media_sequence);
+  EXPECT_DOUBLE_EQ(12, switch_point.time);
+}
+
+TEST_F(SwitchPlannerTest, AlignedSequences) {
+  std::list<Segment> current = make_segments(10, 6, 5);
+  std::list<Segment> target = make_segments(10, 6.006, 5);
+  SwitchPoint switch_point = switch_point_after(*(++current.begin()));
+  auto it = find_switch_segment(target, switch_point, true);
+  ASSERT_TRUE(it != target.end());
+  EXPECT_EQ(12, it->media_sequence);
+}
+
+TEST_F(SwitchPlannerTest, MisalignedSequencesUseTime) {
+  // Same content, the target numbers its segments from 0
+  std::list<Segment> current = make_segments(10, 6, 5);
+  std::list<Segment> target = make_segments(0, 6, 5);
+  SwitchPoint switch_point = switch_point_after(*(++current.begin()));
+  auto it = find_switch_segment(target, switch_point, true);
+  ASSERT_TRUE(it != target.end());
+  EXPECT_EQ(2, it->media_sequence);
+  // Shorter segments in the target, next boundary at or after 12 seconds
+  target = make_segments(0, 5, 5);
+  it = find_switch_segment(target, switch_point, true);
+  ASSERT_TRUE(it != target.end());
+  EXPECT_EQ(3, it->media_sequence);
+}
+
+TEST_F(SwitchPlannerTest, DiscontinuitySequenceMustMatch) {
+  std::list<Segment> current = make_segments(10, 6, 5, 12);
+  std::list<Segment> target = make_segments(10, 6, 5, 12);
+  SwitchPoint switch_point = switch_point_at(*(++(++current.begin())));
+  EXPECT_EQ(1, switch_point.discontinuity_sequence);
+  auto it = find_switch_segment(target, switch_point, true);
+  ASSERT_TRUE(it != target.end());
+  EXPECT_EQ(12, it->media_sequence);
+  // Target without the discontinuity can't be matched by sequence
+  target = make_segments(10, 6, 5);
+  it = find_switch_segment(target, switch_point, false);
+  EXPECT_TRUE(it == target.end());
+}
+
+TEST_F(SwitchPlannerTest, LiveWaitsForSegment) {
+  // Live playlists loaded at different times have different time bases
+  std::list<Segment> current = make_segments(100, 6, 5);
+  std::list<Segment> target = make_segments(102, 6, 3);
+  SwitchPoint switch_point = switch_point_after(current.back());
+  EXPECT_TRUE(find_switch_segment(target, switch_point, false) == target.end());
+  switch_point = switch_point_at(*(++(++(++current.begin()))));
+  auto it = find_switch_segment(target, switch_point, false);
+  ASSERT_TRUE(it != target.end());
+  EXPECT_EQ(103, it->media_sequence);
+}
+
+}
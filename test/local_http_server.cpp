@@ -0,0 +1,143 @@
+/*
+ * local_http_server.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <sstream>
+
+#include "local_http_server.h"
+
+static const int POLL_TIMEOUT_MS = 50;
+
+LocalHttpServer::LocalHttpServer() :
+listen_socket(-1),
+port(0),
+quit_processing(false),
+connection_count(0),
+request_count(0) {
+  listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  bind(listen_socket, (sockaddr*) &addr, sizeof(addr));
+  listen(listen_socket, 16);
+  socklen_t addr_len = sizeof(addr);
+  getsockname(listen_socket, (sockaddr*) &addr, &addr_len);
+  port = ntohs(addr.sin_port);
+  accept_thread = std::thread(&LocalHttpServer::accept_connections, this);
+}
+
+LocalHttpServer::~LocalHttpServer() {
+  quit_processing = true;
+  accept_thread.join();
+  std::lock_guard<std::mutex> lock(client_mutex);
+  for(auto it = client_threads.begin(); it != client_threads.end(); ++it) {
+    it->join();
+  }
+  close(listen_socket);
+}
+
+void LocalHttpServer::add_file(std::string path, std::string contents) {
+  std::lock_guard<std::mutex> lock(files_mutex);
+  files[path] = contents;
+}
+
+std::string LocalHttpServer::get_url(std::string path) {
+  return "http://127.0.0.1:" + std::to_string(port) + path;
+}
+
+std::string LocalHttpServer::get_file(std::string path, bool &found) {
+  std::lock_guard<std::mutex> lock(files_mutex);
+  auto it = files.find(path);
+  found = it != files.end();
+  return found ? it->second : "";
+}
+
+void LocalHttpServer::accept_connections() {
+  while(!quit_processing) {
+    pollfd fd = { listen_socket, POLLIN, 0 };
+    if (poll(&fd, 1, POLL_TIMEOUT_MS) <= 0) {
+      continue;
+    }
+    int client = accept(listen_socket, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    ++connection_count;
+    std::lock_guard<std::mutex> lock(client_mutex);
+    client_threads.push_back(std::thread(&LocalHttpServer::handle_connection, this, client));
+  }
+}
+
+void LocalHttpServer::handle_connection(int client) {
+  std::string buffer;
+  char data[4096];
+  while(!quit_processing) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+      pollfd fd = { client, POLLIN, 0 };
+      if (poll(&fd, 1, POLL_TIMEOUT_MS) <= 0) {
+        continue;
+      }
+      ssize_t received = recv(client, data, sizeof(data), 0);
+      if (received <= 0) {
+        break;
+      }
+      buffer.append(data, received);
+      continue;
+    }
+    std::string request = buffer.substr(0, header_end);
+    buffer.erase(0, header_end + 4);
+    ++request_count;
+
+    std::istringstream lines(request);
+    std::string method, path;
+    lines >> method >> path;
+    std::string line, range;
+    while(std::getline(lines, line)) {
+      if (line.find("Range: bytes=") == 0) {
+        range = line.substr(13);
+      }
+    }
+
+    bool found;
+    std::string body = get_file(path, found);
+    std::string status = "200 OK";
+    if (!found) {
+      status = "404 Not Found";
+    } else if (!range.empty()) {
+      size_t dash = range.find('-');
+      size_t start = std::strtoul(range.substr(0, dash).c_str(), nullptr, 10);
+      size_t end = body.size() - 1;
+      if (dash + 1 < range.size() && range[dash + 1] != '\r') {
+        end = std::min<size_t>(end, std::strtoul(range.substr(dash + 1).c_str(), nullptr, 10));
+      }
+      body = start < body.size() ? body.substr(start, end - start + 1) : "";
+      status = "206 Partial Content";
+    }
+    std::string response = "HTTP/1.1 " + status + "\r\n" +
+        "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+        "Connection: keep-alive\r\n\r\n";
+    if (method != "HEAD") {
+      response += body;
+    }
+    size_t sent = 0;
+    while(sent < response.size()) {
+      ssize_t result = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (result <= 0) {
+        break;
+      }
+      sent += result;
+    }
+  }
+  close(client);
+}
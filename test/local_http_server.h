@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *      Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Minimal HTTP/1.1 server on 127.0.0.1 used to test downloaders without
+// the network.  Supports keep-alive, HEAD and single byte ranges.
+class LocalHttpServer {
+public:
+  LocalHttpServer();
+  ~LocalHttpServer();
+  void add_file(std::string path, std::string contents);
+  std::string get_url(std::string path);
+  // Number of TCP connections accepted so far
+  int get_connection_count() { return connection_count; };
+  int get_request_count() { return request_count; };
+private:
+  void accept_connections();
+  void handle_connection(int client);
+  std::string get_file(std::string path, bool &found);
+private:
+  int listen_socket;
+  int port;
+  std::atomic<bool> quit_processing;
+  std::atomic<int> connection_count;
+  std::atomic<int> request_count;
+  std::mutex files_mutex;
+  std::map<std::string, std::string> files;
+  std::thread accept_thread;
+  std::mutex client_mutex;
+  std::vector<std::thread> client_threads;
+};
@@ -0,0 +1,140 @@
+/*
+ * request_scheduler_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "../src/downloader/request_scheduler.h"
+
+// Every request holds its connection until the test releases its location
+class HoldingDownloader : public Downloader {
+public:
+  std::string download(std::string location) {
+    hold(location);
+    return location;
+  };
+  bool download(std::string location, uint32_t byte_offset, uint32_t byte_length, DownloadCallback func) {
+    hold(location);
+    return true;
+  };
+  void release(std::string location) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      released[location] = true;
+    }
+    cv.notify_all();
+  };
+  int get_started(std::string location) {
+    std::lock_guard<std::mutex> guard(lock);
+    return started[location];
+  };
+  // Waits up to a second for a request to start
+  bool wait_for_start(std::string location) {
+    std::unique_lock<std::mutex> guard(lock);
+    return cv.wait_for(guard, std::chrono::seconds(1), [&] {
+      return started[location] > 0;
+    });
+  };
+private:
+  void hold(std::string location) {
+    std::unique_lock<std::mutex> guard(lock);
+    ++started[location];
+    cv.notify_all();
+    cv.wait(guard, [&] {
+      return released[location];
+    });
+  };
+  std::mutex lock;
+  std::condition_variable cv;
+  std::map<std::string, int> started;
+  std::map<std::string, bool> released;
+};
+
+class RequestSchedulerTest : public ::testing::Test {
+protected:
+  RequestSchedulerTest() : scheduler(&downloader) {};
+  virtual void TearDown() {
+    for(auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+  }
+  void start_segment(std::string location) {
+    threads.push_back(std::thread([this, location] {
+      scheduler.download(RequestClass::SEGMENT, location, 0, 0, [](const uint8_t *, size_t) { return true; });
+    }));
+  }
+  void start(RequestClass request_class, std::string location) {
+    threads.push_back(std::thread([this, request_class, location] {
+      scheduler.download(request_class, location);
+    }));
+  }
+  bool stays_queued(std::string location) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return downloader.get_started(location) == 0;
+  }
+
+  HoldingDownloader downloader;
+  RequestScheduler scheduler;
+  std::vector<std::thread> threads;
+};
+
+TEST_F(RequestSchedulerTest, SharesInFlightDownload) {
+  start(RequestClass::ACTIVE_PLAYLIST, "playlist");
+  ASSERT_TRUE(downloader.wait_for_start("playlist"));
+  std::string contents;
+  std::thread joined([&] {
+    contents = scheduler.download(RequestClass::SPECULATIVE, "playlist");
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  downloader.release("playlist");
+  joined.join();
+  EXPECT_EQ("playlist", contents);
+  EXPECT_EQ(1, downloader.get_started("playlist"));
+}
+
+TEST_F(RequestSchedulerTest, ClassLimit) {
+  start(RequestClass::ACTIVE_PLAYLIST, "first");
+  ASSERT_TRUE(downloader.wait_for_start("first"));
+  start(RequestClass::ACTIVE_PLAYLIST, "second");
+  EXPECT_TRUE(stays_queued("second"));
+  downloader.release("first");
+  EXPECT_TRUE(downloader.wait_for_start("second"));
+  downloader.release("second");
+}
+
+TEST_F(RequestSchedulerTest, SpeculativeWaitsForSegments) {
+  start_segment("segment");
+  ASSERT_TRUE(downloader.wait_for_start("segment"));
+  start(RequestClass::SPECULATIVE, "refresh");
+  EXPECT_TRUE(stays_queued("refresh"));
+  downloader.release("segment");
+  EXPECT_TRUE(downloader.wait_for_start("refresh"));
+  downloader.release("refresh");
+}
+
+TEST_F(RequestSchedulerTest, SegmentsDontQueueBehindSpeculative) {
+  start(RequestClass::SPECULATIVE, "refresh");
+  ASSERT_TRUE(downloader.wait_for_start("refresh"));
+  start_segment("segment");
+  EXPECT_TRUE(downloader.wait_for_start("segment"));
+  downloader.release("segment");
+  downloader.release("refresh");
+}
+
+TEST_F(RequestSchedulerTest, JoiningRaisesClass) {
+  start_segment("segment");
+  ASSERT_TRUE(downloader.wait_for_start("segment"));
+  start(RequestClass::SPECULATIVE, "playlist");
+  EXPECT_TRUE(stays_queued("playlist"));
+  // The active stream needs the playlist the background refresh is waiting on
+  start(RequestClass::ACTIVE_PLAYLIST, "playlist");
+  EXPECT_TRUE(downloader.wait_for_start("playlist"));
+  downloader.release("playlist");
+  downloader.release("segment");
+}
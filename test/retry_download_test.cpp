@@ -0,0 +1,99 @@
+/*
+ * retry_download_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include "gtest/gtest.h"
+
+#include "fault_injecting_downloader.h"
+#include "../src/downloader/retry_download.h"
+
+class RetryDownloadTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    for(size_t i = 0; i < 10000; ++i) {
+      contents += char(i % 251);
+    }
+    policy.wait = [&](std::chrono::milliseconds delay) -> bool {
+      waits.push_back(delay.count());
+      return true;
+    };
+  }
+
+  DownloadCallback append_to(std::string &data) {
+    return [&data](const uint8_t *chunk, size_t length) -> bool {
+      data.append(reinterpret_cast<const char*>(chunk), length);
+      return true;
+    };
+  }
+
+  std::string contents;
+  RetryPolicy policy;
+  std::vector<long long> waits;
+};
+
+TEST_F(RetryDownloadTest, NoFailure) {
+  FaultInjectingDownloader downloader(contents, {});
+  std::string data;
+  EXPECT_TRUE(download_with_retry(&downloader, "http://test/segment.ts", 0, 0, append_to(data), policy));
+  EXPECT_EQ(contents, data);
+  EXPECT_EQ(1, downloader.requests.size());
+  EXPECT_TRUE(waits.empty());
+}
+
+TEST_F(RetryDownloadTest, ResumesMissingRange) {
+  FaultInjectingDownloader downloader(contents, {3000, 2500});
+  std::string data;
+  EXPECT_TRUE(download_with_retry(&downloader, "http://test/segment.ts", 0, 0, append_to(data), policy));
+  EXPECT_EQ(contents, data);
+  ASSERT_EQ(3, downloader.requests.size());
+  EXPECT_EQ(std::make_pair(0u, 0u), downloader.requests.at(0));
+  EXPECT_EQ(std::make_pair(3000u, 0u), downloader.requests.at(1));
+  EXPECT_EQ(std::make_pair(5500u, 0u), downloader.requests.at(2));
+  EXPECT_EQ(std::vector<long long>({250, 500}), waits);
+}
+
+TEST_F(RetryDownloadTest, ResumesWithinByteRange) {
+  FaultInjectingDownloader downloader(contents, {2000});
+  std::string data;
+  EXPECT_TRUE(download_with_retry(&downloader, "http://test/segment.ts", 1000, 5000, append_to(data), policy));
+  EXPECT_EQ(contents.substr(1000, 5000), data);
+  ASSERT_EQ(2, downloader.requests.size());
+  EXPECT_EQ(std::make_pair(1000u, 5000u), downloader.requests.at(0));
+  EXPECT_EQ(std::make_pair(3000u, 3000u), downloader.requests.at(1));
+}
+
+TEST_F(RetryDownloadTest, GivesUpAfterMaxAttempts) {
+  FaultInjectingDownloader downloader(contents, {100, 100, 100, 100, 100});
+  std::string data;
+  EXPECT_FALSE(download_with_retry(&downloader, "http://test/segment.ts", 0, 0, append_to(data), policy));
+  EXPECT_EQ(policy.max_attempts, downloader.requests.size());
+  EXPECT_EQ(contents.substr(0, 400), data);
+}
+
+TEST_F(RetryDownloadTest, BackoffIsCapped) {
+  policy.max_attempts = 7;
+  FaultInjectingDownloader downloader(contents, {10, 10, 10, 10, 10, 10, 10});
+  std::string data;
+  EXPECT_FALSE(download_with_retry(&downloader, "http://test/segment.ts", 0, 0, append_to(data), policy));
+  EXPECT_EQ(std::vector<long long>({250, 500, 1000, 2000, 4000, 4000}), waits);
+}
+
+TEST_F(RetryDownloadTest, CancelDoesNotRetry) {
+  FaultInjectingDownloader downloader(contents, {});
+  EXPECT_FALSE(download_with_retry(&downloader, "http://test/segment.ts", 0, 0,
+      [](const uint8_t *data, size_t length) -> bool {
+    return false;
+  }, policy));
+  EXPECT_EQ(1, downloader.requests.size());
+  EXPECT_TRUE(waits.empty());
+}
+
+TEST_F(RetryDownloadTest, StopsWhenWaitIsInterrupted) {
+  policy.wait = [](std::chrono::milliseconds delay) -> bool {
+    return false;
+  };
+  FaultInjectingDownloader downloader(contents, {3000});
+  std::string data;
+  EXPECT_FALSE(download_with_retry(&downloader, "http://test/segment.ts", 0, 0, append_to(data), policy));
+  EXPECT_EQ(1, downloader.requests.size());
+}
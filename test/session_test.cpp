@@ -3,6 +3,8 @@
  */
 
 #include <limits.h>
+#include <map>
+#include <vector>
 #include "gtest/gtest.h"
 #include "helpers.h"
 
@@ -35,6 +37,77 @@ TEST_F(SessionTest, GetStreams) {
   EXPECT_EQ(2, session->get_streams().m_streamCount);
 }
 
+TEST_F(SessionTest, DisabledStreamHasNoPackets) {
+  session->read_next_pkt();
+  INPUTSTREAM_IDS ids = session->get_streams();
+  ASSERT_EQ(2, ids.m_streamCount);
+  uint32_t disabled = ids.m_streamIds[1];
+  session->enable_stream(disabled, false);
+  // Still listed for the player
+  EXPECT_EQ(2, session->get_streams().m_streamCount);
+  int packets = 0;
+  for(int i = 0; i < 200; ++i) {
+    session->read_next_pkt();
+    DemuxContainer demux_container = session->get_current_pkt();
+    if (!demux_container.demux_packet) {
+      break;
+    }
+    if (demux_container.demux_packet->iStreamId != DMX_SPECIALID_STREAMCHANGE) {
+      EXPECT_NE(disabled, demux_container.demux_packet->iStreamId);
+      ++packets;
+    }
+  }
+  EXPECT_LT(0, packets);
+}
+
+TEST_F(SessionTest, SeekGoesToKeyframeInSegment) {
+  // Plays the first segment so its keyframes are known
+  std::map<int, std::vector<double>> keyframes;
+  // Audio frames are all keyframes
+  int video = -1;
+  for(int i = 0; i < 2000; ++i) {
+    session->read_next_pkt();
+    DemuxContainer demux_container = session->get_current_pkt();
+    DemuxPacket *packet = demux_container.demux_packet;
+    if (!packet || demux_container.segment.media_sequence != 0) {
+      break;
+    }
+    if (packet->iStreamId == DMX_SPECIALID_STREAMCHANGE) {
+      continue;
+    }
+    if (demux_container.keyframe) {
+      keyframes[packet->iStreamId].push_back(packet->pts);
+    } else {
+      video = packet->iStreamId;
+    }
+  }
+  ASSERT_NE(-1, video);
+  ASSERT_LE(3u, keyframes[video].size());
+  // One inside the segment, not the one it starts with
+  double keyframe = keyframes[video][1];
+
+  double startpts;
+  // Right after the keyframe, backwards
+  ASSERT_TRUE(session->seek_time(keyframe / 1000 + 500, true, &startpts));
+  EXPECT_DOUBLE_EQ(keyframe, startpts);
+  // Right before it, forwards
+  ASSERT_TRUE(session->seek_time(keyframe / 1000 - 500, false, &startpts));
+  EXPECT_DOUBLE_EQ(keyframe, startpts);
+
+  // Nothing before the keyframe comes out
+  DemuxContainer demux_container;
+  for(int i = 0; i < 200; ++i) {
+    session->read_next_pkt();
+    demux_container = session->get_current_pkt();
+    if (!demux_container.demux_packet || demux_container.demux_packet->iStreamId == video) {
+      break;
+    }
+  }
+  ASSERT_NE(nullptr, demux_container.demux_packet);
+  EXPECT_TRUE(demux_container.keyframe);
+  EXPECT_DOUBLE_EQ(keyframe, demux_container.demux_packet->pts);
+}
+
 TEST_F(SessionTest, ReadUntilEnd) {
   /*
   while(true) {
@@ -63,5 +136,37 @@ protected:
   Session *session;
 };
 
+class LiveSessionTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    FileMasterPlaylist master_playlist = FileMasterPlaylist();
+    master_playlist.open("test/hls/live_session.m3u8");
+    session = new Session(master_playlist, new FileDownloader(), 0, 0, true);
+  }
+
+  virtual void TearDown() {
+    delete session;
+  }
+
+  Session *session;
+};
+
+TEST_F(LiveSessionTest, LatencyFromLiveEdge) {
+  EXPECT_EQ(-1, session->get_live_latency());
+  // Both segments are listed, the hold-back is longer so it starts at the first
+  for(int i = 0; i < 2000; ++i) {
+    session->read_next_pkt();
+    DemuxContainer demux_container = session->get_current_pkt();
+    if (!demux_container.demux_packet || demux_container.segment.media_sequence != 0) {
+      break;
+    }
+  }
+  ASSERT_TRUE(session->is_live());
+  // Measured when the second segment started, the live edge is at least
+  // at the end of it
+  double latency = session->get_live_latency();
+  EXPECT_LE(10, latency);
+  EXPECT_GE(30, latency);
+}
 
 }
@@ -0,0 +1,80 @@
+/*
+ * throughput_history_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <cstdio>
+
+#include "gtest/gtest.h"
+
+#include "../src/downloader/throughput_history.h"
+
+static const std::time_t NOW = 1500000000;
+static const std::time_t DAY = 24 * 60 * 60;
+
+TEST(ThroughputHistoryTest, Empty) {
+  ThroughputHistory history;
+  EXPECT_EQ(0, history.get_start_bandwidth("http://host", NOW));
+  EXPECT_EQ(0, history.get_latency("http://host", NOW));
+}
+
+TEST(ThroughputHistoryTest, KeptPerHost) {
+  ThroughputHistory history;
+  history.add_sample("http://slow", 1000000, 0, NOW);
+  history.add_sample("http://fast", 20000000, 0, NOW);
+  EXPECT_EQ(1000000, history.get_throughput("http://slow", NOW, 0.5));
+  EXPECT_EQ(20000000, history.get_throughput("http://fast", NOW, 0.5));
+  // A new host gets what was seen with all of them
+  EXPECT_EQ(1000000, history.get_throughput("http://other", NOW, 0.0));
+  EXPECT_EQ(20000000, history.get_throughput("http://other", NOW, 1.0));
+}
+
+TEST(ThroughputHistoryTest, OldSessionsCountLess) {
+  ThroughputHistory history;
+  history.add_sample("http://host", 1000000, 0, NOW - 60 * DAY);
+  history.add_sample("http://host", 5000000, 0, NOW);
+  EXPECT_EQ(5000000, history.get_throughput("http://host", NOW, 0.25));
+}
+
+TEST(ThroughputHistoryTest, LatencyLowersStartBandwidth) {
+  ThroughputHistory history;
+  history.add_sample("http://near", 6000000, 0.0, NOW);
+  history.add_sample("http://far", 6000000, 2.0, NOW);
+  EXPECT_EQ(6000000, history.get_start_bandwidth("http://near", NOW));
+  EXPECT_NEAR(2.0, history.get_latency("http://far", NOW), 0.001);
+  EXPECT_NEAR(4500000, history.get_start_bandwidth("http://far", NOW), 1);
+}
+
+TEST(ThroughputHistoryTest, KeepsRecentSessions) {
+  ThroughputHistory history;
+  history.add_sample("http://host", 100, 0, NOW);
+  for(size_t i = 0; i < HISTORY_SAMPLES_PER_HOST; ++i) {
+    history.add_sample("http://host", 1000000, 0, NOW);
+  }
+  EXPECT_EQ(1000000, history.get_throughput("http://host", NOW, 0.0));
+}
+
+TEST(ThroughputHistoryTest, SaveAndLoad) {
+  std::string path = testing::TempDir() + "throughput_history.txt";
+  ThroughputHistory history;
+  history.add_sample("http://host", 3000000, 0.1, NOW);
+  ASSERT_TRUE(history.save(path));
+  ThroughputHistory loaded;
+  EXPECT_TRUE(loaded.load(path, ""));
+  EXPECT_EQ(3000000, loaded.get_throughput("http://host", NOW, 0.5));
+  EXPECT_NEAR(0.1, loaded.get_latency("http://host", NOW), 0.001);
+  remove(path.c_str());
+}
+
+TEST(ThroughputHistoryTest, MigratesBandwidthFile) {
+  std::string path = testing::TempDir() + "missing_history.txt";
+  std::string legacy_path = testing::TempDir() + "bandwidth.bin";
+  FILE *f = fopen(legacy_path.c_str(), "wb");
+  ASSERT_TRUE(f);
+  double bandwidth = 2500000;
+  fwrite(&bandwidth, sizeof(double), 1, f);
+  fclose(f);
+  ThroughputHistory history;
+  EXPECT_TRUE(history.load(path, legacy_path));
+  EXPECT_EQ(2500000, history.get_throughput("http://host", std::time(nullptr), 0.5));
+  remove(legacy_path.c_str());
+}
@@ -0,0 +1,150 @@
+/*
+ * worker_pool_test.cpp Copyright (C) 2017 Anthony Waters <awaters1@gmail.com>
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "gtest/gtest.h"
+
+#include "../src/worker_pool.h"
+
+class WorkerPoolTest : public ::testing::Test {
+protected:
+  // Waits up to a second for the count to reach the value
+  bool wait_for_count(int value) {
+    std::unique_lock<std::mutex> lock(count_lock);
+    return count_cv.wait_for(lock, std::chrono::seconds(1), [&] {
+      return count >= value;
+    });
+  }
+  void increment() {
+    {
+      std::lock_guard<std::mutex> lock(count_lock);
+      ++count;
+    }
+    count_cv.notify_all();
+  }
+  std::mutex count_lock;
+  std::condition_variable count_cv;
+  int count = 0;
+};
+
+TEST_F(WorkerPoolTest, RunsTasks) {
+  WorkerPool pool(2);
+  EXPECT_EQ(2, pool.get_worker_count());
+  for(int i = 0; i < 100; ++i) {
+    pool.submit([this] { increment(); });
+  }
+  EXPECT_TRUE(wait_for_count(100));
+}
+
+TEST_F(WorkerPoolTest, IdleWorkerStealsTasks) {
+  WorkerPool pool(2);
+  std::atomic<int> started(0);
+  // Both subtasks go on the queue of the worker running the outer task,
+  // they can only run at the same time if the other worker steals one
+  auto subtask = [&] {
+    ++started;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while(started < 2 && std::chrono::steady_clock::now() < end) {
+      std::this_thread::yield();
+    }
+    increment();
+  };
+  pool.submit([&] {
+    pool.submit(subtask);
+    pool.submit(subtask);
+  });
+  EXPECT_TRUE(wait_for_count(2));
+  EXPECT_EQ(2, started);
+}
+
+TEST_F(WorkerPoolTest, DelayedTask) {
+  WorkerPool pool(1);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  pool.submit_after(std::chrono::milliseconds(50), [this] { increment(); });
+  EXPECT_TRUE(wait_for_count(1));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+}
+
+TEST_F(WorkerPoolTest, CancelDropsQueuedTasks) {
+  WorkerPool pool(1);
+  std::mutex block;
+  std::unique_lock<std::mutex> blocked(block);
+  // Keeps the only worker busy so the group's tasks stay queued
+  pool.submit([&] {
+    std::lock_guard<std::mutex> lock(block);
+  });
+  TaskGroup group(&pool);
+  group.submit([this] { increment(); });
+  group.submit_after(std::chrono::milliseconds(10), [this] { increment(); });
+  group.cancel();
+  group.submit([this] { increment(); });
+  blocked.unlock();
+  pool.submit([this] { increment(); });
+  EXPECT_TRUE(wait_for_count(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(1, count);
+}
+
+TEST_F(WorkerPoolTest, CancelWaitsForRunningTask) {
+  WorkerPool pool(1);
+  TaskGroup group(&pool);
+  std::atomic<bool> started(false);
+  std::atomic<bool> finished(false);
+  group.submit([&] {
+    started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    finished = true;
+  });
+  while(!started) {
+    std::this_thread::yield();
+  }
+  group.cancel();
+  EXPECT_TRUE(finished);
+}
+
+TEST_F(WorkerPoolTest, SerialTaskCoalescesTriggers) {
+  WorkerPool pool(2);
+  TaskGroup group(&pool);
+  std::atomic<int> running(0);
+  std::atomic<bool> overlapped(false);
+  SerialTask task(&group, [&] {
+    if (++running > 1) {
+      overlapped = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    --running;
+    increment();
+  });
+  for(int i = 0; i < 10; ++i) {
+    task.trigger();
+  }
+  // One queued run covers all of the triggers
+  EXPECT_TRUE(wait_for_count(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(1, count);
+  EXPECT_FALSE(overlapped);
+  group.cancel();
+}
+
+TEST_F(WorkerPoolTest, SerialTaskRunsAgainWhenTriggeredWhileRunning) {
+  WorkerPool pool(2);
+  TaskGroup group(&pool);
+  std::atomic<bool> started(false);
+  SerialTask task(&group, [&] {
+    started = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    increment();
+  });
+  task.trigger();
+  while(!started) {
+    std::this_thread::yield();
+  }
+  task.trigger();
+  EXPECT_TRUE(wait_for_count(2));
+  group.cancel();
+}